@@ -26,11 +26,14 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
@@ -40,9 +43,162 @@
  * @defgroup libuio_attr libuio attribute functions
  * @ingroup libuio_public
  * @brief public attribute functions
+ *
+ * Attribute files are opened once per device and kept open in a handle
+ * cache owned by the device info struct. sysfs regenerates the content
+ * on every read at offset 0 and takes every write at offset 0 as a
+ * store, so repeated access is a single pread() or pwrite().
  * @{
  */
 
+#define ATTR_PAGE	4096
+#define ATTR_NUM	64
+#define ATTR_CHUNK	65536
+
+struct uio_attr_t {
+	struct uio_attr_t *next;
+	int fd;
+	char name [];
+};
+
+struct uio_attr_notify_t {
+	int fd;
+};
+
+/**
+ * resolve an attribute name to a cached handle
+ *
+ * The handle stays valid until uio_free_info() is called on info.
+ * @param info UIO device info struct
+ * @param attr attribute name
+ * @returns attribute handle or NULL on failure and errno is set
+ */
+struct uio_attr_t *uio_attr_open (struct uio_info_t* info, const char *attr)
+{
+	struct uio_attr_t *handle, *head;
+	char filename [PATH_MAX];
+	int fd;
+
+	if (!info || !attr || strchr (attr, '/'))
+	{
+		errno = EINVAL;
+		ctx_warn (info_ctx (info), _("%s: %s"), __func__,
+			  g_strerror (errno));
+		return NULL;
+	}
+
+	head = __atomic_load_n (&info->attrs, __ATOMIC_ACQUIRE);
+	for (handle = head; handle; handle = handle->next)
+		if (!strcmp (handle->name, attr))
+			return handle;
+
+	snprintf (filename, PATH_MAX, "%s/attr/%s", info->path, attr);
+
+	fd = open (filename, O_RDWR | O_CLOEXEC);
+	if (fd < 0 && errno == EACCES)
+		fd = open (filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0 && errno == EACCES)
+		fd = open (filename, O_WRONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		ctx_err (info_ctx (info), _("open: %s: %s"), filename,
+			 g_strerror (errno));
+		return NULL;
+	}
+
+	handle = malloc (sizeof (*handle) + strlen (attr) + 1);
+	if (!handle)
+	{
+		close (fd);
+		errno = ENOMEM;
+		ctx_err (info_ctx (info), _("%s: %s"), __func__,
+			 g_strerror (errno));
+		return NULL;
+	}
+	handle->fd = fd;
+	strcpy (handle->name, attr);
+
+	/* publish, or use the handle a concurrent caller published first */
+	do {
+		for (handle->next = head; head; head = head->next)
+			if (!strcmp (head->name, attr))
+			{
+				close (fd);
+				free (handle);
+				return head;
+			}
+		head = handle->next;
+	} while (!__atomic_compare_exchange_n (&info->attrs, &head, handle, 0,
+					       __ATOMIC_RELEASE,
+					       __ATOMIC_ACQUIRE));
+
+	return handle;
+}
+
+/**
+ * read an attribute through its handle
+ * @param handle attribute handle
+ * @param buf buffer
+ * @param count buffer size
+ * @returns number of bytes read or -1 on failure and errno is set
+ */
+ssize_t uio_attr_read (struct uio_attr_t *handle, void *buf, size_t count)
+{
+	if (!handle || !buf)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	return pread (handle->fd, buf, count, 0);
+}
+
+/**
+ * write an attribute through its handle
+ * @param handle attribute handle
+ * @param buf attribute content
+ * @param count content size
+ * @returns number of bytes written or -1 on failure and errno is set
+ */
+ssize_t uio_attr_write (struct uio_attr_t *handle, const void *buf,
+			size_t count)
+{
+	if (!handle || !buf)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	return pwrite (handle->fd, buf, count, 0);
+}
+
+/**
+ * get the file descriptor behind an attribute handle
+ * @param handle attribute handle
+ * @returns file descriptor
+ */
+int attr_handle_fd (struct uio_attr_t *handle)
+{
+	return handle->fd;
+}
+
+/**
+ * close all cached attribute handles of a device
+ * @param info UIO device info struct
+ */
+void attr_free_handles (struct uio_info_t* info)
+{
+	struct uio_attr_t *handle, *next;
+
+	for (handle = info->attrs; handle; handle = next)
+	{
+		next = handle->next;
+		close (handle->fd);
+		free (handle);
+	}
+	info->attrs = NULL;
+}
+
 /**
  * list UIO attributes
  * @param info UIO device info struct
@@ -58,7 +214,8 @@ char **uio_list_attr (struct uio_info_t* info)
 	if (!info)
 	{
 		errno = EINVAL;
-		g_warning (_("uio_list_attr: %s"), g_strerror (errno));
+		ctx_warn (info_ctx (info), _("uio_list_attr: %s"),
+			  g_strerror (errno));
 		return NULL;
 	}
 
@@ -70,7 +227,8 @@ char **uio_list_attr (struct uio_info_t* info)
 		if (ENOENT == errno){
 			return NULL;
 		}
-		g_warning (_("scandir: %s"), g_strerror (errno));
+		ctx_err (info_ctx (info), _("scandir: %s"),
+			 g_strerror (errno));
 		return NULL;
 	}
 
@@ -78,7 +236,7 @@ char **uio_list_attr (struct uio_info_t* info)
 	if (!list)
 	{
 		errno = ENOMEM;
-		g_warning (_("calloc: %s"), g_strerror (errno));
+		ctx_err (info_ctx (info), _("calloc: %s"), g_strerror (errno));
 		goto out;
 	}
 
@@ -109,16 +267,34 @@ out:
  */
 char *uio_get_attr (struct uio_info_t* info, char *attr)
 {
-	char filename [PATH_MAX];
+	struct uio_attr_t *handle;
+	char buf [ATTR_PAGE], *nl;
+	ssize_t len;
 
 	if (!info || !attr)
 	{
-		g_warning (_("uio_get_attr: %s\n"), g_strerror (EINVAL));
+		ctx_warn (info_ctx (info), _("uio_get_attr: %s"),
+			  g_strerror (EINVAL));
 		return NULL;
 	}
-	snprintf (filename, PATH_MAX, "%s/attr/%s", info->path, attr);
 
-	return first_line_from_file (filename);
+	handle = uio_attr_open (info, attr);
+	if (!handle)
+		return NULL;
+
+	len = uio_attr_read (handle, buf, sizeof (buf) - 1);
+	if (len < 0)
+	{
+		ctx_err (info_ctx (info), _("read: %s"), g_strerror (errno));
+		return NULL;
+	}
+	buf [len] = 0;
+
+	nl = strchr (buf, '\n');
+	if (nl)
+		*nl = 0;
+
+	return strdup (buf);
 }
 
 /**
@@ -130,33 +306,68 @@ char *uio_get_attr (struct uio_info_t* info, char *attr)
  */
 int uio_set_attr (struct uio_info_t* info, char *attr, char *value)
 {
-	char filename [PATH_MAX];
-	int err, fd, ret = -1;
-	size_t len;
+	struct uio_attr_t *handle;
 
 	if (!info || !attr || !value) {
 		errno = EINVAL;
-		g_warning (_("uio_set_attr: %s"), g_strerror (errno));
+		ctx_warn (info_ctx (info), _("uio_set_attr: %s"),
+			  g_strerror (errno));
 		return -1;
 	}
-	snprintf (filename, PATH_MAX, "%s/attr/%s", info->path, attr);
 
-	fd = open (filename, O_WRONLY);
-	if (fd < 0)
-	{
-		g_warning (_("open: %s"), g_strerror (errno));
+	handle = uio_attr_open (info, attr);
+	if (!handle)
 		return -1;
+
+	return (uio_attr_write (handle, value, strlen (value)) > 0) ? 0 : -1;
+}
+
+static ssize_t attr_pread_full (int fd, void *buf, size_t count, off_t offset)
+{
+	size_t done = 0;
+	ssize_t len;
+
+	/* sysfs hands out at most a page per call */
+	while (done < count)
+	{
+		len = pread (fd, (char *) buf + done, count - done,
+			     offset + done);
+		if (len < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return done ? (ssize_t) done : -1;
+		}
+		if (!len)
+			break;
+		done += len;
 	}
 
-	len = write (fd, value, strlen (value));
-	if (len > 0)
-		ret = 0;
+	return done;
+}
 
-	err = errno;
-	close (fd);
-	errno = err;
+static ssize_t attr_pwrite_full (int fd, const void *buf, size_t count,
+				 off_t offset)
+{
+	size_t done = 0;
+	ssize_t len;
 
-	return ret;
+	while (done < count)
+	{
+		len = pwrite (fd, (const char *) buf + done, count - done,
+			      offset + done);
+		if (len < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return done ? (ssize_t) done : -1;
+		}
+		if (!len)
+			break;
+		done += len;
+	}
+
+	return done;
 }
 
 /**
@@ -168,15 +379,15 @@ int uio_set_attr (struct uio_info_t* info, char *attr, char *value)
  */
 void *uio_get_bin_attr (struct uio_info_t* info, char *attr, size_t count)
 {
-	char filename [PATH_MAX];
+	struct uio_attr_t *handle;
 	void *value;
-	size_t len;
-	int err, fd;
+	ssize_t len;
 
 	if (!info || !attr || count <= 0)
 	{
 		errno = EINVAL;
-		g_warning (_("uio_get_bin_attr: %s\n"), g_strerror (errno));
+		ctx_warn (info_ctx (info), _("uio_get_bin_attr: %s"),
+			  g_strerror (errno));
 		return NULL;
 	}
 
@@ -184,31 +395,25 @@ void *uio_get_bin_attr (struct uio_info_t* info, char *attr, size_t count)
 	if (!value)
 	{
 		errno = ENOMEM;
-		g_warning (_("uio_get_bin_attr: %s\n"), g_strerror (errno));
+		ctx_err (info_ctx (info), _("uio_get_bin_attr: %s"),
+			 g_strerror (errno));
 		return NULL;
 	}
 
-	snprintf (filename, PATH_MAX, "%s/attr/%s", info->path, attr);
-
-	fd = open (filename, O_RDONLY);
-	if (fd < 0)
+	handle = uio_attr_open (info, attr);
+	if (!handle)
 	{
 		free (value);
-		g_warning (_("open: %s"), g_strerror (errno));
 		return NULL;
 	}
 
-	len = read (fd, value, count);
+	len = attr_pread_full (handle->fd, value, count, 0);
 	if (len <= 0)
 	{
 		free (value);
 		value = NULL;
 	}
 
-	err = errno;
-	close (fd);
-	errno = err;
-
 	return value;
 }
 
@@ -222,33 +427,661 @@ void *uio_get_bin_attr (struct uio_info_t* info, char *attr, size_t count)
 int uio_set_bin_attr (struct uio_info_t* info, char *attr,
 		      void *value, size_t count)
 {
-	char filename [PATH_MAX];
-	int err, fd, ret = -1;
-	size_t len;
+	struct uio_attr_t *handle;
 
 	if (!info || !attr || !value) {
 		errno = EINVAL;
-		g_warning (_("uio_set_attr: %s"), g_strerror (errno));
+		ctx_warn (info_ctx (info), _("uio_set_attr: %s"),
+			  g_strerror (errno));
 		return -1;
 	}
+
+	handle = uio_attr_open (info, attr);
+	if (!handle)
+		return -1;
+
+	return (attr_pwrite_full (handle->fd, value, count, 0) ==
+		(ssize_t) count) ? 0 : -1;
+}
+
+/**
+ * read a binary attribute into a caller buffer
+ *
+ * Reads in chunks until count bytes are transferred or the end of the
+ * attribute is reached.
+ * @param info UIO device info struct
+ * @param attr attribute name
+ * @param buf buffer
+ * @param count number of bytes to read
+ * @param offset offset within the attribute
+ * @returns number of bytes read or -1 on failure and errno is set
+ */
+ssize_t uio_read_bin_attr (struct uio_info_t* info, const char *attr,
+			   void *buf, size_t count, off_t offset)
+{
+	struct uio_attr_t *handle;
+
+	if (!buf || offset < 0)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	handle = uio_attr_open (info, attr);
+	if (!handle)
+		return -1;
+
+	return attr_pread_full (handle->fd, buf, count, offset);
+}
+
+/**
+ * write a binary attribute from a caller buffer
+ *
+ * Writes in chunks until count bytes are transferred.
+ * @param info UIO device info struct
+ * @param attr attribute name
+ * @param buf attribute content
+ * @param count number of bytes to write
+ * @param offset offset within the attribute
+ * @returns number of bytes written or -1 on failure and errno is set
+ */
+ssize_t uio_write_bin_attr (struct uio_info_t* info, const char *attr,
+			    const void *buf, size_t count, off_t offset)
+{
+	struct uio_attr_t *handle;
+
+	if (!buf || offset < 0)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	handle = uio_attr_open (info, attr);
+	if (!handle)
+		return -1;
+
+	return attr_pwrite_full (handle->fd, buf, count, offset);
+}
+
+/**
+ * stream a binary attribute chunk by chunk
+ *
+ * Reads from offset to the end of the attribute and hands each chunk
+ * to cb; a non-zero return of cb stops the stream.
+ * @param info UIO device info struct
+ * @param attr attribute name
+ * @param offset start offset within the attribute
+ * @param cb chunk callback
+ * @param arg passed to cb
+ * @returns number of bytes streamed or -1 on failure and errno is set
+ */
+ssize_t uio_stream_bin_attr (struct uio_info_t* info, const char *attr,
+			     off_t offset, uio_bin_attr_cb_t cb, void *arg)
+{
+	struct uio_attr_t *handle;
+	ssize_t len, total = 0;
+	void *buf;
+
+	if (!cb || offset < 0)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	handle = uio_attr_open (info, attr);
+	if (!handle)
+		return -1;
+
+	buf = malloc (ATTR_CHUNK);
+	if (!buf)
+	{
+		errno = ENOMEM;
+		ctx_err (info_ctx (info), _("%s: %s"), __func__,
+			 g_strerror (errno));
+		return -1;
+	}
+
+	for (;;)
+	{
+		len = attr_pread_full (handle->fd, buf, ATTR_CHUNK, offset);
+		if (len <= 0)
+		{
+			if (len < 0)
+				total = -1;
+			break;
+		}
+		if (cb (arg, buf, len, offset))
+			break;
+		offset += len;
+		total += len;
+		if (len < ATTR_CHUNK)
+			break;
+	}
+
+	free (buf);
+
+	return total;
+}
+
+/**
+ * get the size of a binary attribute
+ * @param info UIO device info struct
+ * @param attr attribute name
+ * @returns size in bytes (0 if the driver does not tell) or -1 on
+ *	failure and errno is set
+ */
+ssize_t uio_get_bin_attr_size (struct uio_info_t* info, const char *attr)
+{
+	struct uio_attr_t *handle;
+	struct stat st;
+
+	handle = uio_attr_open (info, attr);
+	if (!handle)
+		return -1;
+
+	if (fstat (handle->fd, &st))
+		return -1;
+
+	return st.st_size;
+}
+
+/**
+ * map a binary attribute for zero copy access
+ *
+ * Only works for attributes whose driver provides an mmap handler,
+ * otherwise fails with the errno of mmap (typically EIO or ENODEV).
+ * @param info UIO device info struct
+ * @param attr attribute name
+ * @param prot PROT_READ and/or PROT_WRITE
+ * @param size returns the mapping size
+ * @returns mapping or NULL on failure and errno is set
+ */
+void *uio_map_bin_attr (struct uio_info_t* info, const char *attr, int prot,
+			size_t *size)
+{
+	char filename [PATH_MAX];
+	struct stat st;
+	void *map;
+	int fd, err;
+
+	if (!info || !attr || !size || strchr (attr, '/'))
+	{
+		errno = EINVAL;
+		ctx_warn (info_ctx (info), _("%s: %s"), __func__,
+			  g_strerror (errno));
+		return NULL;
+	}
+
 	snprintf (filename, PATH_MAX, "%s/attr/%s", info->path, attr);
 
-	fd = open (filename, O_WRONLY);
+	fd = open (filename, ((prot & PROT_WRITE) ? O_RDWR : O_RDONLY) |
+		   O_CLOEXEC);
 	if (fd < 0)
 	{
-		g_warning (_("open: %s"), g_strerror (errno));
-		return -1;
+		ctx_err (info_ctx (info), _("open: %s: %s"), filename,
+			 g_strerror (errno));
+		return NULL;
+	}
+
+	map = NULL;
+	if (fstat (fd, &st))
+		goto out;
+	if (!st.st_size)
+	{
+		errno = EINVAL;
+		goto out;
 	}
 
-	len = write (fd, value, count);
-	if (len > 0)
-		ret = 0;
+	map = mmap (NULL, st.st_size, prot, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		map = NULL;
+	else
+		*size = st.st_size;
 
+out:
 	err = errno;
 	close (fd);
 	errno = err;
 
-	return ret;
+	return map;
+}
+
+/**
+ * unmap a binary attribute mapped by uio_map_bin_attr()
+ * @param map mapping
+ * @param size mapping size
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_unmap_bin_attr (void *map, size_t size)
+{
+	return munmap (map, size);
+}
+
+/* read a text attribute into a fixed, terminated buffer */
+static int attr_read_str (struct uio_info_t* info, const char *attr,
+			  char *buf, size_t size)
+{
+	struct uio_attr_t *handle;
+	ssize_t len;
+
+	handle = uio_attr_open (info, attr);
+	if (!handle)
+		return -1;
+
+	len = pread (handle->fd, buf, size - 1, 0);
+	if (len < 0)
+		return -1;
+	buf [len] = 0;
+
+	return 0;
+}
+
+static int attr_write_str (struct uio_info_t* info, const char *attr,
+			   const char *buf, int len)
+{
+	struct uio_attr_t *handle;
+
+	handle = uio_attr_open (info, attr);
+	if (!handle)
+		return -1;
+
+	return (pwrite (handle->fd, buf, len, 0) == len) ? 0 : -1;
+}
+
+/* only trailing white space may follow a number */
+static int attr_check_end (const char *buf, const char *end)
+{
+	if (end == buf)
+		return -1;
+	while (*end == ' ' || *end == '\t' || *end == '\n')
+		end++;
+
+	return *end ? -1 : 0;
+}
+
+static int attr_parse_u64 (struct uio_info_t* info, const char *attr,
+			   uint64_t *val, int base)
+{
+	char buf [ATTR_NUM], *end;
+	unsigned long long tmp;
+
+	if (!val || attr_read_str (info, attr, buf, sizeof (buf)))
+		return -1;
+
+	if (strchr (buf, '-'))
+	{
+		errno = ERANGE;
+		return -1;
+	}
+
+	errno = 0;
+	tmp = strtoull (buf, &end, base);
+	if (errno)
+		return -1;
+	if (attr_check_end (buf, end))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	*val = tmp;
+
+	return 0;
+}
+
+/**
+ * get an unsigned 32 bit attribute
+ * @param info UIO device info struct
+ * @param attr attribute name
+ * @param val value, decimal, 0x hex or 0 octal in the attribute
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_get_attr_u32 (struct uio_info_t* info, const char *attr,
+		      uint32_t *val)
+{
+	uint64_t tmp;
+
+	if (!val || attr_parse_u64 (info, attr, &tmp, 0))
+		return -1;
+	if (tmp > UINT32_MAX)
+	{
+		errno = ERANGE;
+		return -1;
+	}
+	*val = tmp;
+
+	return 0;
+}
+
+/**
+ * get an unsigned 64 bit attribute
+ * @param info UIO device info struct
+ * @param attr attribute name
+ * @param val value, decimal, 0x hex or 0 octal in the attribute
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_get_attr_u64 (struct uio_info_t* info, const char *attr,
+		      uint64_t *val)
+{
+	return attr_parse_u64 (info, attr, val, 0);
+}
+
+/**
+ * get a hexadecimal attribute, with or without 0x prefix
+ * @param info UIO device info struct
+ * @param attr attribute name
+ * @param val value
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_get_attr_hex (struct uio_info_t* info, const char *attr,
+		      uint64_t *val)
+{
+	return attr_parse_u64 (info, attr, val, 16);
+}
+
+/**
+ * get a signed 64 bit attribute
+ * @param info UIO device info struct
+ * @param attr attribute name
+ * @param val value
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_get_attr_s64 (struct uio_info_t* info, const char *attr,
+		      int64_t *val)
+{
+	char buf [ATTR_NUM], *end;
+	long long tmp;
+
+	if (!val || attr_read_str (info, attr, buf, sizeof (buf)))
+		return -1;
+
+	errno = 0;
+	tmp = strtoll (buf, &end, 0);
+	if (errno)
+		return -1;
+	if (attr_check_end (buf, end))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	*val = tmp;
+
+	return 0;
+}
+
+/**
+ * get a boolean attribute
+ *
+ * Accepts 0/1, y/n, yes/no, on/off and true/false in any case.
+ * @param info UIO device info struct
+ * @param attr attribute name
+ * @param val value
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_get_attr_bool (struct uio_info_t* info, const char *attr, int *val)
+{
+	static const char *const yes [] = { "1", "y", "yes", "on", "true" };
+	static const char *const no [] = { "0", "n", "no", "off", "false" };
+	char buf [ATTR_NUM], *end;
+	unsigned i;
+
+	if (!val || attr_read_str (info, attr, buf, sizeof (buf)))
+		return -1;
+
+	for (end = buf; *end && *end != ' ' && *end != '\t' && *end != '\n';
+	     end++);
+	if (attr_check_end (buf, end))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	*end = 0;
+
+	for (i = 0; i < sizeof (yes) / sizeof (yes [0]); i++)
+	{
+		if (!strcasecmp (buf, yes [i]))
+		{
+			*val = 1;
+			return 0;
+		}
+		if (!strcasecmp (buf, no [i]))
+		{
+			*val = 0;
+			return 0;
+		}
+	}
+
+	errno = EINVAL;
+
+	return -1;
+}
+
+/**
+ * set an unsigned 32 bit attribute (decimal)
+ * @param info UIO device info struct
+ * @param attr attribute name
+ * @param val value
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_set_attr_u32 (struct uio_info_t* info, const char *attr,
+		      uint32_t val)
+{
+	char buf [ATTR_NUM];
+
+	return attr_write_str (info, attr, buf,
+			       snprintf (buf, sizeof (buf), "%u\n", val));
+}
+
+/**
+ * set an unsigned 64 bit attribute (decimal)
+ * @param info UIO device info struct
+ * @param attr attribute name
+ * @param val value
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_set_attr_u64 (struct uio_info_t* info, const char *attr,
+		      uint64_t val)
+{
+	char buf [ATTR_NUM];
+
+	return attr_write_str (info, attr, buf,
+			       snprintf (buf, sizeof (buf), "%llu\n",
+					 (unsigned long long) val));
+}
+
+/**
+ * set a hexadecimal attribute (0x prefixed)
+ * @param info UIO device info struct
+ * @param attr attribute name
+ * @param val value
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_set_attr_hex (struct uio_info_t* info, const char *attr,
+		      uint64_t val)
+{
+	char buf [ATTR_NUM];
+
+	return attr_write_str (info, attr, buf,
+			       snprintf (buf, sizeof (buf), "0x%llx\n",
+					 (unsigned long long) val));
+}
+
+/**
+ * set a signed 64 bit attribute (decimal)
+ * @param info UIO device info struct
+ * @param attr attribute name
+ * @param val value
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_set_attr_s64 (struct uio_info_t* info, const char *attr,
+		      int64_t val)
+{
+	char buf [ATTR_NUM];
+
+	return attr_write_str (info, attr, buf,
+			       snprintf (buf, sizeof (buf), "%lld\n",
+					 (long long) val));
+}
+
+/**
+ * set a boolean attribute (1 or 0)
+ * @param info UIO device info struct
+ * @param attr attribute name
+ * @param val value
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_set_attr_bool (struct uio_info_t* info, const char *attr, int val)
+{
+	return attr_write_str (info, attr, val ? "1\n" : "0\n", 2);
+}
+
+/**
+ * subscribe to change notifications of an attribute
+ *
+ * Works for attributes the driver signals with sysfs_notify(). The
+ * attribute gets its own descriptor, so notifications are not consumed
+ * by cached reads. The descriptor signals POLLPRI | POLLERR (epoll:
+ * EPOLLPRI | EPOLLERR, edge triggered is fine) once the attribute
+ * changed; uio_attr_notify_read() then fetches the new content and
+ * re-arms the notification.
+ * @param info UIO device info struct
+ * @param attr attribute name
+ * @returns notification handle or NULL on failure and errno is set
+ */
+struct uio_attr_notify_t *uio_attr_notify_open (struct uio_info_t* info,
+						const char *attr)
+{
+	struct uio_attr_notify_t *notify;
+	char filename [PATH_MAX], buf [ATTR_PAGE];
+	int fd;
+
+	if (!info || !attr || strchr (attr, '/'))
+	{
+		errno = EINVAL;
+		ctx_warn (info_ctx (info), _("%s: %s"), __func__,
+			  g_strerror (errno));
+		return NULL;
+	}
+
+	snprintf (filename, PATH_MAX, "%s/attr/%s", info->path, attr);
+
+	fd = open (filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		ctx_err (info_ctx (info), _("open: %s: %s"), filename,
+			 g_strerror (errno));
+		return NULL;
+	}
+
+	/* sysfs only reports changes after the first read */
+	if (pread (fd, buf, sizeof (buf), 0) < 0)
+	{
+		ctx_err (info_ctx (info), _("read: %s: %s"), filename,
+			 g_strerror (errno));
+		close (fd);
+		return NULL;
+	}
+
+	notify = malloc (sizeof (*notify));
+	if (!notify)
+	{
+		close (fd);
+		errno = ENOMEM;
+		ctx_err (info_ctx (info), _("%s: %s"), __func__,
+			 g_strerror (errno));
+		return NULL;
+	}
+	notify->fd = fd;
+
+	return notify;
+}
+
+/**
+ * get the pollable descriptor of an attribute notification
+ * @param notify notification handle
+ * @returns file descriptor or -1 on failure and errno is set
+ */
+int uio_attr_notify_get_fd (struct uio_attr_notify_t *notify)
+{
+	if (!notify)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	return notify->fd;
+}
+
+/**
+ * read the current attribute content and re-arm the notification
+ * @param notify notification handle
+ * @param buf buffer
+ * @param count buffer size
+ * @returns number of bytes read or -1 on failure and errno is set
+ */
+ssize_t uio_attr_notify_read (struct uio_attr_notify_t *notify, void *buf,
+			      size_t count)
+{
+	if (!notify || !buf)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	return pread (notify->fd, buf, count, 0);
+}
+
+/**
+ * wait for an attribute change and read the new content
+ * @param notify notification handle
+ * @param buf buffer
+ * @param count buffer size
+ * @param timeout timeout or NULL to wait forever
+ * @returns number of bytes read or -1 on failure and errno is set
+ *	(ETIMEDOUT on timeout)
+ */
+ssize_t uio_attr_notify_wait (struct uio_attr_notify_t *notify, void *buf,
+			      size_t count, struct timeval *timeout)
+{
+	struct pollfd pfd;
+	int ret, ms = -1;
+
+	if (!notify || !buf)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (timeout)
+		ms = timeout->tv_sec * 1000 + (timeout->tv_usec + 999) / 1000;
+
+	pfd.fd = notify->fd;
+	pfd.events = POLLPRI | POLLERR;
+
+	do
+		ret = poll (&pfd, 1, ms);
+	while (ret < 0 && errno == EINTR);
+
+	if (ret <= 0)
+	{
+		if (ret == 0)
+			errno = ETIMEDOUT;
+		return -1;
+	}
+
+	return pread (notify->fd, buf, count, 0);
+}
+
+/**
+ * close an attribute notification
+ * @param notify notification handle
+ */
+void uio_attr_notify_close (struct uio_attr_notify_t *notify)
+{
+	if (!notify)
+		return;
+
+	close (notify->fd);
+	free (notify);
 }
 
 /** @} */
@@ -58,14 +58,39 @@
  * @{
  */
 
-static const char *sysfs = "/sys";
+#define HUGE_2M		(2UL << 20)
+#define HUGE_1G		(1UL << 30)
+
+struct uio_window_t {
+	void *base;
+	size_t size;
+	int refs;
+};
+
+static inline size_t page_round (size_t size)
+{
+	size_t page = getpagesize ();
+
+	return (size + page - 1) & ~(page - 1);
+}
 
 static int uio_unmap (struct uio_map_t *uio_map)
 {
+	void *resv;
 	int ret;
-	ret = munmap (uio_map->map, uio_map->size);
+
+	if (uio_map->slot)
+	{
+		/* keep the window slot reserved */
+		resv = mmap (uio_map->slot, uio_map->size, PROT_NONE,
+			     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE |
+			     MAP_FIXED, -1, 0);
+		ret = (resv == MAP_FAILED) ? -1 : 0;
+	}
+	else
+		ret = munmap (uio_map->map, uio_map->size);
 	if (ret)
-		g_warning (_("munmap: %s\n"), g_strerror (errno));
+		log_err (_("munmap: %s"), g_strerror (errno));
 	else
 	        uio_map->map = MAP_FAILED;
 
@@ -78,7 +103,7 @@ static int uio_unmap (struct uio_map_t *uio_map)
  */
 void uio_setsysfs_point (const char *sysfs_mpoint)
 {
-	sysfs = sysfs_mpoint;
+	ctx_set_default_sysfs (sysfs_mpoint);
 }
 
 /**
@@ -178,46 +203,63 @@ int uio_get_fd(struct uio_info_t* info)
  */
 void uio_free_info(struct uio_info_t* info)
 {
+	struct uio_ctx_t *ctx;
+	int i;
+
 	if (info)
 	{
+		ctx = info->ctx;
+		stats_release (info);
 		if (info->path)
-			free (info->path);
+			ctx_free (ctx, info->path);
 		if (info->name)
-			free (info->name);
+			ctx_free (ctx, info->name);
 		if (info->version)
-			free (info->version);
+			ctx_free (ctx, info->version);
 		if (info->maps)
-			free (info->maps);
+		{
+			for (i = 0; i < info->maxmap; i++)
+				ctx_free (ctx, info->maps [i].name);
+			ctx_free (ctx, info->maps);
+		}
 		if (info->devname)
-			free (info->devname);
-		free (info);
+			ctx_free (ctx, info->devname);
+		if (info->irqstat)
+			ctx_free (ctx, info->irqstat);
+		if (info->bcast)
+			ctx_free (ctx, info->bcast);
+		attr_free_handles (info);
+		ctx_free (ctx, info);
 	}
 }
 
 /**
- * find UIO devices
- * @returns device list or NULL on failure
+ * find UIO devices in a library context
+ * @param ctx library context, NULL for the default context
+ * @returns device list or NULL on failure, release the list with
+ * uio_ctx_free_list()
  */
-struct uio_info_t **uio_find_devices ()
+struct uio_info_t **uio_ctx_find_devices (struct uio_ctx_t *ctx)
 {
 	struct dirent **namelist;
 	struct uio_info_t **info;
 	char sysfsname [PATH_MAX];
 	int i, t = 0, nr;
 
-	snprintf (sysfsname, sizeof (sysfsname), "%s/class/uio", sysfs);
+	snprintf (sysfsname, sizeof (sysfsname), "%s/class/uio",
+		  ctx_sysfs_point (ctx));
 	nr = scandir (sysfsname, &namelist, 0, alphasort);
 	if (nr < 0)
 	{
-		g_warning (_("scandir: %s\n"), g_strerror (errno));
+		ctx_err (ctx, _("scandir: %s"), g_strerror (errno));
 		return NULL;
 	}
 
-	info = calloc (nr, sizeof (struct uio_info_t *));
+	info = ctx_alloc (ctx, nr * sizeof (struct uio_info_t *));
 	if (!info)
 	{
 		errno = ENOMEM;
-		g_warning (_("calloc: %s\n"), g_strerror (errno));
+		ctx_err (ctx, _("calloc: %s"), g_strerror (errno));
 		goto out;
 	}
 
@@ -227,7 +269,8 @@ struct uio_info_t **uio_find_devices ()
 		    !strcmp (namelist [i]->d_name, ".."))
 			continue;
 
-		info [t++] = create_uio_info (sysfsname, namelist [i]->d_name);
+		info [t++] = create_uio_info (ctx, sysfsname,
+					      namelist [i]->d_name);
 	}
 
 out:
@@ -239,11 +282,34 @@ out:
 }
 
 /**
- * find UIO devices by UIO name
+ * release a device list returned by uio_ctx_find_devices()
+ *
+ * Only the list itself is released, not the device info structs.
+ * @param ctx library context the list was found in
+ * @param list device list
+ */
+void uio_ctx_free_list (struct uio_ctx_t *ctx, struct uio_info_t **list)
+{
+	ctx_free (ctx, list);
+}
+
+/**
+ * find UIO devices
+ * @returns device list or NULL on failure
+ */
+struct uio_info_t **uio_find_devices ()
+{
+	return uio_ctx_find_devices (NULL);
+}
+
+/**
+ * find UIO devices by UIO name in a library context
+ * @param ctx library context, NULL for the default context
  * @param uio_name UIO name
  * @returns device info or NULL on failure
  */
-struct uio_info_t *uio_find_by_uio_name (char *uio_name)
+struct uio_info_t *uio_ctx_find_by_uio_name (struct uio_ctx_t *ctx,
+					     char *uio_name)
 {
 	struct uio_info_t *info = NULL, **list, **uio_list;
 	char *name;
@@ -251,7 +317,7 @@ struct uio_info_t *uio_find_by_uio_name (char *uio_name)
 	if (!uio_name)
 		return NULL;
 
-	uio_list = uio_find_devices ();
+	uio_list = uio_ctx_find_devices (ctx);
 	if (!uio_list)
 		return NULL;
 
@@ -266,26 +332,39 @@ struct uio_info_t *uio_find_by_uio_name (char *uio_name)
 			break;
 		}
 	}
-	free (uio_list);
+	ctx_free (ctx, uio_list);
 
 	return info;
 }
 
 /**
- * find UIO devices by UIO enumeration number
+ * find UIO devices by UIO name
+ * @param uio_name UIO name
+ * @returns device info or NULL on failure
+ */
+struct uio_info_t *uio_find_by_uio_name (char *uio_name)
+{
+	return uio_ctx_find_by_uio_name (NULL, uio_name);
+}
+
+/**
+ * find UIO devices by UIO enumeration number in a library context
+ * @param ctx library context, NULL for the default context
  * @param uio_num UIO enumeration number
  * @returns device info or NULL on failure
  */
-struct uio_info_t *uio_find_by_uio_num (int uio_num)
+struct uio_info_t *uio_ctx_find_by_uio_num (struct uio_ctx_t *ctx,
+					    int uio_num)
 {
 	struct uio_info_t *info;
 	char sysfsname [PATH_MAX];
 	char name [PATH_MAX];
 
-	snprintf (sysfsname, sizeof (sysfsname), "%s/class/uio", sysfs);
+	snprintf (sysfsname, sizeof (sysfsname), "%s/class/uio",
+		  ctx_sysfs_point (ctx));
 	snprintf (name, sizeof (name), "uio%d", uio_num);
 
-	info = create_uio_info (sysfsname, name);
+	info = create_uio_info (ctx, sysfsname, name);
 	if (errno)
 	{
 		uio_free_info (info);
@@ -296,16 +375,28 @@ struct uio_info_t *uio_find_by_uio_num (int uio_num)
 }
 
 /**
- * find a UIO device by base address in memory map
+ * find UIO devices by UIO enumeration number
+ * @param uio_num UIO enumeration number
+ * @returns device info or NULL on failure
+ */
+struct uio_info_t *uio_find_by_uio_num (int uio_num)
+{
+	return uio_ctx_find_by_uio_num (NULL, uio_num);
+}
+
+/**
+ * find a UIO device by base address in memory map in a library context
+ * @param ctx library context, NULL for the default context
  * @param base address of a memory map member
  * @returns device info or NULL on failure
  */
-struct uio_info_t *uio_find_by_base_addr (unsigned int base_addr)
+struct uio_info_t *uio_ctx_find_by_base_addr (struct uio_ctx_t *ctx,
+					      unsigned int base_addr)
 {
 	struct uio_info_t *info = NULL, **list, **uio_list;
 	int mapc, mapnum, found = 0;
 
-	uio_list = uio_find_devices();
+	uio_list = uio_ctx_find_devices (ctx);
 	if (!uio_list)
 		return NULL;
 
@@ -330,54 +421,208 @@ struct uio_info_t *uio_find_by_base_addr (unsigned int base_addr)
 			break;
 	}
 
-	free (uio_list);
+	ctx_free (ctx, uio_list);
 
 	return info;
 }
 
 /**
- * open a UIO device (try to map to given address)
- * @param info UIO device info stuct
- * @param ptr try to map at ptr
+ * find a UIO device by base address in memory map
+ * @param base address of a memory map member
+ * @returns device info or NULL on failure
+ */
+struct uio_info_t *uio_find_by_base_addr (unsigned int base_addr)
+{
+	return uio_ctx_find_by_base_addr (NULL, base_addr);
+}
+
+/**
+ * find a mapping address suitable for huge page mappings
+ *
+ * Reserves address space and picks an address that is congruent to the
+ * physical bar address modulo the largest huge page size the bar can
+ * use, so the kernel may install PMD/PUD sized PFN mappings.
+ * @param uio_map memory bar
+ * @param flags mmap flags, MAP_FIXED is added on success
+ * @returns address hint or NULL if no alignment applies
+ */
+static void *huge_align_hint (struct uio_map_t *uio_map, int *flags)
+{
+	unsigned long align, phys, start, addr;
+	void *resv;
+
+	if (uio_map->size >= HUGE_1G)
+		align = HUGE_1G;
+	else if (uio_map->size >= HUGE_2M)
+		align = HUGE_2M;
+	else
+		return NULL;
+
+	resv = mmap (NULL, uio_map->size + align, PROT_NONE,
+		     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (resv == MAP_FAILED)
+		return NULL;
+
+	start = (unsigned long) resv;
+	phys = (uio_map->addr & ~(unsigned long) (getpagesize () - 1)) &
+		(align - 1);
+	addr = ((start - phys + align - 1) & ~(align - 1)) + phys;
+	if (addr < start)
+		addr += align;
+
+	/* keep the aligned window reserved, drop head and tail */
+	if (addr > start)
+		munmap (resv, addr - start);
+	if (start + uio_map->size + align > addr + uio_map->size)
+		munmap ((void *) (addr + uio_map->size),
+			start + uio_map->size + align - addr - uio_map->size);
+
+	*flags |= MAP_FIXED;
+
+	return (void *) addr;
+}
+
+/**
+ * map one memory bar of an opened UIO device
+ * @param info UIO device info struct
+ * @param map_num memory bar number
+ * @param ptr mapping address hint or NULL
+ * @param prot mapping protection, 0 for read/write
  * @returns 0 on success or -1 on failure and errno is set
  */
-int uio_open_fix (struct uio_info_t* info, void *ptr)
+static int map_one (struct uio_info_t* info, int map_num, void *ptr, int prot)
 {
-	int fd, i;
+	struct uio_map_t *uio_map = &info->maps [map_num];
+	void *map, *old = MAP_FAILED;
+	int flags;
 
-	if (!info)
+	if (!prot)
+		prot = PROT_READ | PROT_WRITE;
+	flags = (info->flags & UIO_OPEN_PRIVATE) ? MAP_PRIVATE : MAP_SHARED;
+	if (info->flags & UIO_OPEN_POPULATE)
+		flags |= MAP_POPULATE;
+
+	if (uio_map->slot)
 	{
-		errno = EINVAL;
-		g_warning (_("uio_open: %s\n"), g_strerror (errno));
+		ptr = uio_map->slot;
+		flags |= MAP_FIXED;
+	}
+	else if (!ptr && (info->flags & UIO_OPEN_HUGE_ALIGN))
+		ptr = huge_align_hint (uio_map, &flags);
+
+	map = mmap (ptr, uio_map->size, prot, flags, info->fd,
+		    map_num * getpagesize ());
+	if (map == MAP_FAILED)
+	{
+		ctx_err (info_ctx (info), _("mmap: %s"), g_strerror (errno));
+		if ((flags & MAP_FIXED) && !uio_map->slot)
+			munmap (ptr, uio_map->size);
 		return -1;
 	}
 
-	fd = open (info->devname, O_RDWR);
-	if (fd < 0)
+	/* a concurrent lazy mapping may have been faster */
+	if (!__atomic_compare_exchange_n (&uio_map->map, &old, map, 0,
+					  __ATOMIC_RELEASE, __ATOMIC_RELAXED))
 	{
-		g_warning (_("open: %s\n"), g_strerror (errno));
+		/* MAP_FIXED into a window slot replaced the same pages */
+		if (!uio_map->slot)
+			munmap (map, uio_map->size);
+		return 0;
+	}
+
+	if ((info->flags & UIO_OPEN_MLOCK) && mlock (map, uio_map->size))
+	{
+		ctx_err (info_ctx (info), _("mlock: %s"),
+			 g_strerror (errno));
+		uio_unmap (uio_map);
 		return -1;
 	}
 
+	return 0;
+}
+
+/**
+ * map the memory bars of a UIO device whose descriptor is set up
+ * @param info UIO device info stuct with valid fd
+ * @param ptr try to map at ptr
+ * @param flags UIO_OPEN_* flags
+ * @returns 0 on success or -1 on failure and errno is set; on failure
+ *          the descriptor is closed
+ */
+int map_device (struct uio_info_t* info, void *ptr, int flags)
+{
+	int err, i;
+
+	info->flags = flags;
+
+	if (flags & UIO_OPEN_LAZY)
+		goto out;
+
 	for (i = 0; i < info->maxmap; i++)
 	{
-		info->maps [i].map = mmap (ptr, info->maps [i].size,
-					   PROT_READ | PROT_WRITE,
-					   MAP_SHARED, fd, i * getpagesize());
-		if (info->maps[i].map == MAP_FAILED) {
+		if (map_one (info, i, ptr, info->maps [i].prot))
+		{
+			err = errno;
 			while (--i >= 0)
 				uio_unmap (&info->maps [i]);
-			g_warning (_("mmap: %s\n"), g_strerror (errno));
+			close (info->fd);
+			info->fd = -1;
+			errno = err;
 			return -1;
 		}
 		if (ptr)
-			ptr += info->maps [i].size;
+			ptr += page_round (info->maps [i].offset +
+					   info->maps [i].size);
 	}
-	info->fd = fd;
+
+out:
+	stats_open (info, flags);
 
 	return 0;
 }
 
+/**
+ * open a UIO device and map its memory bars according to flags
+ * @param info UIO device info stuct
+ * @param ptr try to map at ptr
+ * @param flags UIO_OPEN_* flags
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+static int open_device (struct uio_info_t* info, void *ptr, int flags)
+{
+	int fd;
+
+	if (!info)
+	{
+		errno = EINVAL;
+		ctx_warn (info_ctx (info), _("uio_open: %s"),
+			  g_strerror (errno));
+		return -1;
+	}
+
+	fd = open (info->devname, O_RDWR);
+	if (fd < 0)
+	{
+		ctx_err (info_ctx (info), _("open: %s"), g_strerror (errno));
+		return -1;
+	}
+
+	info->fd = fd;
+
+	return map_device (info, ptr, flags);
+}
+
+/**
+ * open a UIO device (try to map to given address)
+ * @param info UIO device info stuct
+ * @param ptr try to map at ptr
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_open_fix (struct uio_info_t* info, void *ptr)
+{
+	return open_device (info, ptr, 0);
+}
+
 /**
  * open a UIO device
  * @param info UIO device info stuct
@@ -385,7 +630,7 @@ int uio_open_fix (struct uio_info_t* info, void *ptr)
  */
 int uio_open (struct uio_info_t* info)
 {
-	return uio_open_fix (info, NULL);
+	return open_device (info, NULL, 0);
 }
 
 /**
@@ -395,38 +640,300 @@ int uio_open (struct uio_info_t* info)
  */
 int uio_open_private (struct uio_info_t* info)
 {
-	int fd, i;
+	return open_device (info, NULL, UIO_OPEN_PRIVATE);
+}
 
-	if (!info)
+/**
+ * open a UIO device with flags
+ *
+ * With UIO_OPEN_LAZY no memory bar is mapped at open. A bar is mapped
+ * by uio_map_mem() or on first use through uio_get_mem_map() or the
+ * register accessors, using the protection set by uio_set_map_prot().
+ *
+ * For deterministic access latency UIO_OPEN_POPULATE prefaults the
+ * mappings, UIO_OPEN_MLOCK locks them and UIO_OPEN_HUGE_ALIGN places
+ * bars of 2 MiB and more at addresses that allow huge PFN mappings.
+ * @param info UIO device info stuct
+ * @param flags UIO_OPEN_* flags
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_open_ex (struct uio_info_t* info, int flags)
+{
+	return open_device (info, NULL, flags);
+}
+
+/**
+ * drop a device reference to its reserved window
+ * @param info UIO device info struct
+ */
+static void window_put (struct uio_info_t* info)
+{
+	struct uio_window_t *window = info->window;
+	int i;
+
+	if (!window)
+		return;
+
+	for (i = 0; i < info->maxmap; i++)
+		info->maps [i].slot = NULL;
+	info->window = NULL;
+
+	if (!__atomic_sub_fetch (&window->refs, 1, __ATOMIC_ACQ_REL))
+	{
+		munmap (window->base, window->size);
+		free (window);
+	}
+}
+
+/**
+ * open a group of UIO devices inside one reserved virtual window
+ *
+ * One region is reserved for all memory bars of all devices. Every bar
+ * gets a page aligned slot inside it, separated by PROT_NONE guard
+ * pages, and is mapped with MAP_FIXED into its slot. The layout only
+ * depends on the bar sizes, so offsets between bars are identical in
+ * every process; with ptr the absolute addresses are fixed as well and
+ * the open fails with EEXIST if the range is already in use.
+ * All uio_open_ex() flags except UIO_OPEN_HUGE_ALIGN apply; lazily
+ * mapped bars are placed into their slot on first use.
+ * @param info array of UIO device info structs
+ * @param nr number of devices
+ * @param ptr fixed window address or NULL
+ * @param flags UIO_OPEN_* flags
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_open_window (struct uio_info_t** info, int nr, void *ptr, int flags)
+{
+	struct uio_window_t *window;
+	size_t page = getpagesize (), total = page;
+	char *resv, *pos;
+	int d, i, err;
+
+	if (!info || nr <= 0)
 	{
 		errno = EINVAL;
-		g_warning (_("uio_open: %s\n"), g_strerror (errno));
+		log_warn (_("%s: %s"), __func__, g_strerror (errno));
 		return -1;
 	}
 
-	fd = open (info->devname, O_RDWR);
-	if (fd < 0)
+	for (d = 0; d < nr; d++)
 	{
-		g_warning (_("open: %s\n"), g_strerror (errno));
+		if (!info [d] || info [d]->window)
+		{
+			errno = EINVAL;
+			log_warn (_("%s: %s"), __func__, g_strerror (errno));
+			return -1;
+		}
+
+		for (i = 0; i < info [d]->maxmap; i++)
+			total += page_round (info [d]->maps [i].offset +
+					     info [d]->maps [i].size) + page;
+	}
+
+	resv = mmap (ptr, total, PROT_NONE,
+		     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE |
+		     (ptr ? MAP_FIXED_NOREPLACE : 0), -1, 0);
+	if (resv == MAP_FAILED)
+	{
+		log_err (_("mmap: %s"), g_strerror (errno));
 		return -1;
 	}
 
-	for (i = 0; i < info->maxmap; i++) {
-		info->maps [i].map = mmap (NULL, info->maps [i].size,
-					   PROT_READ | PROT_WRITE,
-					   MAP_PRIVATE, fd, i * getpagesize());
+	if (ptr && resv != ptr)
+	{
+		/* kernels without MAP_FIXED_NOREPLACE treat it as a hint */
+		munmap (resv, total);
+		errno = EEXIST;
+		log_err (_("%s: %s"), __func__, g_strerror (errno));
+		return -1;
+	}
 
-		if (info->maps[i].map == MAP_FAILED) {
-			while (--i >= 0)
-				uio_unmap(&info->maps [i]);
-			g_warning (_("mmap: %s\n"), g_strerror (errno));
-			return -1;
+	window = calloc (1, sizeof (*window));
+	if (!window)
+	{
+		munmap (resv, total);
+		errno = ENOMEM;
+		log_err (_("calloc: %s"), g_strerror (errno));
+		return -1;
+	}
+	window->base = resv;
+	window->size = total;
+	window->refs = nr;
+
+	pos = resv + page;
+	for (d = 0; d < nr; d++)
+	{
+		info [d]->window = window;
+		for (i = 0; i < info [d]->maxmap; i++)
+		{
+			info [d]->maps [i].slot = pos;
+			pos += page_round (info [d]->maps [i].offset +
+					   info [d]->maps [i].size) + page;
 		}
 	}
 
-	info->fd = fd;
+	for (d = 0; d < nr; d++)
+	{
+		if (open_device (info [d], NULL, flags & ~UIO_OPEN_HUGE_ALIGN))
+			goto err_close;
+	}
 
 	return 0;
+
+err_close:
+	err = errno;
+	for (i = 0; i < d; i++)
+		uio_close (info [i]);
+	for (; d < nr; d++)
+		window_put (info [d]);
+	errno = err;
+
+	return -1;
+}
+
+/**
+ * get the reserved window of a device opened by uio_open_window()
+ * @param info UIO device info struct
+ * @param size window size or NULL
+ * @returns window start address or NULL if there is none
+ */
+void *uio_get_window (struct uio_info_t* info, size_t *size)
+{
+	if (!info || !info->window)
+		return NULL;
+
+	if (size)
+		*size = info->window->size;
+
+	return info->window->base;
+}
+
+/**
+ * get the page size backing a mapped memory bar
+ *
+ * Reports the MMUPageSize the kernel shows for the mapping in
+ * /proc/self/smaps.
+ * @param info UIO device info struct
+ * @param map_num memory bar number
+ * @returns page size in bytes or 0 on failure and errno is set
+ */
+size_t uio_get_mem_pagesize (struct uio_info_t* info, int map_num)
+{
+	unsigned long start, end, addr;
+	size_t kb, pagesize = 0;
+	char line [256];
+	int found = 0;
+	FILE *fhan;
+
+	if (!info || map_num < 0 || map_num >= info->maxmap ||
+	    info->maps [map_num].map == MAP_FAILED)
+	{
+		errno = EINVAL;
+		return 0;
+	}
+
+	fhan = fopen ("/proc/self/smaps", "r");
+	if (!fhan)
+	{
+		ctx_err (info_ctx (info), _("fopen: %s"),
+			 g_strerror (errno));
+		return 0;
+	}
+
+	addr = (unsigned long) info->maps [map_num].map;
+	while (fgets (line, sizeof (line), fhan))
+	{
+		if (sscanf (line, "%lx-%lx ", &start, &end) == 2 &&
+		    strchr (line, '-') < strchr (line, ' '))
+		{
+			found = (addr >= start && addr < end);
+			continue;
+		}
+
+		if (found && sscanf (line, "MMUPageSize: %zu kB", &kb) == 1)
+		{
+			pagesize = kb * 1024;
+			break;
+		}
+	}
+	fclose (fhan);
+
+	if (!pagesize)
+		errno = ENOENT;
+
+	return pagesize;
+}
+
+/**
+ * set protection used when a memory bar gets mapped
+ * @param info UIO device info struct
+ * @param map_num memory bar number
+ * @param prot PROT_READ or PROT_READ | PROT_WRITE
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_set_map_prot (struct uio_info_t* info, int map_num, int prot)
+{
+	if (!info || map_num < 0 || map_num >= info->maxmap ||
+	    !(prot & PROT_READ) || (prot & ~(PROT_READ | PROT_WRITE)))
+	{
+		errno = EINVAL;
+		ctx_warn (info_ctx (info), _("%s: %s"), __func__,
+			  g_strerror (errno));
+		return -1;
+	}
+
+	info->maps [map_num].prot = prot;
+
+	return 0;
+}
+
+/**
+ * map a single memory bar of an opened UIO device
+ * @param info UIO device info struct
+ * @param map_num memory bar number
+ * @param prot mapping protection or 0 for the uio_set_map_prot() value
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_map_mem (struct uio_info_t* info, int map_num, int prot)
+{
+	if (!info || info->fd == -1 || map_num < 0 || map_num >= info->maxmap)
+	{
+		errno = EINVAL;
+		ctx_warn (info_ctx (info), _("%s: %s"), __func__,
+			  g_strerror (errno));
+		return -1;
+	}
+
+	if (__atomic_load_n (&info->maps [map_num].map, __ATOMIC_ACQUIRE) !=
+	    MAP_FAILED)
+		return 0;
+
+	return map_one (info, map_num, NULL,
+			prot ? prot : info->maps [map_num].prot);
+}
+
+/**
+ * unmap a single memory bar of an opened UIO device
+ *
+ * The caller has to make sure that no other thread still uses the bar.
+ * @param info UIO device info struct
+ * @param map_num memory bar number
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_unmap_mem (struct uio_info_t* info, int map_num)
+{
+	if (!info || map_num < 0 || map_num >= info->maxmap)
+	{
+		errno = EINVAL;
+		ctx_warn (info_ctx (info), _("%s: %s"), __func__,
+			  g_strerror (errno));
+		return -1;
+	}
+
+	if (info->maps [map_num].map == MAP_FAILED)
+		return 0;
+
+	return uio_unmap (&info->maps [map_num]);
 }
 
 /**
@@ -441,7 +948,8 @@ int uio_close (struct uio_info_t* info)
 	if (!info)
 	{
 		errno = EINVAL;
-		g_warning (_("uio_close: %s\n"), g_strerror (errno));
+		ctx_warn (info_ctx (info), _("uio_close: %s"),
+			  g_strerror (errno));
 		return -1;
 	}
 
@@ -449,7 +957,19 @@ int uio_close (struct uio_info_t* info)
 		if (info->maps [i].map != MAP_FAILED)
 			uio_unmap(&info->maps [i]);
 
+	if (info->irqfd >= 0)
+	{
+		close (info->irqfd);
+		info->irqfd = -1;
+	}
+	info->irqcount = 0;
+
+	uio_stats_unpublish (info);
+	window_put (info);
+
 	close (info->fd);
+	info->fd = -1;
+	info->flags = 0;
 
 	return 0;
 }
@@ -0,0 +1,324 @@
+/*
+ * libuio - UserspaceIO helper library
+ *
+ * Copyright (C) 2011 Benedikt Spranger
+ * based on libUIO by Hans J. Koch
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include "libuio_internal.h"
+
+/**
+ * @defgroup libuio_batch libuio batched attribute functions
+ * @ingroup libuio_public
+ * @brief public batched attribute functions
+ *
+ * A batch resolves every (device, attribute) pair to its cached handle
+ * and reads all of them at offset 0 with one io_uring submission per
+ * up to 256 requests. Each thread keeps its own ring. Where io_uring
+ * is missing (old kernels, seccomp, disabled by sysctl) the batch
+ * falls back to a pread() loop.
+ * @{
+ */
+
+#define BATCH_ENTRIES	256
+
+#if HAVE_LINUX_IO_URING_H && defined(__NR_io_uring_setup)
+
+struct batch_ring_t {
+	int fd;
+	unsigned entries;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sq_ptr;
+	void *cq_ptr;
+	size_t sq_len;
+	size_t cq_len;
+	size_t sqe_len;
+};
+
+static int uring_broken;
+static pthread_once_t ring_once = PTHREAD_ONCE_INIT;
+static pthread_key_t ring_key;
+static __thread struct batch_ring_t *thread_ring;
+
+static void ring_free (void *arg)
+{
+	struct batch_ring_t *ring = arg;
+
+	if (ring->sqes && ring->sqes != MAP_FAILED)
+		munmap (ring->sqes, ring->sqe_len);
+	if (ring->cq_ptr && ring->cq_ptr != MAP_FAILED &&
+	    ring->cq_ptr != ring->sq_ptr)
+		munmap (ring->cq_ptr, ring->cq_len);
+	if (ring->sq_ptr && ring->sq_ptr != MAP_FAILED)
+		munmap (ring->sq_ptr, ring->sq_len);
+	if (ring->fd >= 0)
+		close (ring->fd);
+	free (ring);
+}
+
+static void ring_key_init (void)
+{
+	pthread_key_create (&ring_key, ring_free);
+}
+
+static struct batch_ring_t *ring_get (void)
+{
+	struct io_uring_params p;
+	struct batch_ring_t *ring;
+
+	if (thread_ring)
+		return thread_ring;
+	if (__atomic_load_n (&uring_broken, __ATOMIC_RELAXED))
+		return NULL;
+
+	ring = calloc (1, sizeof (*ring));
+	if (!ring)
+		return NULL;
+
+	memset (&p, 0, sizeof (p));
+	ring->fd = syscall (__NR_io_uring_setup, BATCH_ENTRIES, &p);
+	if (ring->fd < 0)
+	{
+		/* not coming back for this process */
+		__atomic_store_n (&uring_broken, 1, __ATOMIC_RELAXED);
+		free (ring);
+		return NULL;
+	}
+
+	ring->entries = p.sq_entries;
+	ring->sq_len = p.sq_off.array + p.sq_entries * sizeof (unsigned);
+	ring->cq_len = p.cq_off.cqes +
+		       p.cq_entries * sizeof (struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if (ring->cq_len > ring->sq_len)
+			ring->sq_len = ring->cq_len;
+		ring->cq_len = ring->sq_len;
+	}
+	ring->sqe_len = p.sq_entries * sizeof (struct io_uring_sqe);
+
+	ring->sq_ptr = mmap (NULL, ring->sq_len, PROT_READ | PROT_WRITE,
+			     MAP_SHARED | MAP_POPULATE, ring->fd,
+			     IORING_OFF_SQ_RING);
+	if (ring->sq_ptr == MAP_FAILED)
+		goto err_free;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		ring->cq_ptr = ring->sq_ptr;
+	else
+	{
+		ring->cq_ptr = mmap (NULL, ring->cq_len, PROT_READ | PROT_WRITE,
+				     MAP_SHARED | MAP_POPULATE, ring->fd,
+				     IORING_OFF_CQ_RING);
+		if (ring->cq_ptr == MAP_FAILED)
+			goto err_free;
+	}
+
+	ring->sqes = mmap (NULL, ring->sqe_len, PROT_READ | PROT_WRITE,
+			   MAP_SHARED | MAP_POPULATE, ring->fd,
+			   IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED)
+		goto err_free;
+
+	ring->sq_head = ring->sq_ptr + p.sq_off.head;
+	ring->sq_tail = ring->sq_ptr + p.sq_off.tail;
+	ring->sq_mask = ring->sq_ptr + p.sq_off.ring_mask;
+	ring->sq_array = ring->sq_ptr + p.sq_off.array;
+	ring->cq_head = ring->cq_ptr + p.cq_off.head;
+	ring->cq_tail = ring->cq_ptr + p.cq_off.tail;
+	ring->cq_mask = ring->cq_ptr + p.cq_off.ring_mask;
+	ring->cqes = ring->cq_ptr + p.cq_off.cqes;
+
+	pthread_once (&ring_once, ring_key_init);
+	pthread_setspecific (ring_key, ring);
+	thread_ring = ring;
+
+	return ring;
+
+err_free:
+	log_dbg (_("mmap: %s"), g_strerror (errno));
+	__atomic_store_n (&uring_broken, 1, __ATOMIC_RELAXED);
+	ring_free (ring);
+
+	return NULL;
+}
+
+/*
+ * submit up to ring->entries reads and reap all of them; on failure the
+ * requests the kernel did not take keep result -EINPROGRESS, but those
+ * it took are still reaped since their buffers may be written until then
+ */
+static void ring_read (struct batch_ring_t *ring,
+		       struct uio_attr_req_t *reqs, int *fds, unsigned nr)
+{
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	unsigned tail, head, i, queued = 0, done = 0;
+	int ret, failed = 0;
+
+	tail = *ring->sq_tail;
+	for (i = 0; i < nr; i++)
+	{
+		if (fds [i] < 0)
+			continue;
+
+		sqe = &ring->sqes [tail & *ring->sq_mask];
+		memset (sqe, 0, sizeof (*sqe));
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = fds [i];
+		sqe->addr = (unsigned long) reqs [i].buf;
+		sqe->len = reqs [i].len;
+		sqe->off = 0;
+		sqe->user_data = i;
+		ring->sq_array [tail & *ring->sq_mask] = tail & *ring->sq_mask;
+		tail++;
+		queued++;
+	}
+	__atomic_store_n (ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+	while (done < queued)
+	{
+		head = __atomic_load_n (ring->sq_head, __ATOMIC_ACQUIRE);
+		ret = syscall (__NR_io_uring_enter, ring->fd, tail - head, 1,
+			       IORING_ENTER_GETEVENTS, NULL, 0);
+		if (ret < 0 && errno != EINTR && !failed)
+		{
+			/* take back what the kernel did not consume */
+			failed = 1;
+			head = __atomic_load_n (ring->sq_head,
+						__ATOMIC_ACQUIRE);
+			queued -= tail - head;
+			tail = head;
+			__atomic_store_n (ring->sq_tail, tail,
+					  __ATOMIC_RELEASE);
+		}
+
+		head = *ring->cq_head;
+		while (head != __atomic_load_n (ring->cq_tail, __ATOMIC_ACQUIRE))
+		{
+			cqe = &ring->cqes [head & *ring->cq_mask];
+			reqs [cqe->user_data].result = cqe->res;
+			head++;
+			done++;
+		}
+		__atomic_store_n (ring->cq_head, head, __ATOMIC_RELEASE);
+	}
+}
+
+#endif /* HAVE_LINUX_IO_URING_H */
+
+/**
+ * read many attributes of many devices in one go
+ *
+ * Each request names a device and an attribute and provides the
+ * buffer; result is set to the number of bytes read or to -errno.
+ * Buffers are not terminated.
+ * @param reqs requests
+ * @param nr number of requests
+ * @returns number of successful reads or -1 on failure and errno is set
+ */
+int uio_attr_read_batch (struct uio_attr_req_t *reqs, unsigned nr)
+{
+	struct uio_attr_t *handle;
+	unsigned i, chunk, ok = 0;
+	int fds [BATCH_ENTRIES];
+	ssize_t ret;
+
+	if (nr && !reqs)
+	{
+		errno = EINVAL;
+		log_warn (_("%s: %s"), __func__, g_strerror (errno));
+		return -1;
+	}
+
+	for (; nr; reqs += chunk, nr -= chunk)
+	{
+		chunk = nr < BATCH_ENTRIES ? nr : BATCH_ENTRIES;
+
+		for (i = 0; i < chunk; i++)
+		{
+			fds [i] = -1;
+			handle = NULL;
+			if (!reqs [i].buf)
+				errno = EINVAL;
+			else
+				handle = uio_attr_open (reqs [i].info,
+							reqs [i].attr);
+			if (handle)
+				fds [i] = attr_handle_fd (handle);
+			reqs [i].result = handle ? -EINPROGRESS : -errno;
+		}
+
+#if HAVE_LINUX_IO_URING_H && defined(__NR_io_uring_setup)
+		{
+			struct batch_ring_t *ring = ring_get ();
+
+			if (ring && chunk <= ring->entries)
+			{
+				/* requests left over by a failure go below */
+				ring_read (ring, reqs, fds, chunk);
+
+				/* IORING_OP_READ appeared in 5.6 */
+				for (i = 0; i < chunk; i++)
+					if (reqs [i].result == -EINVAL &&
+					    fds [i] >= 0)
+						reqs [i].result = -EINPROGRESS;
+			}
+		}
+#endif
+
+		for (i = 0; i < chunk; i++)
+		{
+			if (reqs [i].result == -EINPROGRESS)
+			{
+				ret = pread (fds [i], reqs [i].buf,
+					     reqs [i].len, 0);
+				reqs [i].result = (ret < 0) ? -errno : ret;
+			}
+			if (reqs [i].result >= 0)
+				ok++;
+		}
+	}
+
+	return ok;
+}
+
+/** @} */
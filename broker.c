@@ -0,0 +1,1086 @@
+/*
+ * libuio - UserspaceIO helper library
+ *
+ * Copyright (C) 2011 Benedikt Spranger
+ * based on libUIO by Hans J. Koch
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA
+ */
+
+#define _GNU_SOURCE
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+
+#include "libuio_internal.h"
+
+/**
+ * @defgroup libuio_broker libuio register access broker functions
+ * @ingroup libuio_public
+ * @brief public functions to access registers of another process
+ *
+ * A privileged process opens the devices and runs a broker on a UNIX
+ * socket. Every client that connects gets its own shared memory
+ * request ring (a memfd sealed against resizing, so a client cannot
+ * fault the broker by truncating it) and the broker's doorbell eventfd,
+ * both passed with SCM_RIGHTS. At most BROKER_CLIENTS clients are
+ * served at a time. The client writes requests into the ring,
+ * the broker thread polls the rings, checks every request against an
+ * allowlist of device, map and offset ranges (optionally per client
+ * uid, taken from SO_PEERCRED) and writes the result back into the
+ * same slot.
+ *
+ * While the broker had work within the last spin period it busy polls,
+ * so a round trip costs two cache line transfers and no system call.
+ * Only an idle broker sleeps; the client then rings the doorbell once.
+ * Both sides yield the cpu when a short spin does not succeed, which
+ * keeps the broker usable when it shares a cpu with its clients.
+ *
+ * A client handle must not be used by several threads at once, connect
+ * once per thread instead.
+ * @{
+ */
+
+#define BROKER_MAGIC	0x4b524255	/* "UBRK" */
+#define BROKER_VERSION	1
+#define BROKER_ENTRIES	64
+#define BROKER_CLIENTS	256
+#define BROKER_SPIN_NS	100000UL
+#define BROKER_CHECK	1024		/* idle spins between event checks */
+#define SPIN_YIELD	128		/* spins before giving up the cpu */
+#define CLIENT_CHECK	65536		/* wait spins between hangup checks */
+
+#define SLOT_FREE	0
+#define SLOT_REQ	1
+#define SLOT_DONE	2
+
+/* shared memory layout, version BROKER_VERSION */
+struct broker_slot_t {
+	uint32_t state;
+	uint8_t width;
+	uint8_t write;
+	uint16_t pad;
+	int32_t dev;
+	int32_t map_num;
+	uint64_t offset;
+	uint64_t value;
+	int32_t result;
+} __attribute__ ((aligned (64)));
+
+struct broker_shm_t {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entries;
+	uint32_t pad;
+
+	/* set while the broker sleeps, clients ring the doorbell then */
+	uint32_t idle __attribute__ ((aligned (64)));
+
+	struct broker_slot_t slots [BROKER_ENTRIES];
+};
+
+struct broker_hdr_t {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entries;
+	uint32_t size;
+};
+
+struct broker_client_t {
+	int sock;
+	uid_t uid;
+	struct broker_shm_t *shm;
+	unsigned long next;
+};
+
+struct uio_broker_t {
+	struct uio_info_t **info;
+	int nr;
+	struct uio_broker_acl_t *acl;
+	int nacl;
+	char *path;
+	int lsock;
+	int stopfd;
+	int evfd;
+	pthread_t thread;
+	unsigned long spin_ns;
+
+	/* owned by the broker thread */
+	struct broker_client_t *clients;
+	int nclients;
+	struct pollfd *pfd;
+};
+
+struct uio_client_t {
+	int sock;
+	int evfd;
+	struct broker_shm_t *shm;
+	unsigned long next;
+};
+
+static uint64_t broker_now (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return timespec_to_ns (&ts);
+}
+
+static int acl_allows (struct uio_broker_t *broker, uid_t uid, int dev,
+		       int map_num, unsigned long offset, int bytes, int write)
+{
+	struct uio_broker_acl_t *acl;
+	int i;
+
+	for (i = 0; i < broker->nacl; i++)
+	{
+		acl = &broker->acl [i];
+
+		if ((acl->uid != (uid_t) -1 && acl->uid != uid) ||
+		    acl->dev != dev || acl->map_num != map_num ||
+		    !(acl->flags & (write ? UIO_BROKER_WRITE :
+				    UIO_BROKER_READ)) ||
+		    offset < acl->offset || acl->size < (size_t) bytes ||
+		    offset - acl->offset > acl->size - bytes)
+			continue;
+
+		return 1;
+	}
+
+	return 0;
+}
+
+static int broker_access (struct uio_broker_t *broker, uid_t uid,
+			  struct broker_slot_t *req)
+{
+	struct uio_info_t *info;
+	int bytes = req->width / 8, ret;
+	uint8_t v8;
+	uint16_t v16;
+	uint32_t v32;
+	uint64_t v64;
+
+	if ((req->width != 8 && req->width != 16 && req->width != 32 &&
+	     req->width != 64) || req->dev < 0 || req->dev >= broker->nr ||
+	    (req->offset & (bytes - 1)))
+		return -EINVAL;
+
+	info = broker->info [req->dev];
+	if (req->map_num < 0 || req->map_num >= info->maxmap ||
+	    info->maps [req->map_num].size < (size_t) bytes ||
+	    req->offset > info->maps [req->map_num].size - bytes)
+		return -EINVAL;
+
+	if (!acl_allows (broker, uid, req->dev, req->map_num, req->offset,
+			 bytes, req->write))
+		return -EACCES;
+
+	errno = 0;
+	if (req->write)
+	{
+		switch (req->width)
+		{
+		case 8:
+			ret = uio_write8 (info, req->map_num, req->offset,
+					  req->value);
+			break;
+		case 16:
+			ret = uio_write16 (info, req->map_num, req->offset,
+					   req->value);
+			break;
+		case 32:
+			ret = uio_write32 (info, req->map_num, req->offset,
+					   req->value);
+			break;
+		default:
+			ret = uio_write64 (info, req->map_num, req->offset,
+					   req->value);
+			break;
+		}
+	}
+	else
+	{
+		switch (req->width)
+		{
+		case 8:
+			ret = uio_read8 (info, req->map_num, req->offset, &v8);
+			req->value = v8;
+			break;
+		case 16:
+			ret = uio_read16 (info, req->map_num, req->offset,
+					  &v16);
+			req->value = v16;
+			break;
+		case 32:
+			ret = uio_read32 (info, req->map_num, req->offset,
+					  &v32);
+			req->value = v32;
+			break;
+		default:
+			ret = uio_read64 (info, req->map_num, req->offset,
+					  &v64);
+			req->value = v64;
+			break;
+		}
+	}
+
+	return ret ? -(errno ? errno : EIO) : 0;
+}
+
+/**
+ * execute the pending requests of a client
+ * @param broker register access broker
+ * @param client client connection
+ * @returns number of requests executed
+ */
+static int broker_serve (struct uio_broker_t *broker,
+			 struct broker_client_t *client)
+{
+	struct broker_slot_t *slot, req;
+	int nr = 0;
+
+	/* a busy client must not starve the others */
+	while (nr < BROKER_ENTRIES)
+	{
+		slot = &client->shm->slots [client->next &
+					    (BROKER_ENTRIES - 1)];
+		if (__atomic_load_n (&slot->state, __ATOMIC_ACQUIRE) !=
+		    SLOT_REQ)
+			break;
+
+		/* the client may scribble on the slot, work on a copy */
+		memcpy (&req, slot, sizeof (req));
+		slot->result = broker_access (broker, client->uid, &req);
+		slot->value = req.value;
+		__atomic_store_n (&slot->state, SLOT_DONE, __ATOMIC_RELEASE);
+
+		client->next++;
+		nr++;
+	}
+
+	return nr;
+}
+
+static void broker_set_idle (struct uio_broker_t *broker, uint32_t idle)
+{
+	int i;
+
+	for (i = 0; i < broker->nclients; i++)
+		__atomic_store_n (&broker->clients [i].shm->idle, idle,
+				  __ATOMIC_SEQ_CST);
+}
+
+static void broker_drop (struct uio_broker_t *broker, int i)
+{
+	struct broker_client_t *client = &broker->clients [i];
+
+	munmap (client->shm, sizeof (*client->shm));
+	close (client->sock);
+	broker->clients [i] = broker->clients [--broker->nclients];
+}
+
+static void broker_accept (struct uio_broker_t *broker)
+{
+	struct broker_client_t *client;
+	struct broker_shm_t *shm = MAP_FAILED;
+	struct broker_hdr_t hdr;
+	union {
+		char buf [CMSG_SPACE (2 * sizeof (int))];
+		struct cmsghdr align;
+	} ctrl;
+	struct cmsghdr *cmsg;
+	struct ucred cred;
+	socklen_t len = sizeof (cred);
+	struct msghdr msg;
+	struct iovec iov;
+	struct pollfd *pfd;
+	int sock, memfd = -1, fds [2];
+
+	sock = accept4 (broker->lsock, NULL, NULL,
+			SOCK_CLOEXEC | SOCK_NONBLOCK);
+	if (sock < 0)
+		return;
+
+	if (broker->nclients >= BROKER_CLIENTS)
+	{
+		errno = EMFILE;
+		goto err;
+	}
+
+	if (getsockopt (sock, SOL_SOCKET, SO_PEERCRED, &cred, &len))
+		goto err;
+
+	client = realloc (broker->clients,
+			  (broker->nclients + 1) * sizeof (*client));
+	if (!client)
+		goto err;
+	broker->clients = client;
+
+	pfd = realloc (broker->pfd, (broker->nclients + 4) * sizeof (*pfd));
+	if (!pfd)
+		goto err;
+	broker->pfd = pfd;
+
+	memfd = memfd_create ("uio-broker", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (memfd < 0 || ftruncate (memfd, sizeof (*shm)) ||
+	    fcntl (memfd, F_ADD_SEALS,
+		   F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL))
+		goto err;
+
+	shm = mmap (NULL, sizeof (*shm), PROT_READ | PROT_WRITE, MAP_SHARED,
+		    memfd, 0);
+	if (shm == MAP_FAILED)
+		goto err;
+	shm->magic = BROKER_MAGIC;
+	shm->version = BROKER_VERSION;
+	shm->entries = BROKER_ENTRIES;
+
+	hdr.magic = BROKER_MAGIC;
+	hdr.version = BROKER_VERSION;
+	hdr.entries = BROKER_ENTRIES;
+	hdr.size = sizeof (*shm);
+
+	memset (&msg, 0, sizeof (msg));
+	memset (&ctrl, 0, sizeof (ctrl));
+	iov.iov_base = &hdr;
+	iov.iov_len = sizeof (hdr);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctrl.buf;
+	msg.msg_controllen = sizeof (ctrl.buf);
+
+	fds [0] = memfd;
+	fds [1] = broker->evfd;
+	cmsg = CMSG_FIRSTHDR (&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN (sizeof (fds));
+	memcpy (CMSG_DATA (cmsg), fds, sizeof (fds));
+
+	if (sendmsg (sock, &msg, MSG_NOSIGNAL) != sizeof (hdr))
+		goto err;
+	close (memfd);
+
+	client = &broker->clients [broker->nclients++];
+	client->sock = sock;
+	client->uid = cred.uid;
+	client->shm = shm;
+	client->next = 0;
+
+	return;
+
+err:
+	log_err (_("%s: %s"), __func__, g_strerror (errno));
+	if (shm != MAP_FAILED)
+		munmap (shm, sizeof (*shm));
+	if (memfd >= 0)
+		close (memfd);
+	close (sock);
+}
+
+/**
+ * handle socket and doorbell events
+ * @param broker register access broker
+ * @param timeout poll timeout in milliseconds, -1 to sleep
+ * @returns 1 if the broker is stopped, 0 otherwise
+ */
+static int broker_events (struct uio_broker_t *broker, int timeout)
+{
+	struct pollfd *pfd = broker->pfd;
+	uint64_t val;
+	int i, nr;
+
+	pfd [0].fd = broker->stopfd;
+	pfd [1].fd = broker->lsock;
+	pfd [2].fd = broker->evfd;
+	for (i = 0; i < broker->nclients; i++)
+		pfd [i + 3].fd = broker->clients [i].sock;
+	nr = broker->nclients + 3;
+	for (i = 0; i < nr; i++)
+		pfd [i].events = POLLIN;
+
+	if (poll (pfd, nr, timeout) <= 0)
+		return 0;
+
+	if (pfd [0].revents)
+		return 1;
+
+	if (pfd [2].revents & POLLIN)
+		if (read (broker->evfd, &val, sizeof (val)) < 0)
+			val = 0;
+
+	/* clients never talk on the socket, anything means hangup */
+	for (i = nr - 4; i >= 0; i--)
+		if (pfd [i + 3].revents)
+			broker_drop (broker, i);
+
+	if (pfd [1].revents & POLLIN)
+		broker_accept (broker);
+
+	return 0;
+}
+
+static void *broker_thread (void *arg)
+{
+	struct uio_broker_t *broker = arg;
+	unsigned long iter = 0;
+	uint64_t last, now;
+	int i, work, busy = 0, nap, stop;
+
+	last = broker_now ();
+	for (;;)
+	{
+		work = 0;
+		for (i = 0; i < broker->nclients; i++)
+			work += broker_serve (broker, &broker->clients [i]);
+
+		if (work)
+			busy = 1;
+		else if (iter % SPIN_YIELD)
+			cpu_relax ();
+		else
+			sched_yield ();
+
+		if (++iter % BROKER_CHECK)
+			continue;
+
+		now = broker_now ();
+		if (busy)
+		{
+			last = now;
+			busy = 0;
+		}
+
+		nap = 0;
+		if (now - last >= __atomic_load_n (&broker->spin_ns,
+						   __ATOMIC_RELAXED))
+		{
+			/* announce the nap, the fence pairs with the one in
+			 * uio_client_batch (), then look once more */
+			broker_set_idle (broker, 1);
+			__atomic_thread_fence (__ATOMIC_SEQ_CST);
+			nap = 1;
+			for (i = 0; i < broker->nclients; i++)
+				work += broker_serve (broker,
+						      &broker->clients [i]);
+		}
+
+		stop = broker_events (broker, (nap && !work) ? -1 : 0);
+		if (nap)
+		{
+			broker_set_idle (broker, 0);
+			last = broker_now ();
+		}
+		if (stop)
+			break;
+	}
+
+	while (broker->nclients)
+		broker_drop (broker, broker->nclients - 1);
+
+	return NULL;
+}
+
+/**
+ * start a register access broker
+ *
+ * Listens on a UNIX socket and serves register reads and writes of
+ * connected clients from a broker thread. Accesses must match an entry
+ * of the allowlist; everything else fails with EACCES.
+ * @param path UNIX socket path, an existing socket file is replaced
+ * @param info array of opened UIO device info structs
+ * @param nr number of devices in the array, clients address them by index
+ * @param acl allowlist
+ * @param nacl number of allowlist entries
+ * @returns broker or NULL on failure and errno is set
+ */
+struct uio_broker_t *uio_broker_create (const char *path,
+		struct uio_info_t **info, int nr,
+		const struct uio_broker_acl_t *acl, int nacl)
+{
+	struct uio_broker_t *broker;
+	struct sockaddr_un addr;
+	int i, ret;
+
+	if (!path || strlen (path) >= sizeof (addr.sun_path) || !info ||
+	    nr <= 0 || nacl < 0 || (nacl && !acl))
+	{
+		errno = EINVAL;
+		log_warn (_("%s: %s"), __func__, g_strerror (errno));
+		return NULL;
+	}
+
+	for (i = 0; i < nr; i++)
+	{
+		if (!info [i] || info [i]->fd == -1)
+		{
+			errno = EINVAL;
+			log_warn (_("%s: %s"), __func__, g_strerror (errno));
+			return NULL;
+		}
+	}
+
+	broker = calloc (1, sizeof (*broker));
+	if (!broker)
+	{
+		errno = ENOMEM;
+		log_err (_("calloc: %s"), g_strerror (errno));
+		return NULL;
+	}
+
+	broker->nr = nr;
+	broker->nacl = nacl;
+	broker->spin_ns = BROKER_SPIN_NS;
+	broker->lsock = -1;
+	broker->stopfd = -1;
+	broker->evfd = -1;
+
+	broker->info = calloc (nr, sizeof (*info));
+	broker->acl = calloc (nacl + 1, sizeof (*acl));
+	broker->pfd = calloc (3, sizeof (*broker->pfd));
+	broker->path = strdup (path);
+	if (!broker->info || !broker->acl || !broker->pfd || !broker->path)
+	{
+		errno = ENOMEM;
+		log_err (_("calloc: %s"), g_strerror (errno));
+		goto err_free;
+	}
+	memcpy (broker->info, info, nr * sizeof (*info));
+	if (nacl)
+		memcpy (broker->acl, acl, nacl * sizeof (*acl));
+
+	broker->stopfd = eventfd (0, EFD_CLOEXEC);
+	broker->evfd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (broker->stopfd < 0 || broker->evfd < 0)
+	{
+		log_err (_("eventfd: %s"), g_strerror (errno));
+		goto err_free;
+	}
+
+	broker->lsock = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC |
+				SOCK_NONBLOCK, 0);
+	if (broker->lsock < 0)
+	{
+		log_err (_("socket: %s"), g_strerror (errno));
+		goto err_free;
+	}
+
+	memset (&addr, 0, sizeof (addr));
+	addr.sun_family = AF_UNIX;
+	strcpy (addr.sun_path, path);
+	unlink (path);
+	if (bind (broker->lsock, (struct sockaddr *) &addr, sizeof (addr)) ||
+	    listen (broker->lsock, 16))
+	{
+		log_err (_("%s: %s: %s"), __func__, path, g_strerror (errno));
+		goto err_free;
+	}
+
+	ret = pthread_create (&broker->thread, NULL, broker_thread, broker);
+	if (ret)
+	{
+		errno = ret;
+		log_err (_("pthread_create: %s"), g_strerror (errno));
+		unlink (path);
+		goto err_free;
+	}
+	pthread_setname_np (broker->thread, "uio-broker");
+
+	return broker;
+
+err_free:
+	ret = errno;
+	if (broker->lsock >= 0)
+		close (broker->lsock);
+	if (broker->evfd >= 0)
+		close (broker->evfd);
+	if (broker->stopfd >= 0)
+		close (broker->stopfd);
+	free (broker->path);
+	free (broker->pfd);
+	free (broker->acl);
+	free (broker->info);
+	free (broker);
+	errno = ret;
+
+	return NULL;
+}
+
+/**
+ * set how long an idle broker keeps polling before it sleeps
+ * @param broker register access broker
+ * @param usecs busy poll period in microseconds
+ */
+void uio_broker_set_spin (struct uio_broker_t *broker, unsigned long usecs)
+{
+	if (broker)
+		__atomic_store_n (&broker->spin_ns, usecs * 1000,
+				  __ATOMIC_RELAXED);
+}
+
+/**
+ * stop a register access broker and free its resources
+ *
+ * Connected clients see EPIPE. The UIO devices stay open.
+ * @param broker register access broker
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_broker_destroy (struct uio_broker_t *broker)
+{
+	uint64_t one = 1;
+
+	if (!broker)
+	{
+		errno = EINVAL;
+		log_warn (_("%s: %s"), __func__, g_strerror (errno));
+		return -1;
+	}
+
+	if (write (broker->stopfd, &one, sizeof (one)) < 0)
+	{
+		log_err (_("eventfd: %s"), g_strerror (errno));
+		return -1;
+	}
+	pthread_join (broker->thread, NULL);
+
+	unlink (broker->path);
+	close (broker->lsock);
+	close (broker->evfd);
+	close (broker->stopfd);
+	free (broker->clients);
+	free (broker->path);
+	free (broker->pfd);
+	free (broker->acl);
+	free (broker->info);
+	free (broker);
+
+	return 0;
+}
+
+/**
+ * connect to a register access broker
+ * @param path UNIX socket path of the broker
+ * @returns client handle or NULL on failure and errno is set
+ */
+struct uio_client_t *uio_client_connect (const char *path)
+{
+	struct uio_client_t *client;
+	struct broker_hdr_t hdr;
+	struct sockaddr_un addr;
+	union {
+		char buf [CMSG_SPACE (2 * sizeof (int))];
+		struct cmsghdr align;
+	} ctrl;
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	ssize_t ret;
+	int fds [2] = { -1, -1 }, err;
+
+	if (!path || strlen (path) >= sizeof (addr.sun_path))
+	{
+		errno = EINVAL;
+		log_warn (_("%s: %s"), __func__, g_strerror (errno));
+		return NULL;
+	}
+
+	client = calloc (1, sizeof (*client));
+	if (!client)
+	{
+		errno = ENOMEM;
+		log_err (_("calloc: %s"), g_strerror (errno));
+		return NULL;
+	}
+	client->shm = MAP_FAILED;
+
+	client->sock = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (client->sock < 0)
+		goto err;
+
+	memset (&addr, 0, sizeof (addr));
+	addr.sun_family = AF_UNIX;
+	strcpy (addr.sun_path, path);
+	if (connect (client->sock, (struct sockaddr *) &addr, sizeof (addr)))
+		goto err;
+
+	memset (&msg, 0, sizeof (msg));
+	iov.iov_base = &hdr;
+	iov.iov_len = sizeof (hdr);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctrl.buf;
+	msg.msg_controllen = sizeof (ctrl.buf);
+
+	do
+		ret = recvmsg (client->sock, &msg,
+			       MSG_CMSG_CLOEXEC | MSG_WAITALL);
+	while (ret < 0 && errno == EINTR);
+	if (ret < 0)
+		goto err;
+
+	for (cmsg = CMSG_FIRSTHDR (&msg); cmsg; cmsg = CMSG_NXTHDR (&msg, cmsg))
+		if (cmsg->cmsg_level == SOL_SOCKET &&
+		    cmsg->cmsg_type == SCM_RIGHTS &&
+		    cmsg->cmsg_len == CMSG_LEN (sizeof (fds)))
+			memcpy (fds, CMSG_DATA (cmsg), sizeof (fds));
+
+	if (ret != sizeof (hdr) || fds [0] < 0 || fds [1] < 0 ||
+	    hdr.magic != BROKER_MAGIC || hdr.version != BROKER_VERSION ||
+	    hdr.entries != BROKER_ENTRIES ||
+	    hdr.size != sizeof (struct broker_shm_t))
+	{
+		errno = EPROTO;
+		goto err;
+	}
+
+	client->shm = mmap (NULL, sizeof (*client->shm),
+			    PROT_READ | PROT_WRITE, MAP_SHARED, fds [0], 0);
+	if (client->shm == MAP_FAILED)
+		goto err;
+	close (fds [0]);
+	client->evfd = fds [1];
+
+	return client;
+
+err:
+	err = errno;
+	if (fds [0] >= 0)
+		close (fds [0]);
+	if (fds [1] >= 0)
+		close (fds [1]);
+	if (client->sock >= 0)
+		close (client->sock);
+	free (client);
+	errno = err;
+	log_err (_("%s: %s: %s"), __func__, path, g_strerror (errno));
+
+	return NULL;
+}
+
+/**
+ * disconnect from a register access broker
+ * @param client client handle
+ */
+void uio_client_close (struct uio_client_t *client)
+{
+	if (!client)
+		return;
+
+	munmap (client->shm, sizeof (*client->shm));
+	close (client->evfd);
+	close (client->sock);
+	free (client);
+}
+
+static int client_hangup (struct uio_client_t *client)
+{
+	struct pollfd pfd = { .fd = client->sock, .events = POLLIN };
+
+	return poll (&pfd, 1, 0) != 0;
+}
+
+/**
+ * run a batch of register accesses through the broker
+ *
+ * Accesses are executed in array order. The call only fails as a whole
+ * if the broker is gone; per access errors are reported in the result
+ * member of each operation.
+ * @param client client handle
+ * @param ops accesses, read values and results are stored back
+ * @param nr number of accesses
+ * @returns number of failed accesses or -1 on failure and errno is set
+ */
+int uio_client_batch (struct uio_client_t *client, struct uio_broker_op_t *ops,
+		      int nr)
+{
+	struct broker_slot_t *slot;
+	unsigned long spins;
+	uint64_t one = 1;
+	int i, n, done, failed = 0;
+
+	if (!client || !ops || nr < 0)
+	{
+		errno = EINVAL;
+		log_warn (_("%s: %s"), __func__, g_strerror (errno));
+		return -1;
+	}
+
+	for (done = 0; done < nr; done += n)
+	{
+		n = nr - done;
+		if (n > BROKER_ENTRIES)
+			n = BROKER_ENTRIES;
+
+		for (i = 0; i < n; i++)
+		{
+			slot = &client->shm->slots [(client->next + i) &
+						    (BROKER_ENTRIES - 1)];
+			slot->width = ops [done + i].width;
+			slot->write = !!ops [done + i].write;
+			slot->dev = ops [done + i].dev;
+			slot->map_num = ops [done + i].map_num;
+			slot->offset = ops [done + i].offset;
+			slot->value = ops [done + i].value;
+			__atomic_store_n (&slot->state, SLOT_REQ,
+					  __ATOMIC_RELEASE);
+		}
+
+		/* pairs with the broker announcing its nap */
+		__atomic_thread_fence (__ATOMIC_SEQ_CST);
+		if (__atomic_load_n (&client->shm->idle, __ATOMIC_RELAXED))
+			if (write (client->evfd, &one, sizeof (one)) < 0)
+				return -1;
+
+		for (i = 0; i < n; i++)
+		{
+			slot = &client->shm->slots [(client->next + i) &
+						    (BROKER_ENTRIES - 1)];
+			for (spins = 1; __atomic_load_n (&slot->state,
+							 __ATOMIC_ACQUIRE) !=
+				       SLOT_DONE; spins++)
+			{
+				if (!(spins % CLIENT_CHECK) &&
+				    client_hangup (client))
+				{
+					errno = EPIPE;
+					log_err (_("%s: %s"), __func__,
+						 g_strerror (errno));
+					return -1;
+				}
+				if (spins < SPIN_YIELD)
+					cpu_relax ();
+				else
+					sched_yield ();
+			}
+
+			ops [done + i].value = slot->value;
+			ops [done + i].result = slot->result;
+			if (slot->result)
+				failed++;
+			__atomic_store_n (&slot->state, SLOT_FREE,
+					  __ATOMIC_RELAXED);
+		}
+		client->next += n;
+	}
+
+	return failed;
+}
+
+static int client_inval (const char *func)
+{
+	errno = EINVAL;
+	log_warn (_("%s: %s"), func, g_strerror (errno));
+
+	return -1;
+}
+
+static int client_access (struct uio_client_t *client, int dev, int map_num,
+			  unsigned long offset, int width, int write,
+			  uint64_t *value)
+{
+	struct uio_broker_op_t op = {
+		.dev = dev,
+		.map_num = map_num,
+		.offset = offset,
+		.width = width,
+		.write = write,
+		.value = *value,
+	};
+	int ret;
+
+	ret = uio_client_batch (client, &op, 1);
+	if (ret)
+	{
+		if (ret > 0)
+			errno = -op.result;
+		return -1;
+	}
+	*value = op.value;
+
+	return 0;
+}
+
+/**
+ * read 8 bit through a register access broker
+ * @param client client handle
+ * @param dev device index at the broker
+ * @param map_num memory bar number
+ * @param offset register offset
+ * @param val register value
+ * @return 0 on success or -1 on failure and errno is set
+ */
+int uio_client_read8 (struct uio_client_t *client, int dev, int map_num,
+		      unsigned long offset, uint8_t *val)
+{
+	uint64_t tmp = 0;
+
+	if (!val)
+		return client_inval (__func__);
+	if (client_access (client, dev, map_num, offset, 8, 0, &tmp))
+		return -1;
+	*val = tmp;
+
+	return 0;
+}
+
+/**
+ * read 16 bit through a register access broker
+ * @param client client handle
+ * @param dev device index at the broker
+ * @param map_num memory bar number
+ * @param offset register offset
+ * @param val register value
+ * @return 0 on success or -1 on failure and errno is set
+ */
+int uio_client_read16 (struct uio_client_t *client, int dev, int map_num,
+		       unsigned long offset, uint16_t *val)
+{
+	uint64_t tmp = 0;
+
+	if (!val)
+		return client_inval (__func__);
+	if (client_access (client, dev, map_num, offset, 16, 0, &tmp))
+		return -1;
+	*val = tmp;
+
+	return 0;
+}
+
+/**
+ * read 32 bit through a register access broker
+ * @param client client handle
+ * @param dev device index at the broker
+ * @param map_num memory bar number
+ * @param offset register offset
+ * @param val register value
+ * @return 0 on success or -1 on failure and errno is set
+ */
+int uio_client_read32 (struct uio_client_t *client, int dev, int map_num,
+		       unsigned long offset, uint32_t *val)
+{
+	uint64_t tmp = 0;
+
+	if (!val)
+		return client_inval (__func__);
+	if (client_access (client, dev, map_num, offset, 32, 0, &tmp))
+		return -1;
+	*val = tmp;
+
+	return 0;
+}
+
+/**
+ * read 64 bit through a register access broker
+ * @param client client handle
+ * @param dev device index at the broker
+ * @param map_num memory bar number
+ * @param offset register offset
+ * @param val register value
+ * @return 0 on success or -1 on failure and errno is set
+ */
+int uio_client_read64 (struct uio_client_t *client, int dev, int map_num,
+		       unsigned long offset, uint64_t *val)
+{
+	if (!val)
+		return client_inval (__func__);
+
+	return client_access (client, dev, map_num, offset, 64, 0, val);
+}
+
+/**
+ * write 8 bit through a register access broker
+ * @param client client handle
+ * @param dev device index at the broker
+ * @param map_num memory bar number
+ * @param offset register offset
+ * @param val register value
+ * @return 0 on success or -1 on failure and errno is set
+ */
+int uio_client_write8 (struct uio_client_t *client, int dev, int map_num,
+		       unsigned long offset, uint8_t val)
+{
+	uint64_t tmp = val;
+
+	return client_access (client, dev, map_num, offset, 8, 1, &tmp);
+}
+
+/**
+ * write 16 bit through a register access broker
+ * @param client client handle
+ * @param dev device index at the broker
+ * @param map_num memory bar number
+ * @param offset register offset
+ * @param val register value
+ * @return 0 on success or -1 on failure and errno is set
+ */
+int uio_client_write16 (struct uio_client_t *client, int dev, int map_num,
+			unsigned long offset, uint16_t val)
+{
+	uint64_t tmp = val;
+
+	return client_access (client, dev, map_num, offset, 16, 1, &tmp);
+}
+
+/**
+ * write 32 bit through a register access broker
+ * @param client client handle
+ * @param dev device index at the broker
+ * @param map_num memory bar number
+ * @param offset register offset
+ * @param val register value
+ * @return 0 on success or -1 on failure and errno is set
+ */
+int uio_client_write32 (struct uio_client_t *client, int dev, int map_num,
+			unsigned long offset, uint32_t val)
+{
+	uint64_t tmp = val;
+
+	return client_access (client, dev, map_num, offset, 32, 1, &tmp);
+}
+
+/**
+ * write 64 bit through a register access broker
+ * @param client client handle
+ * @param dev device index at the broker
+ * @param map_num memory bar number
+ * @param offset register offset
+ * @param val register value
+ * @return 0 on success or -1 on failure and errno is set
+ */
+int uio_client_write64 (struct uio_client_t *client, int dev, int map_num,
+			unsigned long offset, uint64_t val)
+{
+	return client_access (client, dev, map_num, offset, 64, 1, &val);
+}
+
+/** @} */
@@ -0,0 +1,241 @@
+/*
+ * libuio - UserspaceIO helper library
+ *
+ * Copyright (C) 2011 Benedikt Spranger
+ * based on libUIO by Hans J. Koch
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#include "libuio_internal.h"
+
+/**
+ * @defgroup libuio_cache libuio cache maintenance functions
+ * @ingroup libuio_public
+ * @brief public cache maintenance functions for cached DMA maps
+ *
+ * Memory bars backed by normal memory (uio_dmem_genirq, reserved
+ * regions) may be mapped cacheable. If the device does not snoop the
+ * CPU caches, clean a range before the device reads it and invalidate
+ * it before the CPU reads what the device wrote.
+ *
+ * x86 uses clwb to clean, falling back to clflushopt and clflush, and
+ * clflushopt (or clflush) to flush; there is no unprivileged
+ * invalidate, so invalidate flushes. arm64 uses dc cvac to clean and
+ * dc civac to flush and invalidate, as dc ivac is not available to
+ * user space.
+ * @{
+ */
+
+enum {
+	CACHE_NONE,
+	CACHE_CLFLUSH,
+	CACHE_CLFLUSHOPT,
+	CACHE_CLWB,
+	CACHE_DC,
+};
+
+enum {
+	OP_CLEAN,
+	OP_INVALIDATE,
+	OP_FLUSH,
+};
+
+static int cache_line;
+static int cache_flush_insn;
+static int cache_clean_insn;
+
+static void cache_detect (void)
+{
+	int line = 0, flush = CACHE_NONE, clean = CACHE_NONE;
+
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned int eax, ebx, ecx, edx;
+
+	if (__get_cpuid (1, &eax, &ebx, &ecx, &edx) && (edx & (1 << 19)))
+	{
+		line = ((ebx >> 8) & 0xff) * 8;
+		flush = clean = CACHE_CLFLUSH;
+	}
+
+	if (__get_cpuid_count (7, 0, &eax, &ebx, &ecx, &edx))
+	{
+		if (ebx & (1 << 23))
+			flush = clean = CACHE_CLFLUSHOPT;
+		if (ebx & (1 << 24))
+			clean = CACHE_CLWB;
+	}
+#elif defined(__aarch64__)
+	uint64_t ctr;
+
+	__asm__ __volatile__ ("mrs %0, ctr_el0" : "=r" (ctr));
+	line = 4 << ((ctr >> 16) & 0xf);
+	flush = clean = CACHE_DC;
+#endif
+
+	if (line <= 0)
+		line = 64;
+
+	__atomic_store_n (&cache_flush_insn, flush, __ATOMIC_RELAXED);
+	__atomic_store_n (&cache_clean_insn, clean, __ATOMIC_RELAXED);
+	__atomic_store_n (&cache_line, line, __ATOMIC_RELEASE);
+}
+
+static int cache_op (struct uio_info_t* info, int map_num,
+		     unsigned long offset, size_t len, int op)
+{
+	char *map, *pos, *end;
+	int insn;
+
+	if (!info || map_num < 0 || map_num >= info->maxmap ||
+	    offset + len < offset || offset + len > info->maps [map_num].size)
+	{
+		errno = EINVAL;
+		ctx_warn (info_ctx (info), _("%s: %s"), __func__,
+			  g_strerror (errno));
+		return -1;
+	}
+
+	if (!__atomic_load_n (&cache_line, __ATOMIC_ACQUIRE))
+		cache_detect ();
+
+	insn = (op == OP_CLEAN) ? cache_clean_insn : cache_flush_insn;
+	if (insn == CACHE_NONE)
+	{
+		errno = ENOSYS;
+		ctx_warn (info_ctx (info), _("%s: %s"), __func__,
+			  g_strerror (errno));
+		return -1;
+	}
+
+	if (!len)
+		return 0;
+
+	map = uio_get_mem_map (info, map_num);
+	if (!map)
+		return -1;
+
+	pos = map + info->maps [map_num].offset + offset;
+	end = pos + len;
+	pos = (char *) ((unsigned long) pos & ~(unsigned long) (cache_line - 1));
+
+#if defined(__x86_64__) || defined(__i386__)
+	/* clflush is ordered against stores, the others need a fence */
+	if (insn != CACHE_CLFLUSH)
+		mmio_mb ();
+	for (; pos < end; pos += cache_line)
+	{
+		switch (insn)
+		{
+		case CACHE_CLWB:
+			__asm__ __volatile__ ("clwb %0" : "+m" (*pos));
+			break;
+		case CACHE_CLFLUSHOPT:
+			__asm__ __volatile__ ("clflushopt %0" : "+m" (*pos));
+			break;
+		default:
+			__asm__ __volatile__ ("clflush %0" : "+m" (*pos));
+			break;
+		}
+	}
+	mmio_mb ();
+#elif defined(__aarch64__)
+	__asm__ __volatile__ ("dsb ish" ::: "memory");
+	if (op == OP_CLEAN)
+		for (; pos < end; pos += cache_line)
+			__asm__ __volatile__ ("dc cvac, %0" :: "r" (pos) : "memory");
+	else
+		for (; pos < end; pos += cache_line)
+			__asm__ __volatile__ ("dc civac, %0" :: "r" (pos) : "memory");
+	__asm__ __volatile__ ("dsb sy" ::: "memory");
+#else
+	(void) end;
+#endif
+
+	return 0;
+}
+
+/**
+ * write back dirty cache lines of a memory bar range
+ *
+ * Call after the CPU wrote a buffer the device is going to read.
+ * @param info opened UIO device info struct
+ * @param map_num memory bar number
+ * @param offset range start within the bar
+ * @param len range length in bytes
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_cache_clean (struct uio_info_t* info, int map_num,
+		     unsigned long offset, size_t len)
+{
+	return cache_op (info, map_num, offset, len, OP_CLEAN);
+}
+
+/**
+ * discard cache lines of a memory bar range
+ *
+ * Call before the CPU reads a buffer the device has written. Lines
+ * that are dirty are written back first on architectures that lack an
+ * unprivileged invalidate.
+ * @param info opened UIO device info struct
+ * @param map_num memory bar number
+ * @param offset range start within the bar
+ * @param len range length in bytes
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_cache_invalidate (struct uio_info_t* info, int map_num,
+			  unsigned long offset, size_t len)
+{
+	return cache_op (info, map_num, offset, len, OP_INVALIDATE);
+}
+
+/**
+ * write back and discard cache lines of a memory bar range
+ * @param info opened UIO device info struct
+ * @param map_num memory bar number
+ * @param offset range start within the bar
+ * @param len range length in bytes
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_cache_flush (struct uio_info_t* info, int map_num,
+		     unsigned long offset, size_t len)
+{
+	return cache_op (info, map_num, offset, len, OP_FLUSH);
+}
+
+/**
+ * get the data cache line size used for maintenance
+ * @returns cache line size in bytes
+ */
+int uio_cache_line_size (void)
+{
+	if (!__atomic_load_n (&cache_line, __ATOMIC_ACQUIRE))
+		cache_detect ();
+
+	return cache_line;
+}
+
+/** @} */
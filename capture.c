@@ -0,0 +1,663 @@
+/*
+ * libuio - UserspaceIO helper library
+ *
+ * Copyright (C) 2011 Benedikt Spranger
+ * based on libUIO by Hans J. Koch
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA
+ */
+
+#define _GNU_SOURCE
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/eventfd.h>
+#include <sys/types.h>
+
+#include "libuio_internal.h"
+
+/**
+ * @defgroup libuio_capture libuio streaming capture functions
+ * @ingroup libuio_public
+ * @brief public streaming capture functions
+ *
+ * A capture engine pulls completed segments of a ping-pong (or longer)
+ * buffer out of a memory bar on every interrupt and streams them to a
+ * file or pipe. A capture thread waits for the interrupt, copies the
+ * segment with 16 byte wide loads into one of a pool of aligned
+ * buffers and queues it; a writer thread writes the queue out. If the
+ * output descriptor was opened with O_DIRECT, every write is a
+ * multiple of 4 KiB from a 4 KiB aligned buffer.
+ *
+ * Container format, all fields little endian host order:
+ *  - file header: struct capture_hdr_t, padded to the record alignment
+ *  - records: struct capture_rec_t followed by the segment data,
+ *    padded to the record alignment
+ *  - index: one struct capture_idx_t per record, then a
+ *    struct capture_tail_t, padded to the record alignment; the tail
+ *    ends the stream, so a reader finds the index from the end of a
+ *    file
+ * @{
+ */
+
+#define CAPTURE_MAGIC		"UIOCAP01"
+#define CAPTURE_INDEX_MAGIC	"UIOCAPIX"
+#define CAPTURE_REC_MAGIC	0x44524355	/* "UCRD" */
+#define CAPTURE_ALIGN		64
+#define CAPTURE_DIRECT_ALIGN	4096
+
+struct capture_hdr_t {
+	char magic [8];
+	uint32_t version;
+	uint32_t align;
+	uint64_t seg_size;
+	uint32_t segments;
+	uint32_t reserved [9];
+};
+
+struct capture_rec_t {
+	uint32_t magic;
+	uint32_t segment;
+	uint64_t seq;
+	uint64_t stamp;		/* CLOCK_MONOTONIC ns */
+	uint32_t count;		/* UIO interrupt count */
+	uint32_t length;
+};
+
+struct capture_idx_t {
+	uint64_t seq;
+	uint64_t offset;
+};
+
+struct capture_tail_t {
+	char magic [8];
+	uint64_t records;
+	uint64_t offset;	/* index start */
+	uint64_t reserved;
+};
+
+struct capture_buf_t {
+	void *data;
+	size_t len;
+	uint64_t seq;
+};
+
+typedef uint64_t capture_vec_t __attribute__ ((vector_size (16)));
+
+struct uio_capture_t {
+	struct uio_info_t *info;
+	struct uio_capture_attr_t attr;
+	int fd;
+	int stopfd;
+	size_t align;
+	size_t rec_size;
+	char *src;
+
+	pthread_mutex_t lock;
+	pthread_cond_t filled;
+	pthread_cond_t freed;
+	struct capture_buf_t *bufs;
+	struct capture_buf_t **free_list;
+	struct capture_buf_t **queue;
+	unsigned nfree;
+	unsigned qhead;
+	unsigned qlen;
+	int done;
+
+	struct capture_idx_t *index;
+	size_t nindex;
+	size_t index_cap;
+	uint64_t pos;
+
+	struct uio_capture_stats_t stats;
+
+	pthread_t capture;
+	pthread_t writer;
+};
+
+static size_t align_up (size_t val, size_t align)
+{
+	return (val + align - 1) & ~(align - 1);
+}
+
+/* segments are 16 byte aligned and a multiple of 64 bytes */
+static void copy_wide (void *dst, const void *src, size_t len)
+{
+	const volatile capture_vec_t *s = src;
+	capture_vec_t *d = dst;
+	capture_vec_t a, b, c, e;
+
+	for (; len; len -= 64, s += 4, d += 4)
+	{
+		a = s [0];
+		b = s [1];
+		c = s [2];
+		e = s [3];
+		d [0] = a;
+		d [1] = b;
+		d [2] = c;
+		d [3] = e;
+	}
+}
+
+static int write_all (int fd, const void *buf, size_t len)
+{
+	const char *pos = buf;
+	ssize_t ret;
+
+	while (len)
+	{
+		ret = write (fd, pos, len);
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		pos += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+static void stat_add (uint64_t *stat, uint64_t val)
+{
+	__atomic_fetch_add (stat, val, __ATOMIC_RELAXED);
+}
+
+static void *capture_writer (void *arg)
+{
+	struct uio_capture_t *cap = arg;
+	struct capture_idx_t *index;
+	struct capture_buf_t *buf;
+	int err;
+
+	pthread_mutex_lock (&cap->lock);
+	for (;;)
+	{
+		while (!cap->qlen && !cap->done)
+			pthread_cond_wait (&cap->filled, &cap->lock);
+		if (!cap->qlen)
+			break;
+
+		buf = cap->queue [cap->qhead];
+		cap->qhead = (cap->qhead + 1) % cap->attr.buffers;
+		cap->qlen--;
+		pthread_mutex_unlock (&cap->lock);
+
+		err = cap->stats.error;
+		if (!err && cap->nindex == cap->index_cap)
+		{
+			index = realloc (cap->index, (cap->index_cap * 2 + 64) *
+					 sizeof (*index));
+			if (index)
+			{
+				cap->index = index;
+				cap->index_cap = cap->index_cap * 2 + 64;
+			}
+			else
+				err = ENOMEM;
+		}
+
+		if (!err && write_all (cap->fd, buf->data, buf->len))
+			err = errno;
+
+		if (!err)
+		{
+			cap->index [cap->nindex].seq = buf->seq;
+			cap->index [cap->nindex].offset = cap->pos;
+			cap->nindex++;
+			cap->pos += buf->len;
+			stat_add (&cap->stats.bytes, buf->len);
+		}
+		else if (!cap->stats.error)
+		{
+			log_err (_("%s: %s"), __func__, g_strerror (err));
+			__atomic_store_n (&cap->stats.error, err,
+					  __ATOMIC_RELAXED);
+		}
+
+		pthread_mutex_lock (&cap->lock);
+		cap->free_list [cap->nfree++] = buf;
+		pthread_cond_signal (&cap->freed);
+	}
+	pthread_mutex_unlock (&cap->lock);
+
+	return NULL;
+}
+
+static struct capture_buf_t *get_buffer (struct uio_capture_t *cap)
+{
+	struct capture_buf_t *buf = NULL;
+
+	pthread_mutex_lock (&cap->lock);
+	if (!cap->nfree && !(cap->attr.flags & UIO_CAPTURE_DROP))
+	{
+		stat_add (&cap->stats.stalls, 1);
+		while (!cap->nfree)
+			pthread_cond_wait (&cap->freed, &cap->lock);
+	}
+	if (cap->nfree)
+		buf = cap->free_list [--cap->nfree];
+	pthread_mutex_unlock (&cap->lock);
+
+	return buf;
+}
+
+static void *capture_thread (void *arg)
+{
+	struct uio_capture_t *cap = arg;
+	struct uio_capture_attr_t *attr = &cap->attr;
+	struct capture_buf_t *buf;
+	struct capture_rec_t *rec;
+	struct pollfd pfd [2];
+	struct timespec stamp;
+	uint32_t count, last = 0, seg, next = 0;
+	uint64_t seq = 0;
+	int have_last = 0;
+
+	pfd [0].fd = cap->stopfd;
+	pfd [0].events = POLLIN;
+	pfd [1].fd = cap->info->fd;
+	pfd [1].events = POLLIN;
+
+	for (;;)
+	{
+		if (poll (pfd, 2, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			log_err (_("poll: %s"), g_strerror (errno));
+			break;
+		}
+
+		if (pfd [0].revents)
+			break;
+
+		if (pfd [1].revents & (POLLERR | POLLHUP | POLLNVAL))
+		{
+			log_err (_("%s: irq source lost"), cap->info->name);
+			break;
+		}
+
+		if (read (cap->info->fd, &count, 4) != 4)
+			continue;
+		clock_gettime (CLOCK_MONOTONIC, &stamp);
+		irq_delivered (cap->info, count, &stamp);
+
+		if (attr->flags & UIO_CAPTURE_REENABLE)
+			uio_enable_irq (cap->info);
+
+		/* the device lapped us, those segments are gone */
+		if (have_last && count - last > 1)
+			stat_add (&cap->stats.overruns, count - last - 1);
+		last = count;
+		have_last = 1;
+
+		if (attr->index_map >= 0)
+		{
+			if (uio_read32 (cap->info, attr->index_map,
+					attr->index_reg, &seg))
+				continue;
+			seg %= attr->segments;
+		}
+		else
+			seg = next;
+		next = (seg + 1) % attr->segments;
+
+		buf = get_buffer (cap);
+		if (!buf)
+		{
+			stat_add (&cap->stats.dropped, 1);
+			continue;
+		}
+
+		rec = buf->data;
+		rec->magic = CAPTURE_REC_MAGIC;
+		rec->segment = seg;
+		rec->seq = seq;
+		rec->stamp = timespec_to_ns (&stamp);
+		rec->count = count;
+		rec->length = attr->seg_size;
+
+		mmio_rmb ();
+		copy_wide ((char *) buf->data + sizeof (*rec),
+			   cap->src + seg * attr->seg_size, attr->seg_size);
+		buf->seq = seq++;
+
+		pthread_mutex_lock (&cap->lock);
+		cap->queue [(cap->qhead + cap->qlen) % attr->buffers] = buf;
+		cap->qlen++;
+		pthread_cond_signal (&cap->filled);
+		pthread_mutex_unlock (&cap->lock);
+
+		stat_add (&cap->stats.segments, 1);
+	}
+
+	return NULL;
+}
+
+/**
+ * initialize capture attributes with defaults
+ * @param attr capture attributes
+ */
+void uio_capture_attr_init (struct uio_capture_attr_t *attr)
+{
+	memset (attr, 0, sizeof (*attr));
+	attr->segments = 2;
+	attr->index_map = -1;
+	attr->buffers = 16;
+}
+
+static void capture_free (struct uio_capture_t *cap)
+{
+	unsigned i;
+
+	if (cap->bufs)
+		for (i = 0; i < cap->attr.buffers; i++)
+			free (cap->bufs [i].data);
+	if (cap->stopfd >= 0)
+		close (cap->stopfd);
+	pthread_cond_destroy (&cap->filled);
+	pthread_cond_destroy (&cap->freed);
+	pthread_mutex_destroy (&cap->lock);
+	free (cap->bufs);
+	free (cap->free_list);
+	free (cap->queue);
+	free (cap->index);
+	free (cap);
+}
+
+/**
+ * start streaming a device buffer to a file descriptor
+ *
+ * The UIO device must be opened. Its interrupt must be delivered
+ * through the capture engine only, do not wait on it elsewhere.
+ * @param info opened UIO device info struct
+ * @param attr buffer layout and engine settings
+ * @param fd output file or pipe, may be opened with O_DIRECT
+ * @returns capture engine or NULL on failure and errno is set
+ */
+struct uio_capture_t *uio_capture_start (struct uio_info_t* info,
+					 const struct uio_capture_attr_t *attr,
+					 int fd)
+{
+	struct uio_capture_t *cap;
+	struct capture_hdr_t *hdr;
+	void *head;
+	size_t hdr_size;
+	unsigned i;
+	char *map;
+	int flags, ret;
+
+	if (!info || info->fd == -1 || !attr || fd < 0 ||
+	    attr->map < 0 || attr->map >= info->maxmap ||
+	    !attr->segments || !attr->buffers || !attr->seg_size ||
+	    (attr->seg_size & 63) || (attr->offset & 15) ||
+	    attr->seg_size > UINT32_MAX ||
+	    attr->offset + attr->seg_size * attr->segments >
+	    info->maps [attr->map].size ||
+	    attr->index_map >= info->maxmap)
+	{
+		errno = EINVAL;
+		ctx_warn (info_ctx (info), _("%s: %s"), __func__,
+			  g_strerror (errno));
+		return NULL;
+	}
+
+	flags = fcntl (fd, F_GETFL);
+	if (flags < 0)
+	{
+		ctx_err (info_ctx (info), _("fcntl: %s"),
+			 g_strerror (errno));
+		return NULL;
+	}
+
+	map = uio_get_mem_map (info, attr->map);
+	if (!map)
+		return NULL;
+
+	/* the bar itself may start anywhere within its page */
+	map += info->maps [attr->map].offset + attr->offset;
+	if ((unsigned long) map & 15)
+	{
+		errno = EINVAL;
+		ctx_warn (info_ctx (info), _("%s: %s"), __func__,
+			  g_strerror (errno));
+		return NULL;
+	}
+
+	cap = calloc (1, sizeof (*cap));
+	if (!cap)
+	{
+		errno = ENOMEM;
+		ctx_err (info_ctx (info), _("%s: %s"), __func__,
+			 g_strerror (errno));
+		return NULL;
+	}
+
+	cap->info = info;
+	cap->attr = *attr;
+	cap->fd = fd;
+	cap->src = map;
+	cap->align = (flags & O_DIRECT) ? CAPTURE_DIRECT_ALIGN : CAPTURE_ALIGN;
+	cap->rec_size = align_up (sizeof (struct capture_rec_t) +
+				  attr->seg_size, cap->align);
+	pthread_mutex_init (&cap->lock, NULL);
+	pthread_cond_init (&cap->filled, NULL);
+	pthread_cond_init (&cap->freed, NULL);
+
+	cap->stopfd = eventfd (0, EFD_CLOEXEC);
+	if (cap->stopfd < 0)
+	{
+		ctx_err (info_ctx (info), _("eventfd: %s"),
+			 g_strerror (errno));
+		goto err_free;
+	}
+
+	cap->bufs = calloc (attr->buffers, sizeof (*cap->bufs));
+	cap->free_list = calloc (attr->buffers, sizeof (*cap->free_list));
+	cap->queue = calloc (attr->buffers, sizeof (*cap->queue));
+	if (!cap->bufs || !cap->free_list || !cap->queue)
+		goto err_nomem;
+
+	for (i = 0; i < attr->buffers; i++)
+	{
+		if (posix_memalign (&cap->bufs [i].data, cap->align,
+				    cap->rec_size))
+			goto err_nomem;
+		/* padding goes to disk, keep it deterministic */
+		memset (cap->bufs [i].data, 0, cap->rec_size);
+		cap->bufs [i].len = cap->rec_size;
+		cap->free_list [cap->nfree++] = &cap->bufs [i];
+	}
+
+	hdr_size = align_up (sizeof (*hdr), cap->align);
+	if (posix_memalign (&head, cap->align, hdr_size))
+		goto err_nomem;
+	memset (head, 0, hdr_size);
+	hdr = head;
+	memcpy (hdr->magic, CAPTURE_MAGIC, sizeof (hdr->magic));
+	hdr->version = 1;
+	hdr->align = cap->align;
+	hdr->seg_size = attr->seg_size;
+	hdr->segments = attr->segments;
+	ret = write_all (fd, head, hdr_size);
+	free (head);
+	if (ret)
+	{
+		ctx_err (info_ctx (info), _("write: %s"),
+			 g_strerror (errno));
+		goto err_free;
+	}
+	cap->pos = hdr_size;
+
+	ret = pthread_create (&cap->writer, NULL, capture_writer, cap);
+	if (ret)
+	{
+		errno = ret;
+		ctx_err (info_ctx (info), _("pthread_create: %s"),
+			 g_strerror (errno));
+		goto err_free;
+	}
+	pthread_setname_np (cap->writer, "uio-capwr");
+
+	ret = pthread_create (&cap->capture, NULL, capture_thread, cap);
+	if (ret)
+	{
+		pthread_mutex_lock (&cap->lock);
+		cap->done = 1;
+		pthread_cond_signal (&cap->filled);
+		pthread_mutex_unlock (&cap->lock);
+		pthread_join (cap->writer, NULL);
+		errno = ret;
+		ctx_err (info_ctx (info), _("pthread_create: %s"),
+			 g_strerror (errno));
+		goto err_free;
+	}
+	pthread_setname_np (cap->capture, "uio-capture");
+
+	return cap;
+
+err_nomem:
+	errno = ENOMEM;
+	ctx_err (info_ctx (info), _("%s: %s"), __func__, g_strerror (errno));
+err_free:
+	ret = errno;
+	capture_free (cap);
+	errno = ret;
+
+	return NULL;
+}
+
+/**
+ * get a snapshot of the capture counters
+ * @param cap capture engine
+ * @param stats counters
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_capture_get_stats (struct uio_capture_t *cap,
+			   struct uio_capture_stats_t *stats)
+{
+	if (!cap || !stats)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	stats->segments = __atomic_load_n (&cap->stats.segments,
+					   __ATOMIC_RELAXED);
+	stats->bytes = __atomic_load_n (&cap->stats.bytes, __ATOMIC_RELAXED);
+	stats->overruns = __atomic_load_n (&cap->stats.overruns,
+					   __ATOMIC_RELAXED);
+	stats->stalls = __atomic_load_n (&cap->stats.stalls, __ATOMIC_RELAXED);
+	stats->dropped = __atomic_load_n (&cap->stats.dropped,
+					  __ATOMIC_RELAXED);
+	stats->error = __atomic_load_n (&cap->stats.error, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+/**
+ * stop a capture engine, write the index and free it
+ *
+ * Queued segments are written out before the index.
+ * @param cap capture engine
+ * @param stats final counters or NULL
+ * @returns 0 on success or -1 on failure and errno is set to the first
+ *	output error
+ */
+int uio_capture_stop (struct uio_capture_t *cap,
+		      struct uio_capture_stats_t *stats)
+{
+	struct capture_tail_t *tail;
+	size_t len, size;
+	uint64_t one = 1;
+	void *buf;
+	int err;
+
+	if (!cap)
+	{
+		errno = EINVAL;
+		log_warn (_("%s: %s"), __func__, g_strerror (errno));
+		return -1;
+	}
+
+	if (write (cap->stopfd, &one, sizeof (one)) < 0)
+	{
+		log_err (_("eventfd: %s"), g_strerror (errno));
+		return -1;
+	}
+	pthread_join (cap->capture, NULL);
+
+	pthread_mutex_lock (&cap->lock);
+	cap->done = 1;
+	pthread_cond_signal (&cap->filled);
+	pthread_mutex_unlock (&cap->lock);
+	pthread_join (cap->writer, NULL);
+
+	err = cap->stats.error;
+	if (!err)
+	{
+		len = cap->nindex * sizeof (*cap->index);
+		size = align_up (len + sizeof (*tail), cap->align);
+		if (posix_memalign (&buf, cap->align, size))
+			err = ENOMEM;
+		else
+		{
+			memset (buf, 0, size);
+			if (len)
+				memcpy (buf, cap->index, len);
+			/* the tail ends the stream */
+			tail = (void *) ((char *) buf + size - sizeof (*tail));
+			memcpy (tail->magic, CAPTURE_INDEX_MAGIC,
+				sizeof (tail->magic));
+			tail->records = cap->nindex;
+			tail->offset = cap->pos;
+			if (write_all (cap->fd, buf, size))
+				err = errno;
+			free (buf);
+		}
+		if (err)
+			log_err (_("%s: %s"), __func__, g_strerror (err));
+		cap->stats.error = err;
+	}
+
+	if (stats)
+		uio_capture_get_stats (cap, stats);
+
+	capture_free (cap);
+
+	if (err)
+	{
+		errno = err;
+		return -1;
+	}
+
+	return 0;
+}
+
+/** @} */
@@ -0,0 +1,333 @@
+/*
+ * libuio - UserspaceIO helper library
+ *
+ * Copyright (C) 2011 Benedikt Spranger
+ * based on libUIO by Hans J. Koch
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "libuio_internal.h"
+
+/**
+ * @defgroup libuio_ctx libuio context functions
+ * @ingroup libuio_public
+ * @brief public library context functions
+ *
+ * A context carries everything device discovery depends on: the sysfs
+ * and /dev roots, the allocator for device info structs and device
+ * lists, a log hook and a device node cache. Contexts are immutable
+ * after creation apart from their caches, which are locked, so any
+ * number of threads may enumerate through the same or different
+ * contexts. Device info structs remember their context; it must
+ * outlive them.
+ *
+ * The functions without a context argument use the default context:
+ * /sys (see uio_setsysfs_point()), /dev, malloc and the library wide
+ * log sink.
+ * @{
+ */
+
+static struct uio_ctx_t default_ctx = {
+	.sysfs = "/sys",
+	.dev = "/dev",
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static void *libc_alloc (void *arg, size_t size)
+{
+	(void) arg;
+
+	return malloc (size);
+}
+
+static void libc_release (void *arg, void *ptr)
+{
+	(void) arg;
+
+	free (ptr);
+}
+
+/**
+ * create a library context
+ * @param attr context settings, NULL or zeroed fields select defaults
+ * @returns context or NULL on failure and errno is set
+ */
+struct uio_ctx_t *uio_ctx_new (const struct uio_ctx_attr_t *attr)
+{
+	struct uio_ctx_t *ctx;
+
+	if (attr && (!attr->alloc != !attr->release))
+	{
+		errno = EINVAL;
+		log_warn (_("%s: %s"), __func__, g_strerror (errno));
+		return NULL;
+	}
+
+	ctx = calloc (1, sizeof (*ctx));
+	if (!ctx)
+		goto err_nomem;
+
+	ctx->sysfs = strdup ((attr && attr->sysfs_root) ?
+			     attr->sysfs_root : "/sys");
+	ctx->dev = strdup ((attr && attr->dev_root) ? attr->dev_root : "/dev");
+	if (!ctx->sysfs || !ctx->dev)
+		goto err_free;
+
+	if (attr)
+	{
+		ctx->alloc = attr->alloc;
+		ctx->release = attr->release;
+		ctx->alloc_arg = attr->alloc_arg;
+		ctx->log = attr->log;
+		ctx->log_arg = attr->log_arg;
+	}
+	ctx->owned = 1;
+	pthread_mutex_init (&ctx->lock, NULL);
+
+	return ctx;
+
+err_free:
+	free ((char *) ctx->sysfs);
+	free ((char *) ctx->dev);
+	free (ctx);
+err_nomem:
+	errno = ENOMEM;
+	log_err (_("%s: %s"), __func__, g_strerror (errno));
+
+	return NULL;
+}
+
+/**
+ * free a library context
+ *
+ * All device info structs of the context must be freed before.
+ * @param ctx library context
+ */
+void uio_ctx_free (struct uio_ctx_t *ctx)
+{
+	size_t i;
+
+	if (!ctx || !ctx->owned)
+		return;
+
+	for (i = 0; i < ctx->ndevnames; i++)
+		free (ctx->devnames [i].name);
+	free (ctx->devnames);
+	pthread_mutex_destroy (&ctx->lock);
+	free ((char *) ctx->sysfs);
+	free ((char *) ctx->dev);
+	free (ctx);
+}
+
+/**
+ * get the context of a device info struct
+ * @param info UIO device info struct
+ * @returns library context
+ */
+struct uio_ctx_t *uio_get_ctx (struct uio_info_t* info)
+{
+	return ctx_get (info ? info->ctx : NULL);
+}
+
+/**
+ * resolve a context pointer, NULL selects the default context
+ * @param ctx library context or NULL
+ * @returns library context
+ */
+struct uio_ctx_t *ctx_get (struct uio_ctx_t *ctx)
+{
+	return ctx ? ctx : &default_ctx;
+}
+
+/**
+ * set the sysfs root of the default context
+ * @param sysfs_mpoint path, must stay valid while in use
+ */
+void ctx_set_default_sysfs (const char *sysfs_mpoint)
+{
+	__atomic_store_n (&default_ctx.sysfs, sysfs_mpoint, __ATOMIC_RELEASE);
+}
+
+/**
+ * get the sysfs root of a context
+ * @param ctx library context or NULL
+ * @returns path to sysfs mount point
+ */
+const char *ctx_sysfs_point (struct uio_ctx_t *ctx)
+{
+	return __atomic_load_n (&ctx_get (ctx)->sysfs, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * get the device node root of a context
+ * @param ctx library context or NULL
+ * @returns path to device nodes
+ */
+const char *ctx_dev_root (struct uio_ctx_t *ctx)
+{
+	return ctx_get (ctx)->dev;
+}
+
+/**
+ * allocate zeroed memory from the context allocator
+ * @param ctx library context or NULL
+ * @param size size in bytes
+ * @returns memory or NULL on failure and errno is set
+ */
+void *ctx_alloc (struct uio_ctx_t *ctx, size_t size)
+{
+	void *ptr;
+
+	ctx = ctx_get (ctx);
+	ptr = ctx->alloc ? ctx->alloc (ctx->alloc_arg, size) :
+			   libc_alloc (NULL, size);
+	if (!ptr)
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+	memset (ptr, 0, size);
+
+	return ptr;
+}
+
+/**
+ * duplicate a string with the context allocator
+ * @param ctx library context or NULL
+ * @param str string or NULL
+ * @returns copy or NULL
+ */
+char *ctx_strdup (struct uio_ctx_t *ctx, const char *str)
+{
+	char *copy;
+	size_t len;
+
+	if (!str)
+		return NULL;
+
+	len = strlen (str) + 1;
+	copy = ctx_alloc (ctx, len);
+	if (copy)
+		memcpy (copy, str, len);
+
+	return copy;
+}
+
+/**
+ * release memory to the context allocator
+ * @param ctx library context or NULL
+ * @param ptr memory or NULL
+ */
+void ctx_free (struct uio_ctx_t *ctx, void *ptr)
+{
+	if (!ptr)
+		return;
+
+	ctx = ctx_get (ctx);
+	if (ctx->release)
+		ctx->release (ctx->alloc_arg, ptr);
+	else
+		libc_release (NULL, ptr);
+}
+
+/**
+ * look up a device node in the context cache
+ *
+ * A cached node is only returned if it still is the character device
+ * with the given id.
+ * @param ctx library context or NULL
+ * @param devid major/minor
+ * @returns context allocated node name or NULL if not cached
+ */
+char *ctx_devname_lookup (struct uio_ctx_t *ctx, dev_t devid)
+{
+	struct stat st;
+	char *name = NULL;
+	size_t i;
+
+	ctx = ctx_get (ctx);
+
+	pthread_mutex_lock (&ctx->lock);
+	for (i = 0; i < ctx->ndevnames; i++)
+	{
+		if (ctx->devnames [i].devid != devid)
+			continue;
+		if (!stat (ctx->devnames [i].name, &st) &&
+		    S_ISCHR (st.st_mode) && st.st_rdev == devid)
+			name = ctx_strdup (ctx, ctx->devnames [i].name);
+		break;
+	}
+	pthread_mutex_unlock (&ctx->lock);
+
+	return name;
+}
+
+/**
+ * remember a device node in the context cache
+ * @param ctx library context or NULL
+ * @param devid major/minor
+ * @param name device node name
+ */
+void ctx_devname_store (struct uio_ctx_t *ctx, dev_t devid, const char *name)
+{
+	struct uio_ctx_devname_t *names;
+	char *copy;
+	size_t i;
+
+	ctx = ctx_get (ctx);
+
+	copy = strdup (name);
+	if (!copy)
+		return;
+
+	pthread_mutex_lock (&ctx->lock);
+	for (i = 0; i < ctx->ndevnames; i++)
+	{
+		if (ctx->devnames [i].devid == devid)
+		{
+			free (ctx->devnames [i].name);
+			ctx->devnames [i].name = copy;
+			goto out;
+		}
+	}
+
+	names = realloc (ctx->devnames, (ctx->ndevnames + 1) * sizeof (*names));
+	if (!names)
+	{
+		free (copy);
+		goto out;
+	}
+	ctx->devnames = names;
+	ctx->devnames [ctx->ndevnames].devid = devid;
+	ctx->devnames [ctx->ndevnames].name = copy;
+	ctx->ndevnames++;
+out:
+	pthread_mutex_unlock (&ctx->lock);
+}
+
+/** @} */
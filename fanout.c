@@ -0,0 +1,271 @@
+/*
+ * libuio - UserspaceIO helper library
+ *
+ * Copyright (C) 2011 Benedikt Spranger
+ * based on libUIO by Hans J. Koch
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libuio_internal.h"
+
+/**
+ * @defgroup libuio_fanout libuio irq fan-out functions
+ * @ingroup libuio_public
+ * @brief public irq fan-out functions
+ *
+ * An interrupt consumed by any library wait path (uio_irqwait(),
+ * uio_irq_consume() or an irq service thread) is published once into a
+ * sequence numbered broadcast slot of the device. Every subscriber
+ * keeps its own read position, so subscribers never block each other
+ * or the publishing reader, and a slow subscriber learns how many
+ * events it missed instead of holding anybody up. Exactly one place in
+ * the process should read the device interrupts.
+ *
+ * The slot is a small ring of cells, each tagged with the sequence
+ * number of its event. The single publisher fills the next cell and
+ * tags it last; a subscriber copies the newest cell and checks the tag
+ * once more. Should the publisher have lapped the ring meanwhile, the
+ * event is not retried but counted as missed on the next fetch. Neither
+ * side ever waits for the other.
+ * @{
+ */
+
+#define BCAST_CELLS	8	/* power of two */
+
+struct bcast_cell_t {
+	/* sequence number of the event, 0 while the cell is written */
+	uint64_t seq;
+	int64_t stamp;
+	uint32_t count;
+};
+
+struct uio_irq_bcast_t {
+	/* futex word, bumped once per published event */
+	int futex;
+	int waiters;
+	/* sequence number of the newest event */
+	uint64_t seq;
+	struct bcast_cell_t cells [BCAST_CELLS];
+};
+
+struct uio_irq_sub_t {
+	struct uio_irq_bcast_t *bcast;
+	uint64_t seen;
+	struct uio_ctx_t *ctx;
+};
+
+/**
+ * publish an interrupt into the broadcast slot
+ * @param bcast broadcast slot
+ * @param count UIO interrupt count
+ * @param stamp CLOCK_MONOTONIC wakeup time
+ */
+void bcast_publish (struct uio_irq_bcast_t *bcast, uint32_t count,
+		    const struct timespec *stamp)
+{
+	uint64_t seq = __atomic_load_n (&bcast->seq, __ATOMIC_RELAXED) + 1;
+	struct bcast_cell_t *cell = &bcast->cells [seq & (BCAST_CELLS - 1)];
+
+	__atomic_store_n (&cell->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence (__ATOMIC_RELEASE);
+	__atomic_store_n (&cell->stamp, (int64_t) timespec_to_ns (stamp),
+			  __ATOMIC_RELAXED);
+	__atomic_store_n (&cell->count, count, __ATOMIC_RELAXED);
+	__atomic_store_n (&cell->seq, seq, __ATOMIC_RELEASE);
+	__atomic_store_n (&bcast->seq, seq, __ATOMIC_RELEASE);
+
+	__atomic_fetch_add (&bcast->futex, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n (&bcast->waiters, __ATOMIC_SEQ_CST))
+		futex_wake (&bcast->futex);
+}
+
+/* copy the event seq, returns 0 if the publisher overwrote it */
+static int bcast_read (struct uio_irq_bcast_t *bcast, uint64_t seq,
+		       struct uio_irq_event_t *ev)
+{
+	struct bcast_cell_t *cell = &bcast->cells [seq & (BCAST_CELLS - 1)];
+	int64_t stamp;
+
+	if (__atomic_load_n (&cell->seq, __ATOMIC_ACQUIRE) != seq)
+		return 0;
+	stamp = __atomic_load_n (&cell->stamp, __ATOMIC_RELAXED);
+	ev->count = __atomic_load_n (&cell->count, __ATOMIC_RELAXED);
+	__atomic_thread_fence (__ATOMIC_ACQUIRE);
+	if (__atomic_load_n (&cell->seq, __ATOMIC_RELAXED) != seq)
+		return 0;
+
+	ev->stamp.tv_sec = stamp / 1000000000;
+	ev->stamp.tv_nsec = stamp % 1000000000;
+	ev->dev = 0;
+
+	return 1;
+}
+
+/**
+ * subscribe to the interrupts of a UIO device
+ *
+ * The subscriber sees interrupts published after this call.
+ * @param info UIO device info struct
+ * @returns subscriber or NULL on failure and errno is set
+ */
+struct uio_irq_sub_t *uio_irq_subscribe (struct uio_info_t* info)
+{
+	struct uio_irq_bcast_t *bcast, *old = NULL;
+	struct uio_irq_sub_t *sub;
+
+	if (!info)
+	{
+		errno = EINVAL;
+		ctx_warn (info_ctx (info), _("%s: %s"), __func__,
+			  g_strerror (errno));
+		return NULL;
+	}
+
+	bcast = __atomic_load_n (&info->bcast, __ATOMIC_ACQUIRE);
+	if (!bcast)
+	{
+		bcast = ctx_alloc (info->ctx, sizeof (*bcast));
+		if (!bcast)
+		{
+			ctx_err (info_ctx (info), _("%s: %s"), __func__,
+				 g_strerror (errno));
+			return NULL;
+		}
+
+		if (!__atomic_compare_exchange_n (&info->bcast, &old, bcast, 0,
+						  __ATOMIC_ACQ_REL,
+						  __ATOMIC_ACQUIRE))
+		{
+			ctx_free (info->ctx, bcast);
+			bcast = old;
+		}
+	}
+
+	sub = ctx_alloc (info->ctx, sizeof (*sub));
+	if (!sub)
+	{
+		ctx_err (info_ctx (info), _("%s: %s"), __func__,
+			 g_strerror (errno));
+		return NULL;
+	}
+
+	sub->ctx = info->ctx;
+	sub->bcast = bcast;
+	sub->seen = __atomic_load_n (&bcast->seq, __ATOMIC_ACQUIRE);
+
+	return sub;
+}
+
+/**
+ * remove an interrupt subscriber
+ * @param sub subscriber
+ */
+void uio_irq_unsubscribe (struct uio_irq_sub_t *sub)
+{
+	if (sub)
+		ctx_free (sub->ctx, sub);
+}
+
+/**
+ * fetch the latest interrupt without blocking
+ * @param sub subscriber
+ * @param ev latest event
+ * @param missed number of events published but not seen by this
+ *        subscriber since its previous fetch, or NULL
+ * @returns 1 if a new event was fetched, 0 if there is none or it was
+ *          overwritten while being fetched, or -1 on failure and errno
+ *          is set
+ */
+int uio_irq_sub_poll (struct uio_irq_sub_t *sub, struct uio_irq_event_t *ev,
+		      uint64_t *missed)
+{
+	uint64_t seq;
+
+	if (!sub || !ev)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	seq = __atomic_load_n (&sub->bcast->seq, __ATOMIC_ACQUIRE);
+	if (seq == sub->seen)
+		return 0;
+
+	/* lapped while copying: the next fetch accounts for this event */
+	if (!bcast_read (sub->bcast, seq, ev))
+		return 0;
+	if (missed)
+		*missed = seq - sub->seen - 1;
+	sub->seen = seq;
+
+	return 1;
+}
+
+/**
+ * wait for the next interrupt
+ * @param sub subscriber
+ * @param ev latest event
+ * @param missed number of events missed since the previous fetch or NULL
+ * @param timeout timeout or NULL to wait forever
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_irq_sub_wait (struct uio_irq_sub_t *sub, struct uio_irq_event_t *ev,
+		      uint64_t *missed, struct timeval *timeout)
+{
+	struct timespec deadline, *pdeadline = NULL;
+	struct uio_irq_bcast_t *bcast;
+	int val, ret;
+
+	if (!sub || !ev)
+	{
+		errno = EINVAL;
+		ctx_warn_hot (NULL, _("%s: %s"), __func__,
+			      g_strerror (errno));
+		return -1;
+	}
+
+	if (timeout)
+	{
+		timeval_to_deadline (timeout, &deadline);
+		pdeadline = &deadline;
+	}
+
+	bcast = sub->bcast;
+	for (;;)
+	{
+		val = __atomic_load_n (&bcast->futex, __ATOMIC_SEQ_CST);
+		if (uio_irq_sub_poll (sub, ev, missed) == 1)
+			return 0;
+
+		__atomic_fetch_add (&bcast->waiters, 1, __ATOMIC_SEQ_CST);
+		ret = futex_wait (&bcast->futex, val, pdeadline);
+		__atomic_fetch_sub (&bcast->waiters, 1, __ATOMIC_SEQ_CST);
+
+		if (ret < 0 && errno == ETIMEDOUT)
+			return -1;
+	}
+}
+
+/** @} */
@@ -0,0 +1,440 @@
+/*
+ * libuio - UserspaceIO helper library
+ *
+ * Copyright (C) 2011 Benedikt Spranger
+ * based on libUIO by Hans J. Koch
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include "libuio_internal.h"
+
+/**
+ * @defgroup libuio_handoff libuio device handoff functions
+ * @ingroup libuio_public
+ * @brief public functions to pass opened devices between processes
+ *
+ * uio_export() sends the device descriptor with SCM_RIGHTS over a UNIX
+ * socket together with the serialized device description and map
+ * table. uio_import() rebuilds a usable device from it without
+ * touching sysfs or /dev.
+ * @{
+ */
+
+#define HANDOFF_MAGIC	0x48494f55	/* "UOIH" */
+#define HANDOFF_VERSION	1
+
+struct handoff_hdr_t {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t len;
+	uint32_t pad;
+};
+
+struct handoff_buf_t {
+	char *data;
+	size_t len;
+	size_t pos;
+};
+
+static int put (struct handoff_buf_t *buf, const void *data, size_t len)
+{
+	char *tmp;
+
+	if (buf->pos + len > buf->len)
+	{
+		tmp = realloc (buf->data, (buf->pos + len) * 2);
+		if (!tmp)
+			return -1;
+		buf->data = tmp;
+		buf->len = (buf->pos + len) * 2;
+	}
+
+	memcpy (buf->data + buf->pos, data, len);
+	buf->pos += len;
+
+	return 0;
+}
+
+static int put_u64 (struct handoff_buf_t *buf, uint64_t val)
+{
+	return put (buf, &val, sizeof (val));
+}
+
+static int put_str (struct handoff_buf_t *buf, const char *str)
+{
+	uint32_t len = str ? strlen (str) + 1 : 0;
+
+	if (put (buf, &len, sizeof (len)))
+		return -1;
+
+	return put (buf, str, len);
+}
+
+static int get (struct handoff_buf_t *buf, void *data, size_t len)
+{
+	if (buf->pos + len > buf->len)
+		return -1;
+
+	memcpy (data, buf->data + buf->pos, len);
+	buf->pos += len;
+
+	return 0;
+}
+
+static int get_u64 (struct handoff_buf_t *buf, uint64_t *val)
+{
+	return get (buf, val, sizeof (*val));
+}
+
+static int get_str (struct uio_ctx_t *ctx, struct handoff_buf_t *buf,
+		    char **str)
+{
+	uint32_t len;
+
+	*str = NULL;
+	if (get (buf, &len, sizeof (len)) || buf->pos + len > buf->len)
+		return -1;
+
+	if (!len)
+		return 0;
+
+	if (buf->data [buf->pos + len - 1])
+		return -1;
+
+	*str = ctx_strdup (ctx, buf->data + buf->pos);
+	if (!*str)
+		return -1;
+	buf->pos += len;
+
+	return 0;
+}
+
+static int serialize (struct uio_info_t* info, struct handoff_buf_t *buf)
+{
+	int i;
+
+	if (put_u64 (buf, info->devid) || put_u64 (buf, info->maxmap) ||
+	    put_str (buf, info->path) || put_str (buf, info->name) ||
+	    put_str (buf, info->version) || put_str (buf, info->devname))
+		return -1;
+
+	for (i = 0; i < info->maxmap; i++)
+	{
+		if (put_u64 (buf, info->maps [i].addr) ||
+		    put_u64 (buf, info->maps [i].size) ||
+		    put_u64 (buf, info->maps [i].offset) ||
+		    put_u64 (buf, info->maps [i].prot) ||
+		    put_str (buf, info->maps [i].name))
+			return -1;
+	}
+
+	return 0;
+}
+
+static struct uio_info_t *deserialize (struct uio_ctx_t *ctx,
+				       struct handoff_buf_t *buf)
+{
+	struct uio_info_t *info;
+	uint64_t val, maxmap;
+	int i;
+
+	info = ctx_alloc (ctx, sizeof (*info));
+	if (!info)
+		return NULL;
+	info->ctx = ctx;
+	info->fd = -1;
+	info->irqfd = -1;
+
+	if (get_u64 (buf, &val) || get_u64 (buf, &maxmap) ||
+	    maxmap > 1024 ||
+	    get_str (ctx, buf, &info->path) ||
+	    get_str (ctx, buf, &info->name) ||
+	    get_str (ctx, buf, &info->version) ||
+	    get_str (ctx, buf, &info->devname))
+		goto err_free;
+	info->devid = val;
+
+	if (maxmap)
+	{
+		info->maps = ctx_alloc (ctx, maxmap * sizeof (*info->maps));
+		if (!info->maps)
+			goto err_free;
+	}
+
+	for (i = 0; i < (int) maxmap; i++)
+	{
+		struct uio_map_t *map = &info->maps [i];
+
+		map->map = MAP_FAILED;
+		info->maxmap = i + 1;
+		if (get_u64 (buf, &val))
+			goto err_free;
+		map->addr = val;
+		if (get_u64 (buf, &val))
+			goto err_free;
+		map->size = val;
+		if (get_u64 (buf, &val))
+			goto err_free;
+		map->offset = val;
+		if (get_u64 (buf, &val))
+			goto err_free;
+		map->prot = val;
+		if (get_str (ctx, buf, &map->name))
+			goto err_free;
+	}
+
+	return info;
+
+err_free:
+	uio_free_info (info);
+	errno = EPROTO;
+
+	return NULL;
+}
+
+/**
+ * export an opened UIO device over a UNIX socket
+ * @param info opened UIO device info struct
+ * @param sock connected UNIX domain socket
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_export (struct uio_info_t* info, int sock)
+{
+	struct handoff_buf_t buf = { NULL, 0, 0 };
+	struct handoff_hdr_t hdr;
+	union {
+		char buf [CMSG_SPACE (sizeof (int))];
+		struct cmsghdr align;
+	} ctrl;
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	ssize_t ret;
+	size_t done;
+	int err;
+
+	if (!info || info->fd == -1)
+	{
+		errno = EINVAL;
+		ctx_warn (info_ctx (info), _("%s: %s"), __func__,
+			  g_strerror (errno));
+		return -1;
+	}
+
+	if (serialize (info, &buf))
+	{
+		free (buf.data);
+		errno = ENOMEM;
+		ctx_err (info_ctx (info), _("%s: %s"), __func__,
+			 g_strerror (errno));
+		return -1;
+	}
+
+	hdr.magic = HANDOFF_MAGIC;
+	hdr.version = HANDOFF_VERSION;
+	hdr.len = buf.pos;
+	hdr.pad = 0;
+
+	memset (&msg, 0, sizeof (msg));
+	memset (&ctrl, 0, sizeof (ctrl));
+	iov.iov_base = &hdr;
+	iov.iov_len = sizeof (hdr);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctrl.buf;
+	msg.msg_controllen = sizeof (ctrl.buf);
+
+	cmsg = CMSG_FIRSTHDR (&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN (sizeof (int));
+	memcpy (CMSG_DATA (cmsg), &info->fd, sizeof (int));
+
+	do
+		ret = sendmsg (sock, &msg, MSG_NOSIGNAL);
+	while (ret < 0 && errno == EINTR);
+	if (ret != sizeof (hdr))
+		goto err;
+
+	for (done = 0; done < buf.pos; done += ret)
+	{
+		ret = send (sock, buf.data + done, buf.pos - done,
+			    MSG_NOSIGNAL);
+		if (ret < 0 && errno == EINTR)
+			ret = 0;
+		else if (ret <= 0)
+			goto err;
+	}
+
+	free (buf.data);
+
+	return 0;
+
+err:
+	err = ret < 0 ? errno : EPIPE;
+	free (buf.data);
+	errno = err;
+	ctx_err (info_ctx (info), _("%s: %s"), __func__, g_strerror (errno));
+
+	return -1;
+}
+
+/**
+ * import a UIO device exported by uio_export() into a library context
+ *
+ * The received descriptor is mapped according to flags exactly like
+ * uio_open_ex() would do; sysfs and /dev are not accessed. The device
+ * info struct and everything attached to it later are allocated from
+ * the context. Malformed messages, e.g. with an empty description, a
+ * truncated control message or more than one descriptor, fail with
+ * EPROTO and every received descriptor is closed.
+ * @param ctx library context, NULL for the default context
+ * @param sock connected UNIX domain socket
+ * @param flags UIO_OPEN_* flags
+ * @returns opened UIO device info struct or NULL on failure and errno is set
+ */
+struct uio_info_t *uio_ctx_import (struct uio_ctx_t *ctx, int sock, int flags)
+{
+	struct handoff_buf_t buf = { NULL, 0, 0 };
+	struct uio_info_t *info = NULL;
+	struct handoff_hdr_t hdr;
+	union {
+		char buf [CMSG_SPACE (sizeof (int))];
+		struct cmsghdr align;
+	} ctrl;
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	size_t i, nr;
+	ssize_t ret;
+	int fd = -1, extra = 0, tmp, err;
+
+	memset (&msg, 0, sizeof (msg));
+	iov.iov_base = &hdr;
+	iov.iov_len = sizeof (hdr);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctrl.buf;
+	msg.msg_controllen = sizeof (ctrl.buf);
+
+	do
+		ret = recvmsg (sock, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+	while (ret < 0 && errno == EINTR);
+	if (ret < 0)
+		goto err;
+
+	/* keep the first descriptor, a well behaved peer sends no more */
+	for (cmsg = CMSG_FIRSTHDR (&msg); cmsg; cmsg = CMSG_NXTHDR (&msg, cmsg))
+	{
+		if (cmsg->cmsg_level != SOL_SOCKET ||
+		    cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+
+		nr = (cmsg->cmsg_len - CMSG_LEN (0)) / sizeof (int);
+		for (i = 0; i < nr; i++)
+		{
+			memcpy (&tmp, CMSG_DATA (cmsg) + i * sizeof (int),
+				sizeof (int));
+			if (fd < 0)
+				fd = tmp;
+			else
+			{
+				close (tmp);
+				extra = 1;
+			}
+		}
+	}
+
+	if (ret != sizeof (hdr) || fd < 0 || extra ||
+	    (msg.msg_flags & MSG_CTRUNC) || hdr.magic != HANDOFF_MAGIC ||
+	    hdr.version != HANDOFF_VERSION || !hdr.len ||
+	    hdr.len > (1 << 20))
+	{
+		errno = EPROTO;
+		goto err;
+	}
+
+	buf.data = malloc (hdr.len);
+	if (!buf.data)
+	{
+		errno = ENOMEM;
+		goto err;
+	}
+	buf.len = hdr.len;
+
+	do
+		ret = recv (sock, buf.data, buf.len, MSG_WAITALL);
+	while (ret < 0 && errno == EINTR);
+	if (ret != (ssize_t) buf.len)
+	{
+		if (ret >= 0)
+			errno = EPROTO;
+		goto err;
+	}
+
+	info = deserialize (ctx, &buf);
+	if (!info)
+		goto err;
+	free (buf.data);
+
+	info->fd = fd;
+	if (map_device (info, NULL, flags))
+	{
+		err = errno;
+		uio_free_info (info);
+		errno = err;
+		ctx_err (ctx, _("%s: %s"), __func__, g_strerror (errno));
+		return NULL;
+	}
+
+	return info;
+
+err:
+	err = errno;
+	if (fd >= 0)
+		close (fd);
+	free (buf.data);
+	errno = err;
+	ctx_err (ctx, _("%s: %s"), __func__, g_strerror (errno));
+
+	return NULL;
+}
+
+/**
+ * import a UIO device exported by uio_export()
+ * @param sock connected UNIX domain socket
+ * @param flags UIO_OPEN_* flags
+ * @returns opened UIO device info struct or NULL on failure and errno is set
+ */
+struct uio_info_t *uio_import (int sock, int flags)
+{
+	return uio_ctx_import (NULL, sock, flags);
+}
+
+/** @} */
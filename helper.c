@@ -32,8 +32,10 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <linux/futex.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/sysmacros.h>
 #include <sys/types.h>
 
@@ -46,12 +48,55 @@
  * @{
  */
 
+/**
+ * wait on a futex word
+ * @param addr futex word
+ * @param val expected value
+ * @param deadline absolute CLOCK_MONOTONIC deadline or NULL
+ * @returns 0 on wakeup or -1 on failure and errno is set
+ */
+int futex_wait (int *addr, int val, const struct timespec *deadline)
+{
+	return syscall (SYS_futex, addr, FUTEX_WAIT_BITSET_PRIVATE, val,
+			deadline, NULL, FUTEX_BITSET_MATCH_ANY);
+}
+
+/**
+ * wake all waiters of a futex word
+ * @param addr futex word
+ * @returns number of woken waiters or -1 on failure and errno is set
+ */
+int futex_wake (int *addr)
+{
+	return syscall (SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL,
+			NULL, 0);
+}
+
+/**
+ * convert a relative timeout into an absolute CLOCK_MONOTONIC deadline
+ * @param timeout relative timeout
+ * @param deadline absolute deadline
+ */
+void timeval_to_deadline (const struct timeval *timeout,
+			  struct timespec *deadline)
+{
+	clock_gettime (CLOCK_MONOTONIC, deadline);
+	deadline->tv_sec += timeout->tv_sec;
+	deadline->tv_nsec += timeout->tv_usec * 1000;
+	if (deadline->tv_nsec >= 1000000000)
+	{
+		deadline->tv_sec++;
+		deadline->tv_nsec -= 1000000000;
+	}
+}
+
 /**
  * read a line from a file
+ * @param ctx library context, allocates the line
  * @param filename file name
  * @returns first line or NULL on failure
  */
-char *first_line_from_file (char *filename)
+char *first_line_from_file (struct uio_ctx_t *ctx, char *filename)
 {
 	char c, *out;
 	int fd, len;
@@ -59,26 +104,26 @@ char *first_line_from_file (char *filename)
 	fd = open (filename, O_RDONLY);
 	if (fd < 0)
 	{
-		g_warning (_("open: %s: %s"), filename, g_strerror (errno));
+		ctx_dbg (ctx, _("open: %s: %s"), filename, g_strerror (errno));
 		return NULL;
 	}
 
 	for (len = 0; ((read (fd, &c, 1) == 1) && (c != '\n')); len++);
 	lseek (fd, 0, SEEK_SET);
 
-	out = malloc (len + 1);
+	out = ctx_alloc (ctx, len + 1);
 	if (!out)
 	{
 		errno = ENOMEM;
-		g_warning (_("malloc: %s"), g_strerror (errno));
+		ctx_err (ctx, _("malloc: %s"), g_strerror (errno));
 		goto out;
 	}
 
 	len = read (fd, out, len);
 	if (len < 0)
 	{
-		g_warning (_("read: %s"), g_strerror (errno));
-		free (out);
+		ctx_err (ctx, _("read: %s"), g_strerror (errno));
+		ctx_free (ctx, out);
 		out = NULL;
 		goto out;
 	}
@@ -92,10 +137,11 @@ out:
 
 /**
  * read device id from file
+ * @param ctx library context
  * @param filename file name
  * @returns device id or 0 on failure
  */
-dev_t devid_from_file (char *filename)
+dev_t devid_from_file (struct uio_ctx_t *ctx, char *filename)
 {
 	FILE *fhan;
 	int major, minor;
@@ -104,7 +150,7 @@ dev_t devid_from_file (char *filename)
 	fhan = fopen (filename, "r");
 	if (!fhan)
 	{
-		g_warning (_("fopen: %s"), g_strerror (errno));
+		ctx_err (ctx, _("fopen: %s"), g_strerror (errno));
 		goto out;
 	}
 
@@ -119,11 +165,13 @@ out:
 
 /**
  * read a line from a file
+ * @param ctx library context
  * @param dir map directory
  * @param maxmap available maps
  * @returns maps or NULL on failure/no maps
  */
-static struct uio_map_t *scan_maps (char *dir, int *maxmap)
+static struct uio_map_t *scan_maps (struct uio_ctx_t *ctx, char *dir,
+				    int *maxmap)
 {
 	struct uio_map_t *map = NULL;
 	struct dirent **namelist;
@@ -136,11 +184,11 @@ static struct uio_map_t *scan_maps (char *dir, int *maxmap)
 	if (nr < 0)
 		return NULL;
 
-	map = calloc (nr, sizeof (struct uio_map_t));
+	map = ctx_alloc (ctx, nr * sizeof (struct uio_map_t));
 	if (!map)
 	{
 		errno = ENOMEM;
-		g_warning (_("calloc: %s"), g_strerror (errno));
+		ctx_err (ctx, _("calloc: %s"), g_strerror (errno));
 		goto err_nomem1;
 	}
 
@@ -159,25 +207,25 @@ static struct uio_map_t *scan_maps (char *dir, int *maxmap)
 		if (spfret < 0 || spfret >= (int)sizeof (name))
 			goto err_inv_name;
 
-		tmp = first_line_from_file (name);
+		tmp = first_line_from_file (ctx, name);
 		map [t].addr = strtoul (tmp, NULL, 0);
-		free (tmp);
+		ctx_free (ctx, tmp);
 
 		spfret = snprintf (name, sizeof (name), "%s/%s/name",
 		                   dir, namelist [i]->d_name);
 		if (spfret < 0 || spfret >= (int)sizeof (name))
 			goto err_inv_name;
 
-		map [t].name = first_line_from_file (name);
+		map [t].name = first_line_from_file (ctx, name);
 
 		spfret = snprintf (name, sizeof (name), "%s/%s/size",
 		                   dir, namelist [i]->d_name);
 		if (spfret < 0 || spfret >= (int)sizeof (name))
 			goto err_inv_name;
 
-		tmp = first_line_from_file (name);
+		tmp = first_line_from_file (ctx, name);
 		map [t].size = strtoul (tmp, NULL, 0);
-		free (tmp);
+		ctx_free (ctx, tmp);
 		map [t].offset = map [t].addr & (getpagesize () - 1);
 		map [t].map = MAP_FAILED;
 
@@ -190,8 +238,8 @@ static struct uio_map_t *scan_maps (char *dir, int *maxmap)
 	return map;
 
 err_inv_name:
-	g_warning (_("invalid name"));
-	free(map);
+	ctx_warn (ctx, _("invalid name"));
+	ctx_free (ctx, map);
 err_nomem1:
 	for (i = 0; i < nr; i++)
 	{
@@ -206,12 +254,14 @@ err_nomem1:
 
 /**
  * search device node name by major/minor
+ * @param ctx library context, allocates the name
  * @param dir start in directory dir
  * @param devid major/minor
  * @param devname first matching device node name
  * @returns -1 on error, 0 on not found and 1 on success
  */
-static int search_major_minor (const char *dir, dev_t devid, char **devname)
+static int search_major_minor (struct uio_ctx_t *ctx, const char *dir,
+			       dev_t devid, char **devname)
 {
 	struct dirent **namelist;
 	struct stat stat;
@@ -221,14 +271,14 @@ static int search_major_minor (const char *dir, dev_t devid, char **devname)
 	if (!devname)
 	{
 		errno = EINVAL;
-		g_warning (_("search_major_minor: %s"), g_strerror (errno));
+		ctx_warn (ctx, _("search_major_minor: %s"), g_strerror (errno));
 		return -1;
 	}
 
 	nr = scandir (dir, &namelist, 0, alphasort);
 	if (nr < 0)
 	{
-		g_warning (_("scandir: %s"), g_strerror (errno));
+		ctx_err (ctx, _("scandir: %s"), g_strerror (errno));
 		return nr;
 	}
 
@@ -244,13 +294,13 @@ static int search_major_minor (const char *dir, dev_t devid, char **devname)
 		ret = lstat (name, &stat);
 		if (ret < 0)
 		{
-			g_warning (_("lstat: %s"), g_strerror (errno));
+			ctx_err (ctx, _("lstat: %s"), g_strerror (errno));
 			goto out;
 		}
 
 		if (S_ISDIR (stat.st_mode))
 		{
-			ret = search_major_minor (name, devid, devname);
+			ret = search_major_minor (ctx, name, devid, devname);
 			if (ret != 0)
 				goto out;
 		}
@@ -260,11 +310,12 @@ static int search_major_minor (const char *dir, dev_t devid, char **devname)
 			if (stat.st_rdev != devid)
 				continue;
 
-			*devname = strdup (name);
+			*devname = ctx_strdup (ctx, name);
 			if (!*devname)
 			{
 				errno = ENOMEM;
-				g_warning (_("strdup: %s"), g_strerror (errno));
+				ctx_err (ctx, _("strdup: %s"),
+					 g_strerror (errno));
 				ret = -1;
 			}
 			else
@@ -283,37 +334,46 @@ out:
 
 /**
  * create UIO device info struct
+ * @param ctx library context, NULL for the default context
  * @param dir sysfs directory
  * @param name uio device entry
  * @returns UIO device info struct or NULL on failure
  */
-struct uio_info_t *create_uio_info (char *dir, char *name)
+struct uio_info_t *create_uio_info (struct uio_ctx_t *ctx, char *dir,
+				    char *name)
 {
 	struct uio_info_t *info;
 	char filename [PATH_MAX];
 
-	info = calloc (1, sizeof (struct uio_info_t));
+	info = ctx_alloc (ctx, sizeof (struct uio_info_t));
 	if (!info)
 		return NULL;
+	info->ctx = ctx;
 
 	snprintf (filename, PATH_MAX, "%s/%s", dir, name);
-	info->path = strdup (filename);
+	info->path = ctx_strdup (ctx, filename);
 
 	snprintf (filename, PATH_MAX, "%s/%s/name", dir, name);
-	info->name = first_line_from_file (filename);
+	info->name = first_line_from_file (ctx, filename);
 
 	snprintf (filename, PATH_MAX, "%s/%s/version", dir, name);
-	info->version = first_line_from_file (filename);
+	info->version = first_line_from_file (ctx, filename);
 
 	snprintf (filename, PATH_MAX, "%s/%s/dev", dir, name);
-	info->devid = devid_from_file (filename);
+	info->devid = devid_from_file (ctx, filename);
 
-	search_major_minor ("/dev", info->devid, &info->devname);
+	/* walking /dev is the expensive part of discovery */
+	info->devname = ctx_devname_lookup (ctx, info->devid);
+	if (!info->devname &&
+	    search_major_minor (ctx, ctx_dev_root (ctx), info->devid,
+				&info->devname) == 1)
+		ctx_devname_store (ctx, info->devid, info->devname);
 
 	snprintf (filename, PATH_MAX, "%s/%s/maps", dir, name);
-	info->maps = scan_maps (filename, &info->maxmap);
+	info->maps = scan_maps (ctx, filename, &info->maxmap);
 
 	info->fd = -1;
+	info->irqfd = -1;
 
 	return info;
 }
@@ -40,6 +40,30 @@
  * @{
  */
 
+/**
+ * account an interrupt consumed by one of the library wait paths
+ * @param info UIO device info struct
+ * @param count UIO interrupt count
+ * @param stamp CLOCK_MONOTONIC wakeup time or NULL for now
+ */
+void irq_notify (struct uio_info_t* info, uint32_t count,
+		 const struct timespec *stamp)
+{
+	struct timespec now;
+
+	if (!stamp)
+	{
+		clock_gettime (CLOCK_MONOTONIC, &now);
+		stamp = &now;
+	}
+
+	if (info->irqstat)
+		irqstat_wakeup (info, stamp);
+
+	if (info->bcast)
+		bcast_publish (info->bcast, count, stamp);
+}
+
 /**
  * enable UIO device interrupt
  * @param info UIO device info struct
@@ -52,7 +76,8 @@ int uio_enable_irq (struct uio_info_t* info)
 	if (!info || info->fd == -1)
 	{
 		errno = EINVAL;
-		g_warning (_("%s: %s"), __func__, g_strerror (errno));
+		ctx_warn_hot (info_ctx (info), _("%s: %s"), __func__,
+			      g_strerror (errno));
 		return -1;
 	}
 
@@ -71,7 +96,8 @@ int uio_disable_irq (struct uio_info_t* info)
 	if (!info || info->fd == -1)
 	{
 		errno = EINVAL;
-		g_warning (_("%s: %s"), __func__, g_strerror (errno));
+		ctx_warn_hot (info_ctx (info), _("%s: %s"), __func__,
+			      g_strerror (errno));
 		return -1;
 	}
 
@@ -86,16 +112,23 @@ int uio_disable_irq (struct uio_info_t* info)
  */
 int uio_irqwait_timeout (struct uio_info_t* info, struct timeval *timeout)
 {
-	unsigned long dummy;
+	struct uio_stats_page_t *stats;
+	struct timespec start;
+	uint32_t count;
 	int ret;
 
 	if (!info || info->fd == -1)
 	{
 		errno = EINVAL;
-		g_warning (_("%s: %s"), __func__, g_strerror (errno));
+		ctx_warn_hot (info_ctx (info), _("%s: %s"), __func__,
+			      g_strerror (errno));
 		return -1;
 	}
 
+	stats = stats_get (info);
+	if (stats)
+		clock_gettime (CLOCK_MONOTONIC, &start);
+
 	if (timeout)
 	{
 		fd_set rfds;
@@ -106,13 +139,121 @@ int uio_irqwait_timeout (struct uio_info_t* info, struct timeval *timeout)
 		if (ret < 1) {
 			if (ret == 0)
 				errno = ETIMEDOUT;
-			return -1;
+			ret = -1;
+			goto out;
 		}
 	}
 
-	ret = read (info->fd, &dummy, 4);
+	ret = read (info->fd, &count, 4);
+	if (ret < 0)
+		goto out;
+
+	irq_delivered (info, count, NULL);
+	ret = 0;
+
+out:
+	if (stats)
+		stats_wait_done (stats, &start, ret);
+
+	return ret;
+}
+
+/**
+ * get a pollable interrupt file descriptor for event loops
+ *
+ * Opens a second, non-blocking descriptor of the device node on first
+ * use. The UIO core keeps a separate event counter per open file, so
+ * this descriptor sees every interrupt without stealing them from
+ * uio_irqwait() callers. It becomes readable (POLLIN/EPOLLIN) when an
+ * interrupt is pending; call uio_irq_consume() then. The descriptor is
+ * owned by the library and closed by uio_close().
+ * @param info UIO device info struct
+ * @returns file descriptor or -1 on failure and errno is set, ENODEV if
+ *          the device has no device node
+ */
+int uio_irq_pollfd (struct uio_info_t* info)
+{
+	int fd, old = -1;
+
+	if (!info || info->fd == -1)
+	{
+		errno = EINVAL;
+		ctx_warn (info_ctx (info), _("%s: %s"), __func__,
+			  g_strerror (errno));
+		return -1;
+	}
+
+	/* simulated devices come with theirs */
+	fd = __atomic_load_n (&info->irqfd, __ATOMIC_ACQUIRE);
+	if (fd >= 0)
+		return fd;
+
+	if (!info->devname)
+	{
+		errno = ENODEV;
+		ctx_warn (info_ctx (info), _("%s: %s"), __func__,
+			  g_strerror (errno));
+		return -1;
+	}
+
+	fd = open (info->devname, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0)
+	{
+		ctx_err (info_ctx (info), _("open: %s"), g_strerror (errno));
+		return -1;
+	}
+
+	if (!__atomic_compare_exchange_n (&info->irqfd, &old, fd, 0,
+					  __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+	{
+		/* somebody else was faster */
+		close (fd);
+		fd = old;
+	}
+
+	return fd;
+}
+
+/**
+ * consume, count and re-enable a pending interrupt
+ *
+ * Completes the UIO interrupt protocol for the descriptor returned by
+ * uio_irq_pollfd(): reads the interrupt counter without blocking,
+ * computes the number of interrupts since the previous call and
+ * re-enables the interrupt. May be called from any thread or event loop.
+ * @param info UIO device info struct
+ * @param events number of interrupts since the last call or NULL
+ * @returns 1 if an interrupt was consumed, 0 if none was pending or
+ *          -1 on failure and errno is set
+ */
+int uio_irq_consume (struct uio_info_t* info, uint32_t *events)
+{
+	uint32_t count, last;
+	unsigned long tmp = 1;
+	int fd;
+
+	fd = uio_irq_pollfd (info);
+	if (fd < 0)
+		return -1;
+
+	if (read (fd, &count, 4) != 4)
+	{
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return 0;
+		return -1;
+	}
+
+	irq_delivered (info, count, NULL);
+
+	last = __atomic_exchange_n (&info->irqcount, count, __ATOMIC_RELAXED);
+	if (events)
+		*events = (last && count != last) ? count - last : 1;
+
+	/* drivers without irqcontrol keep the interrupt enabled anyway */
+	if (write (fd, &tmp, 4) != 4 && errno != ENOSYS)
+		return -1;
 
-	return (ret < 0) ? ret : 0;
+	return 1;
 }
 
 /** @} */
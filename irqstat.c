@@ -0,0 +1,471 @@
+/*
+ * libuio - UserspaceIO helper library
+ *
+ * Copyright (C) 2011 Benedikt Spranger
+ * based on libUIO by Hans J. Koch
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libuio_internal.h"
+
+/**
+ * @defgroup libuio_irqstat libuio irq latency statistics
+ * @ingroup libuio_public
+ * @brief public irq latency and jitter instrumentation
+ *
+ * All values are recorded in nanoseconds into log-linear histograms:
+ * values below 16 have their own bucket, above that every power of two
+ * is split into 16 linear sub-buckets, which bounds the relative error
+ * to about 6%. Values are clamped to 2^40 ns.
+ * @{
+ */
+
+#define HIST_SUB_BITS	4
+#define HIST_SUB	(1 << HIST_SUB_BITS)
+#define HIST_MAX_EXP	(UIO_HIST_BUCKETS / HIST_SUB + HIST_SUB_BITS - 2)
+
+struct uio_irqstat_t {
+	struct uio_histogram_t hist [UIO_STAT_MAX];
+	uint64_t last_wakeup;
+	uint64_t wakeup;
+	uint64_t begin;
+
+	/* optional device side interrupt timestamp */
+	int ts_map;
+	int ts_width;
+	unsigned long ts_latch;
+	unsigned long ts_counter;
+	uint64_t ts_hz;
+};
+
+static const char *stat_names [UIO_STAT_MAX] = {
+	[UIO_STAT_INTERARRIVAL]		= N_("inter-arrival"),
+	[UIO_STAT_WAKEUP_TO_HANDLER]	= N_("wakeup-to-handler"),
+	[UIO_STAT_HANDLER]		= N_("handler"),
+	[UIO_STAT_DEVICE_TO_WAKEUP]	= N_("device-to-wakeup"),
+};
+
+static inline uint64_t now_ns (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return timespec_to_ns (&ts);
+}
+
+static int hist_index (uint64_t val)
+{
+	int exp;
+
+	if (val < HIST_SUB)
+		return val;
+
+	exp = 63 - __builtin_clzll (val);
+	if (exp > HIST_MAX_EXP)
+		return UIO_HIST_BUCKETS - 1;
+
+	return (exp - HIST_SUB_BITS + 1) * HIST_SUB +
+		((val >> (exp - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+static uint64_t hist_value (int idx)
+{
+	int exp;
+
+	if (idx < HIST_SUB)
+		return idx;
+
+	exp = idx / HIST_SUB + HIST_SUB_BITS - 1;
+
+	return (uint64_t) (HIST_SUB + idx % HIST_SUB) << (exp - HIST_SUB_BITS);
+}
+
+static void hist_record (struct uio_histogram_t *hist, uint64_t val)
+{
+	uint64_t old;
+
+	__atomic_fetch_add (&hist->buckets [hist_index (val)], 1,
+			    __ATOMIC_RELAXED);
+	__atomic_fetch_add (&hist->sum, val, __ATOMIC_RELAXED);
+	__atomic_fetch_add (&hist->count, 1, __ATOMIC_RELAXED);
+
+	old = __atomic_load_n (&hist->min, __ATOMIC_RELAXED);
+	while (val < old &&
+	       !__atomic_compare_exchange_n (&hist->min, &old, val, 1,
+					     __ATOMIC_RELAXED,
+					     __ATOMIC_RELAXED));
+
+	old = __atomic_load_n (&hist->max, __ATOMIC_RELAXED);
+	while (val > old &&
+	       !__atomic_compare_exchange_n (&hist->max, &old, val, 1,
+					     __ATOMIC_RELAXED,
+					     __ATOMIC_RELAXED));
+}
+
+static void hist_reset (struct uio_histogram_t *hist)
+{
+	memset (hist, 0, sizeof (*hist));
+	hist->min = UINT64_MAX;
+}
+
+static int dev_latency (struct uio_info_t *info, struct uio_irqstat_t *stat,
+			uint64_t *ns)
+{
+	uint64_t latch, counter, ticks;
+	uint32_t l32, c32;
+
+	if (stat->ts_width == 64)
+	{
+		if (uio_read64 (info, stat->ts_map, stat->ts_latch, &latch) ||
+		    uio_read64 (info, stat->ts_map, stat->ts_counter, &counter))
+			return -1;
+		ticks = counter - latch;
+	}
+	else
+	{
+		if (uio_read32 (info, stat->ts_map, stat->ts_latch, &l32) ||
+		    uio_read32 (info, stat->ts_map, stat->ts_counter, &c32))
+			return -1;
+		ticks = (uint32_t) (c32 - l32);
+	}
+
+	*ns = (uint64_t) ((unsigned __int128) ticks * 1000000000ULL /
+			  stat->ts_hz);
+
+	return 0;
+}
+
+/**
+ * record an interrupt wakeup (called from the library wait paths)
+ * @param info UIO device info struct
+ * @param stamp CLOCK_MONOTONIC wakeup time or NULL for now
+ */
+void irqstat_wakeup (struct uio_info_t *info, const struct timespec *stamp)
+{
+	struct uio_irqstat_t *stat = info->irqstat;
+	uint64_t now, last, lat;
+
+	now = stamp ? timespec_to_ns (stamp) : now_ns ();
+
+	last = __atomic_exchange_n (&stat->last_wakeup, now, __ATOMIC_RELAXED);
+	if (last && now > last)
+		hist_record (&stat->hist [UIO_STAT_INTERARRIVAL], now - last);
+
+	__atomic_store_n (&stat->wakeup, now, __ATOMIC_RELEASE);
+
+	if (stat->ts_hz && !dev_latency (info, stat, &lat))
+		hist_record (&stat->hist [UIO_STAT_DEVICE_TO_WAKEUP], lat);
+}
+
+/**
+ * enable irq latency instrumentation
+ * @param info UIO device info struct
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_irq_stats_enable (struct uio_info_t *info)
+{
+	struct uio_irqstat_t *stat;
+	int i;
+
+	if (!info)
+	{
+		errno = EINVAL;
+		ctx_warn (info_ctx (info), _("%s: %s"), __func__,
+			  g_strerror (errno));
+		return -1;
+	}
+
+	if (info->irqstat)
+		return 0;
+
+	stat = ctx_alloc (info->ctx, sizeof (*stat));
+	if (!stat)
+	{
+		ctx_err (info_ctx (info), _("%s: %s"), __func__,
+			 g_strerror (errno));
+		return -1;
+	}
+
+	for (i = 0; i < UIO_STAT_MAX; i++)
+		hist_reset (&stat->hist [i]);
+
+	info->irqstat = stat;
+
+	return 0;
+}
+
+/**
+ * disable irq latency instrumentation and drop collected data
+ *
+ * Must not be called while another thread waits on the device.
+ * @param info UIO device info struct
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_irq_stats_disable (struct uio_info_t *info)
+{
+	if (!info)
+	{
+		errno = EINVAL;
+		ctx_warn (info_ctx (info), _("%s: %s"), __func__,
+			  g_strerror (errno));
+		return -1;
+	}
+
+	ctx_free (info->ctx, info->irqstat);
+	info->irqstat = NULL;
+
+	return 0;
+}
+
+/**
+ * reset all irq latency histograms
+ * @param info UIO device info struct
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_irq_stats_reset (struct uio_info_t *info)
+{
+	int i;
+
+	if (!info || !info->irqstat)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (i = 0; i < UIO_STAT_MAX; i++)
+		hist_reset (&info->irqstat->hist [i]);
+	info->irqstat->last_wakeup = 0;
+
+	return 0;
+}
+
+/**
+ * configure a device side interrupt timestamp
+ *
+ * At every wakeup the latched interrupt timestamp and the free running
+ * device counter are read and their difference is recorded as
+ * device-to-wakeup latency.
+ * @param info UIO device info struct
+ * @param map_num memory bar number holding both registers
+ * @param latch offset of the register latching the counter at irq time
+ * @param counter offset of the free running counter register
+ * @param width register width in bits (32 or 64)
+ * @param hz counter frequency
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_irq_stats_set_dev_timestamp (struct uio_info_t *info, int map_num,
+				     unsigned long latch, unsigned long counter,
+				     int width, uint64_t hz)
+{
+	struct uio_irqstat_t *stat;
+
+	if (!info || !info->irqstat || map_num < 0 ||
+	    map_num >= info->maxmap || !hz || (width != 32 && width != 64))
+	{
+		errno = EINVAL;
+		ctx_warn (info_ctx (info), _("%s: %s"), __func__,
+			  g_strerror (errno));
+		return -1;
+	}
+
+	stat = info->irqstat;
+	stat->ts_map = map_num;
+	stat->ts_latch = latch;
+	stat->ts_counter = counter;
+	stat->ts_width = width;
+	stat->ts_hz = hz;
+
+	return 0;
+}
+
+/**
+ * mark start of interrupt handling
+ *
+ * Records the time since the last wakeup as wakeup-to-handler latency.
+ * @param info UIO device info struct
+ */
+void uio_irq_handler_begin (struct uio_info_t *info)
+{
+	struct uio_irqstat_t *stat;
+	uint64_t now, wakeup;
+
+	if (!info || !info->irqstat)
+		return;
+
+	stat = info->irqstat;
+	now = now_ns ();
+	wakeup = __atomic_load_n (&stat->wakeup, __ATOMIC_ACQUIRE);
+	if (wakeup && now >= wakeup)
+		hist_record (&stat->hist [UIO_STAT_WAKEUP_TO_HANDLER],
+			     now - wakeup);
+	stat->begin = now;
+}
+
+/**
+ * mark end of interrupt handling
+ *
+ * Records the time since uio_irq_handler_begin() as handler duration.
+ * @param info UIO device info struct
+ */
+void uio_irq_handler_end (struct uio_info_t *info)
+{
+	struct uio_irqstat_t *stat;
+	uint64_t now;
+
+	if (!info || !info->irqstat || !info->irqstat->begin)
+		return;
+
+	stat = info->irqstat;
+	now = now_ns ();
+	if (now >= stat->begin)
+		hist_record (&stat->hist [UIO_STAT_HANDLER], now - stat->begin);
+	stat->begin = 0;
+}
+
+/**
+ * get a copy of an irq latency histogram
+ * @param info UIO device info struct
+ * @param which histogram selector
+ * @param hist histogram destination
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_irq_stats_get (struct uio_info_t *info, enum uio_irq_stat_t which,
+		       struct uio_histogram_t *hist)
+{
+	struct uio_histogram_t *src;
+	int i;
+
+	if (!info || !info->irqstat || !hist || which < 0 ||
+	    which >= UIO_STAT_MAX)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	src = &info->irqstat->hist [which];
+	hist->count = __atomic_load_n (&src->count, __ATOMIC_RELAXED);
+	hist->sum = __atomic_load_n (&src->sum, __ATOMIC_RELAXED);
+	hist->min = __atomic_load_n (&src->min, __ATOMIC_RELAXED);
+	hist->max = __atomic_load_n (&src->max, __ATOMIC_RELAXED);
+	for (i = 0; i < UIO_HIST_BUCKETS; i++)
+		hist->buckets [i] = __atomic_load_n (&src->buckets [i],
+						     __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+/**
+ * get a percentile from a histogram
+ * @param hist histogram
+ * @param percentile percentile (0.0 - 100.0)
+ * @returns lower bound of the bucket holding the percentile in ns,
+ *          clamped to the recorded minimum
+ */
+uint64_t uio_histogram_percentile (const struct uio_histogram_t *hist,
+				   double percentile)
+{
+	uint64_t total = 0, target, val;
+	int i;
+
+	if (!hist || !hist->count)
+		return 0;
+
+	for (i = 0; i < UIO_HIST_BUCKETS; i++)
+		total += hist->buckets [i];
+
+	target = (uint64_t) (total * percentile / 100.0);
+	if (target >= total)
+		return hist->max;
+
+	for (i = 0, total = 0; i < UIO_HIST_BUCKETS; i++)
+	{
+		total += hist->buckets [i];
+		if (total > target)
+			break;
+	}
+
+	val = hist_value (i);
+	if (val < hist->min)
+		val = hist->min;
+
+	return val;
+}
+
+/**
+ * format all irq latency histograms as readable text
+ * @param info UIO device info struct
+ * @returns string to be released by the caller with free () or NULL on
+ *          failure; it is owned by the caller, so unlike the device
+ *          state it does not come from the context allocator
+ */
+char *uio_irq_stats_format (struct uio_info_t *info)
+{
+	struct uio_histogram_t hist;
+	size_t len = 0, size = UIO_STAT_MAX * 192 + 128;
+	char *out;
+	int i;
+
+	if (!info || !info->irqstat)
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+
+	out = malloc (size);
+	if (!out)
+	{
+		errno = ENOMEM;
+		ctx_err (info_ctx (info), _("malloc: %s"),
+			 g_strerror (errno));
+		return NULL;
+	}
+
+	len += snprintf (out + len, size - len,
+			 _("%-18s %10s %10s %10s %10s %10s %10s %10s\n"),
+			 info->name ? info->name : "", _("count"), _("min"),
+			 _("p50"), _("p99"), _("p99.9"), _("max"), _("mean"));
+
+	for (i = 0; i < UIO_STAT_MAX; i++)
+	{
+		uio_irq_stats_get (info, i, &hist);
+		len += snprintf (out + len, size - len,
+				 "%-18s %10llu %10llu %10llu %10llu %10llu %10llu %10llu\n",
+				 _(stat_names [i]),
+				 (unsigned long long) hist.count,
+				 (unsigned long long) (hist.count ? hist.min : 0),
+				 (unsigned long long) uio_histogram_percentile (&hist, 50),
+				 (unsigned long long) uio_histogram_percentile (&hist, 99),
+				 (unsigned long long) uio_histogram_percentile (&hist, 99.9),
+				 (unsigned long long) hist.max,
+				 (unsigned long long) (hist.count ? hist.sum / hist.count : 0));
+		if (len >= size)
+			break;
+	}
+
+	return out;
+}
+
+/** @} */
@@ -0,0 +1,590 @@
+/*
+ * libuio - UserspaceIO helper library
+ *
+ * Copyright (C) 2011 Benedikt Spranger
+ * based on libUIO by Hans J. Koch
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA
+ */
+
+#define _GNU_SOURCE
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/eventfd.h>
+#include <sys/types.h>
+
+#include "libuio_internal.h"
+
+/**
+ * @defgroup libuio_irqthread libuio irq service thread functions
+ * @ingroup libuio_public
+ * @brief public irq service thread functions
+ * @{
+ */
+
+#define UIO_IRQ_RING_DEFAULT	256
+
+struct uio_irq_cell_t {
+	unsigned long seq;
+	struct uio_irq_event_t ev;
+};
+
+struct uio_irq_thread_t {
+	struct uio_info_t **info;
+	struct pollfd *pfd;		/* stop eventfd and the devices */
+	int nr;
+	int flags;
+	pthread_t thread;
+	int stopfd;
+	int efd;
+	struct uio_irq_cell_t *ring;
+	unsigned long mask;
+	unsigned long dropped;
+
+	/* producer and consumer indices live on separate cache lines */
+	unsigned long head __attribute__ ((aligned (64)));
+	unsigned long tail __attribute__ ((aligned (64)));
+
+	/* bumped on every publish, consumers sleep on it */
+	int futex __attribute__ ((aligned (64)));
+	int waiters;
+};
+
+/**
+ * read a short sysfs value without warning on absence
+ * @param filename file name
+ * @param buf destination buffer
+ * @param len buffer size
+ * @returns 0 on success or -1 on failure
+ */
+static int read_sysfs_value (const char *filename, char *buf, size_t len)
+{
+	ssize_t ret;
+	int fd;
+
+	fd = open (filename, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	ret = read (fd, buf, len - 1);
+	close (fd);
+	if (ret <= 0)
+		return -1;
+
+	buf [ret] = 0;
+
+	return 0;
+}
+
+/**
+ * parse a kernel cpulist ("0-3,8,10-11")
+ * @param list cpu list string
+ * @param set resulting cpu set
+ * @returns 0 on success or -1 on failure
+ */
+static int parse_cpulist (const char *list, cpu_set_t *set)
+{
+	unsigned long first, last;
+	char *end;
+
+	CPU_ZERO (set);
+	while (*list && *list != '\n')
+	{
+		first = strtoul (list, &end, 10);
+		if (end == list)
+			return -1;
+
+		last = first;
+		if (*end == '-')
+		{
+			list = end + 1;
+			last = strtoul (list, &end, 10);
+			if (end == list || last < first)
+				return -1;
+		}
+
+		for (; first <= last && first < CPU_SETSIZE; first++)
+			CPU_SET (first, set);
+
+		if (*end == ',')
+			end++;
+		else if (*end && *end != '\n')
+			return -1;
+		list = end;
+	}
+
+	return CPU_COUNT (set) ? 0 : -1;
+}
+
+/**
+ * get the cpus local to the numa node of a UIO device
+ * @param info UIO device info struct
+ * @param set resulting cpu set
+ * @returns 0 on success or -1 if no numa information is available
+ */
+static int numa_cpus (struct uio_info_t *info, cpu_set_t *set)
+{
+	char filename [PATH_MAX], buf [4096];
+	int node;
+
+	snprintf (filename, PATH_MAX, "%s/device/numa_node", info->path);
+	if (read_sysfs_value (filename, buf, sizeof (buf)))
+		return -1;
+
+	node = strtol (buf, NULL, 0);
+	if (node < 0)
+		return -1;
+
+	snprintf (filename, PATH_MAX, "%s/devices/system/node/node%d/cpulist",
+		  ctx_sysfs_point (info->ctx), node);
+	if (read_sysfs_value (filename, buf, sizeof (buf)))
+		return -1;
+
+	return parse_cpulist (buf, set);
+}
+
+static int ring_put (struct uio_irq_thread_t *thread,
+		     struct uio_irq_event_t *ev)
+{
+	struct uio_irq_cell_t *cell;
+	unsigned long pos = thread->head;
+
+	cell = &thread->ring [pos & thread->mask];
+	if (__atomic_load_n (&cell->seq, __ATOMIC_ACQUIRE) != pos)
+		return -1;
+
+	cell->ev = *ev;
+	__atomic_store_n (&cell->seq, pos + 1, __ATOMIC_RELEASE);
+	thread->head = pos + 1;
+
+	return 0;
+}
+
+static void publish (struct uio_irq_thread_t *thread)
+{
+	uint64_t one = 1;
+
+	__atomic_fetch_add (&thread->futex, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n (&thread->waiters, __ATOMIC_SEQ_CST))
+		futex_wake (&thread->futex);
+
+	if (thread->efd >= 0 && write (thread->efd, &one, sizeof (one)) < 0)
+		log_err (_("eventfd: %s"), g_strerror (errno));
+}
+
+static void *irq_thread (void *arg)
+{
+	struct uio_irq_thread_t *thread = arg;
+	struct pollfd *pfd = thread->pfd;
+	struct uio_irq_event_t ev;
+	uint32_t count;
+	int i, ret, published;
+
+	for (;;)
+	{
+		ret = poll (pfd, thread->nr + 1, -1);
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			log_err (_("poll: %s"), g_strerror (errno));
+			break;
+		}
+
+		if (pfd [0].revents)
+			break;
+
+		clock_gettime (CLOCK_MONOTONIC, &ev.stamp);
+
+		published = 0;
+		for (i = 0; i < thread->nr; i++)
+		{
+			if (pfd [i + 1].revents & (POLLERR | POLLHUP | POLLNVAL))
+			{
+				log_err (_("%s: irq source lost"),
+					 thread->info [i]->name);
+				pfd [i + 1].fd = -1;
+				continue;
+			}
+
+			if (!(pfd [i + 1].revents & POLLIN))
+				continue;
+
+			if (read (thread->info [i]->fd, &count, 4) != 4)
+				continue;
+
+			irq_delivered (thread->info [i], count, &ev.stamp);
+
+			ev.dev = i;
+			ev.count = count;
+			if (ring_put (thread, &ev))
+				__atomic_fetch_add (&thread->dropped, 1,
+						    __ATOMIC_RELAXED);
+			else
+				published++;
+
+			if (thread->flags & UIO_IRQ_THREAD_REENABLE)
+				uio_enable_irq (thread->info [i]);
+		}
+
+		if (published)
+			publish (thread);
+	}
+
+	return NULL;
+}
+
+/**
+ * initialize irq service thread attributes with defaults
+ *
+ * The default is no realtime priority, a ring of 256 events and an
+ * affinity to the cpus of the first device's numa node (if known).
+ * @param attr irq service thread attributes
+ */
+void uio_irq_thread_attr_init (struct uio_irq_thread_attr_t *attr)
+{
+	if (!attr)
+		return;
+
+	attr->cpus = NULL;
+	attr->priority = 0;
+	attr->ring_size = UIO_IRQ_RING_DEFAULT;
+	attr->flags = 0;
+}
+
+/**
+ * start an irq service thread for a group of opened UIO devices
+ *
+ * The thread waits for interrupts of all devices in the group and
+ * publishes an event (device index, timestamp, interrupt count) per
+ * interrupt to a bounded lock-free ring. Events are dropped and
+ * counted when the ring is full.
+ * @param info array of opened UIO device info structs
+ * @param nr number of devices in the array
+ * @param attr thread attributes or NULL for defaults
+ * @returns irq service thread or NULL on failure and errno is set
+ */
+struct uio_irq_thread_t *uio_irq_thread_create (struct uio_info_t **info,
+		int nr, const struct uio_irq_thread_attr_t *attr)
+{
+	struct uio_irq_thread_attr_t defattr;
+	struct uio_irq_thread_t *thread;
+	struct sched_param param;
+	pthread_attr_t pattr;
+	cpu_set_t cpus;
+	unsigned long i;
+	int ret, have_cpus = 0;
+
+	if (!attr)
+	{
+		uio_irq_thread_attr_init (&defattr);
+		attr = &defattr;
+	}
+
+	if (!info || nr <= 0 || !attr->ring_size ||
+	    (attr->ring_size & (attr->ring_size - 1)))
+	{
+		errno = EINVAL;
+		log_warn (_("%s: %s"), __func__, g_strerror (errno));
+		return NULL;
+	}
+
+	for (ret = 0; ret < nr; ret++)
+	{
+		if (!info [ret] || info [ret]->fd == -1)
+		{
+			errno = EINVAL;
+			log_warn (_("%s: %s"), __func__, g_strerror (errno));
+			return NULL;
+		}
+	}
+
+	if (attr->cpus)
+	{
+		if (parse_cpulist (attr->cpus, &cpus))
+		{
+			errno = EINVAL;
+			log_warn (_("%s: invalid cpu list %s"), __func__,
+				  attr->cpus);
+			return NULL;
+		}
+		have_cpus = 1;
+	}
+	else if (!numa_cpus (info [0], &cpus))
+		have_cpus = 1;
+
+	thread = calloc (1, sizeof (*thread));
+	if (!thread)
+	{
+		errno = ENOMEM;
+		log_err (_("calloc: %s"), g_strerror (errno));
+		return NULL;
+	}
+
+	thread->nr = nr;
+	thread->flags = attr->flags;
+	thread->mask = attr->ring_size - 1;
+	thread->efd = -1;
+	thread->stopfd = -1;
+
+	thread->info = calloc (nr, sizeof (*info));
+	thread->pfd = calloc (nr + 1, sizeof (*thread->pfd));
+	thread->ring = calloc (attr->ring_size, sizeof (*thread->ring));
+	if (!thread->info || !thread->pfd || !thread->ring)
+	{
+		errno = ENOMEM;
+		log_err (_("calloc: %s"), g_strerror (errno));
+		goto err_free;
+	}
+	memcpy (thread->info, info, nr * sizeof (*info));
+
+	for (i = 0; i < attr->ring_size; i++)
+		thread->ring [i].seq = i;
+
+	thread->stopfd = eventfd (0, EFD_CLOEXEC);
+	if (thread->stopfd < 0)
+	{
+		log_err (_("eventfd: %s"), g_strerror (errno));
+		goto err_free;
+	}
+
+	thread->pfd [0].fd = thread->stopfd;
+	thread->pfd [0].events = POLLIN;
+	for (ret = 0; ret < nr; ret++)
+	{
+		thread->pfd [ret + 1].fd = info [ret]->fd;
+		thread->pfd [ret + 1].events = POLLIN;
+	}
+
+	if (attr->flags & UIO_IRQ_THREAD_EVENTFD)
+	{
+		thread->efd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if (thread->efd < 0)
+		{
+			log_err (_("eventfd: %s"), g_strerror (errno));
+			goto err_free;
+		}
+	}
+
+	pthread_attr_init (&pattr);
+	if (have_cpus)
+		pthread_attr_setaffinity_np (&pattr, sizeof (cpus), &cpus);
+	if (attr->priority > 0)
+	{
+		param.sched_priority = attr->priority;
+		pthread_attr_setinheritsched (&pattr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy (&pattr, SCHED_FIFO);
+		pthread_attr_setschedparam (&pattr, &param);
+	}
+
+	ret = pthread_create (&thread->thread, &pattr, irq_thread, thread);
+	pthread_attr_destroy (&pattr);
+	if (ret)
+	{
+		errno = ret;
+		log_err (_("pthread_create: %s"), g_strerror (errno));
+		goto err_free;
+	}
+	pthread_setname_np (thread->thread, "uio-irq");
+
+	return thread;
+
+err_free:
+	ret = errno;
+	if (thread->efd >= 0)
+		close (thread->efd);
+	if (thread->stopfd >= 0)
+		close (thread->stopfd);
+	free (thread->ring);
+	free (thread->pfd);
+	free (thread->info);
+	free (thread);
+	errno = ret;
+
+	return NULL;
+}
+
+/**
+ * stop an irq service thread and free its resources
+ *
+ * The UIO devices stay open.
+ * @param thread irq service thread
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_irq_thread_destroy (struct uio_irq_thread_t *thread)
+{
+	uint64_t one = 1;
+
+	if (!thread)
+	{
+		errno = EINVAL;
+		log_warn (_("%s: %s"), __func__, g_strerror (errno));
+		return -1;
+	}
+
+	if (write (thread->stopfd, &one, sizeof (one)) < 0)
+	{
+		log_err (_("eventfd: %s"), g_strerror (errno));
+		return -1;
+	}
+	pthread_join (thread->thread, NULL);
+
+	if (thread->efd >= 0)
+		close (thread->efd);
+	close (thread->stopfd);
+	free (thread->ring);
+	free (thread->pfd);
+	free (thread->info);
+	free (thread);
+
+	return 0;
+}
+
+/**
+ * fetch the next interrupt event without blocking
+ *
+ * Any number of consumers may call this concurrently.
+ * @param thread irq service thread
+ * @param ev event destination
+ * @returns 1 if an event was fetched, 0 if the ring is empty or -1 on failure
+ */
+int uio_irq_thread_poll (struct uio_irq_thread_t *thread,
+			 struct uio_irq_event_t *ev)
+{
+	struct uio_irq_cell_t *cell;
+	unsigned long pos, seq;
+	long diff;
+
+	if (!thread || !ev)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	pos = __atomic_load_n (&thread->tail, __ATOMIC_RELAXED);
+	for (;;)
+	{
+		cell = &thread->ring [pos & thread->mask];
+		seq = __atomic_load_n (&cell->seq, __ATOMIC_ACQUIRE);
+		diff = (long) (seq - (pos + 1));
+
+		if (diff < 0)
+			return 0;
+
+		if (diff > 0)
+		{
+			pos = __atomic_load_n (&thread->tail, __ATOMIC_RELAXED);
+			continue;
+		}
+
+		if (__atomic_compare_exchange_n (&thread->tail, &pos, pos + 1,
+						 1, __ATOMIC_RELAXED,
+						 __ATOMIC_RELAXED))
+			break;
+	}
+
+	*ev = cell->ev;
+	__atomic_store_n (&cell->seq, pos + thread->mask + 1,
+			  __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+/**
+ * wait for the next interrupt event
+ * @param thread irq service thread
+ * @param ev event destination
+ * @param timeout timeout or NULL to wait forever
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_irq_thread_wait (struct uio_irq_thread_t *thread,
+			 struct uio_irq_event_t *ev, struct timeval *timeout)
+{
+	struct timespec deadline, *pdeadline = NULL;
+	int seq, ret;
+
+	if (!thread || !ev)
+	{
+		errno = EINVAL;
+		ctx_warn_hot (NULL, _("%s: %s"), __func__,
+			      g_strerror (errno));
+		return -1;
+	}
+
+	if (timeout)
+	{
+		timeval_to_deadline (timeout, &deadline);
+		pdeadline = &deadline;
+	}
+
+	for (;;)
+	{
+		seq = __atomic_load_n (&thread->futex, __ATOMIC_SEQ_CST);
+		if (uio_irq_thread_poll (thread, ev) == 1)
+			return 0;
+
+		__atomic_fetch_add (&thread->waiters, 1, __ATOMIC_SEQ_CST);
+		ret = futex_wait (&thread->futex, seq, pdeadline);
+		__atomic_fetch_sub (&thread->waiters, 1, __ATOMIC_SEQ_CST);
+
+		if (ret < 0 && errno == ETIMEDOUT)
+			return -1;
+	}
+}
+
+/**
+ * get the event notification file descriptor of an irq service thread
+ *
+ * The descriptor is only available if the thread was created with
+ * UIO_IRQ_THREAD_EVENTFD. It becomes readable whenever events were
+ * published and can be added to poll/epoll sets.
+ * @param thread irq service thread
+ * @returns eventfd or -1 on failure
+ */
+int uio_irq_thread_get_fd (struct uio_irq_thread_t *thread)
+{
+	if (!thread)
+		return -1;
+
+	return thread->efd;
+}
+
+/**
+ * get number of events dropped because the ring was full
+ * @param thread irq service thread
+ * @returns number of dropped events
+ */
+unsigned long uio_irq_thread_get_dropped (struct uio_irq_thread_t *thread)
+{
+	if (!thread)
+		return 0;
+
+	return __atomic_load_n (&thread->dropped, __ATOMIC_RELAXED);
+}
+
+/** @} */
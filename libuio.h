@@ -25,6 +25,8 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <time.h>
+
 #include <sys/time.h>
 #include <sys/types.h>
 
@@ -33,6 +35,234 @@ extern "C" {
 #endif /* __cplusplus */
 
 struct uio_info_t;
+struct uio_irq_thread_t;
+struct uio_irq_sub_t;
+struct uio_pool_t;
+struct uio_ring_t;
+struct uio_capture_t;
+struct uio_sim_t;
+struct uio_watch_t;
+struct uio_attr_t;
+struct uio_attr_notify_t;
+struct uio_ctx_t;
+struct uio_broker_t;
+struct uio_client_t;
+
+/* irq service thread flags */
+#define UIO_IRQ_THREAD_REENABLE	(1 << 0)	/* re-enable irq after each event */
+#define UIO_IRQ_THREAD_EVENTFD	(1 << 1)	/* provide an eventfd for consumers */
+
+struct uio_irq_thread_attr_t {
+	const char *cpus;		/* cpulist, NULL for numa_node cpus */
+	int priority;			/* SCHED_FIFO priority, 0 for none */
+	unsigned int ring_size;		/* event ring size, power of two */
+	int flags;
+};
+
+/* irq latency statistics */
+#define UIO_HIST_BUCKETS	592
+
+enum uio_irq_stat_t {
+	UIO_STAT_INTERARRIVAL,		/* wakeup to previous wakeup */
+	UIO_STAT_WAKEUP_TO_HANDLER,	/* wakeup to uio_irq_handler_begin */
+	UIO_STAT_HANDLER,		/* handler begin to handler end */
+	UIO_STAT_DEVICE_TO_WAKEUP,	/* device timestamp to wakeup */
+	UIO_STAT_MAX
+};
+
+struct uio_histogram_t {
+	uint64_t count;
+	uint64_t sum;			/* ns */
+	uint64_t min;			/* ns */
+	uint64_t max;			/* ns */
+	uint64_t buckets [UIO_HIST_BUCKETS];
+};
+
+struct uio_irq_event_t {
+	struct timespec stamp;		/* CLOCK_MONOTONIC wakeup time */
+	uint32_t count;			/* UIO interrupt count */
+	int dev;			/* device index within group */
+};
+
+/* descriptor ring roles and flags */
+#define UIO_RING_PRODUCER	0		/* library fills, device drains */
+#define UIO_RING_CONSUMER	1		/* device fills, library drains */
+#define UIO_RING_IRQ		(1 << 0)	/* uio_ring_wait() on interrupt */
+
+struct uio_ring_attr_t {
+	int desc_map;			/* memory bar holding descriptors */
+	unsigned long desc_offset;	/* first descriptor within bar */
+	size_t desc_size;		/* bytes per descriptor, 4 aligned */
+	unsigned entries;		/* number of slots, power of two */
+	int reg_map;			/* memory bar holding index registers */
+	unsigned long head_reg;		/* producer index register offset */
+	unsigned long tail_reg;		/* consumer index register offset */
+	int role;			/* UIO_RING_PRODUCER or _CONSUMER */
+	int flags;			/* UIO_RING_IRQ */
+};
+
+/* capture engine flags */
+#define UIO_CAPTURE_REENABLE	(1 << 0)	/* re-enable irq after each event */
+#define UIO_CAPTURE_DROP	(1 << 1)	/* drop instead of blocking */
+
+struct uio_capture_attr_t {
+	int map;			/* memory bar holding the segments */
+	unsigned long offset;		/* first segment, 16 byte aligned */
+	size_t seg_size;		/* bytes per segment, multiple of 64 */
+	unsigned segments;		/* 2 for a ping-pong buffer */
+	int index_map;			/* bar of completed segment register */
+	unsigned long index_reg;	/* or index_map -1 for round robin */
+	unsigned buffers;		/* in-flight copies */
+	int flags;			/* UIO_CAPTURE_* */
+};
+
+struct uio_capture_stats_t {
+	uint64_t segments;		/* segments captured */
+	uint64_t bytes;			/* bytes written */
+	uint64_t overruns;		/* interrupts missed, data lost */
+	uint64_t stalls;		/* waits for the writer */
+	uint64_t dropped;		/* segments dropped, no buffer */
+	int error;			/* first output errno or 0 */
+};
+
+struct uio_attr_req_t {
+	struct uio_info_t *info;
+	const char *attr;
+	void *buf;
+	size_t len;
+	ssize_t result;			/* bytes read or -errno */
+};
+
+struct uio_watch_change_t {
+	unsigned long offset;		/* register offset within bar */
+	uint32_t old_val;
+	uint32_t new_val;
+};
+
+struct uio_broker_acl_t {
+	uid_t uid;			/* (uid_t) -1 for every client */
+	int dev;			/* index into the broker's devices */
+	int map_num;
+	unsigned long offset;
+	size_t size;
+	int flags;			/* UIO_BROKER_READ, UIO_BROKER_WRITE */
+};
+
+struct uio_broker_op_t {
+	int dev;			/* index into the broker's devices */
+	int map_num;
+	unsigned long offset;
+	int width;			/* 8, 16, 32 or 64 */
+	int write;
+	uint64_t value;			/* written or read value */
+	int result;			/* 0 or -errno */
+};
+
+/* statistics page, see uio_stats_publish () */
+#define UIO_STATS_PREFIX	"libuio."
+#define UIO_STATS_MAGIC		0x54534955	/* "UIST" */
+#define UIO_STATS_VERSION	1
+
+/*
+ * Layout version 1. Fields are only ever appended: readers check the
+ * magic, accept any version >= 1 and must not look beyond size. Each
+ * counter group has a cache line of its own, so the interrupt path and
+ * the register accessors do not bounce lines between each other.
+ */
+struct uio_stats_page_t {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;			/* valid bytes in this page */
+	uint32_t pid;
+	char name [24];			/* UIO name */
+	char devname [24];		/* device node */
+
+	/* interrupts */
+	uint64_t irqs __attribute__ ((aligned (64)));	/* delivered */
+	uint64_t waits;			/* uio_irqwait*() calls */
+	uint64_t wait_ns;		/* total time spent waiting */
+	uint64_t wait_max_ns;
+	uint64_t timeouts;
+
+	/* register accessors */
+	uint64_t reads __attribute__ ((aligned (64)));
+	uint64_t writes __attribute__ ((aligned (64)));
+
+	/* failed accesses and waits */
+	uint64_t errors __attribute__ ((aligned (64)));
+};
+
+/* register access trace file, see uio_trace_dump () */
+#define UIO_TRACE_MAGIC		"UIOTRC01"
+#define UIO_TRACE_VERSION	2
+#define UIO_TRACE_WRITE		(1 << 0)
+
+/*
+ * A trace file is a header, the device table and the records in time
+ * stamp order, all in the byte order of the recording host. Version 1
+ * files have no device table and record the device minor instead.
+ */
+struct uio_trace_hdr_t {
+	char magic [8];
+	uint32_t version;
+	uint32_t rec_size;		/* sizeof (struct uio_trace_rec_t) */
+	uint64_t records;
+	uint64_t lost;			/* overwritten before the dump */
+	uint64_t tsc_hz;		/* time stamp ticks per second */
+	uint32_t devices;		/* entries of the device table */
+	uint32_t dev_size;		/* sizeof (struct uio_trace_dev_t) */
+};
+
+struct uio_trace_dev_t {
+	char name [32];			/* device node name, e.g. uio0, or
+					   the name of a simulated device */
+};
+
+struct uio_trace_rec_t {
+	uint64_t tsc;			/* time stamp counter */
+	uint64_t value;			/* value read or written */
+	uint64_t offset;		/* register offset within the bar */
+	uint32_t dev;			/* index into the device table */
+	uint16_t map_num;
+	uint8_t width;			/* 8, 16, 32 or 64 */
+	uint8_t flags;			/* UIO_TRACE_WRITE */
+};
+
+/* log levels */
+#define UIO_LOG_ERR		0
+#define UIO_LOG_WARNING		1
+#define UIO_LOG_INFO		2
+#define UIO_LOG_DEBUG		3
+
+typedef void (*uio_log_fn_t) (void *arg, int level, const char *msg);
+
+struct uio_ctx_attr_t {
+	const char *sysfs_root;		/* NULL for /sys */
+	const char *dev_root;		/* NULL for /dev */
+	void *(*alloc) (void *arg, size_t size);
+	void (*release) (void *arg, void *ptr);
+	void *alloc_arg;
+	uio_log_fn_t log;		/* NULL for the library wide sink */
+	void *log_arg;
+};
+
+typedef int (*uio_bin_attr_cb_t) (void *arg, const void *data, size_t len,
+				  off_t offset);
+
+typedef void (*uio_watch_cb_t) (void *arg,
+				const struct uio_watch_change_t *change);
+
+/* broker allowlist flags */
+#define UIO_BROKER_READ		(1 << 0)
+#define UIO_BROKER_WRITE	(1 << 1)
+
+/* open flags */
+#define UIO_OPEN_PRIVATE	(1 << 0)	/* map copy-on-write */
+#define UIO_OPEN_LAZY		(1 << 1)	/* map on first use */
+#define UIO_OPEN_POPULATE	(1 << 2)	/* prefault mappings */
+#define UIO_OPEN_MLOCK		(1 << 3)	/* lock mappings */
+#define UIO_OPEN_HUGE_ALIGN	(1 << 4)	/* 2 MiB / 1 GiB alignment */
+#define UIO_OPEN_STATS		(1 << 5)	/* publish statistics page */
 
 /* base functions */
 struct uio_info_t **uio_find_devices ();
@@ -50,8 +280,77 @@ int uio_get_fd (struct uio_info_t* info);
 int uio_open (struct uio_info_t* info);
 int uio_open_fix (struct uio_info_t* info, void *ptr);
 int uio_open_private (struct uio_info_t* info);
+int uio_open_ex (struct uio_info_t* info, int flags);
+int uio_open_window (struct uio_info_t** info, int nr, void *ptr, int flags);
+void *uio_get_window (struct uio_info_t* info, size_t *size);
+struct uio_info_t *uio_open_shared (struct uio_info_t* info, int flags);
+int uio_close_shared (struct uio_info_t* info);
+int uio_export (struct uio_info_t* info, int sock);
+struct uio_info_t *uio_import (int sock, int flags);
+struct uio_info_t *uio_ctx_import (struct uio_ctx_t *ctx, int sock, int flags);
+int uio_set_map_prot (struct uio_info_t* info, int map_num, int prot);
+int uio_map_mem (struct uio_info_t* info, int map_num, int prot);
+int uio_unmap_mem (struct uio_info_t* info, int map_num);
+size_t uio_get_mem_pagesize (struct uio_info_t* info, int map_num);
 int uio_close (struct uio_info_t* info);
 
+/* register access broker functions */
+struct uio_broker_t *uio_broker_create (const char *path,
+		struct uio_info_t **info, int nr,
+		const struct uio_broker_acl_t *acl, int nacl);
+void uio_broker_set_spin (struct uio_broker_t *broker, unsigned long usecs);
+int uio_broker_destroy (struct uio_broker_t *broker);
+struct uio_client_t *uio_client_connect (const char *path);
+void uio_client_close (struct uio_client_t *client);
+int uio_client_read8 (struct uio_client_t *client, int dev, int map_num,
+		      unsigned long offset, uint8_t *val);
+int uio_client_read16 (struct uio_client_t *client, int dev, int map_num,
+		       unsigned long offset, uint16_t *val);
+int uio_client_read32 (struct uio_client_t *client, int dev, int map_num,
+		       unsigned long offset, uint32_t *val);
+int uio_client_read64 (struct uio_client_t *client, int dev, int map_num,
+		       unsigned long offset, uint64_t *val);
+int uio_client_write8 (struct uio_client_t *client, int dev, int map_num,
+		       unsigned long offset, uint8_t val);
+int uio_client_write16 (struct uio_client_t *client, int dev, int map_num,
+			unsigned long offset, uint16_t val);
+int uio_client_write32 (struct uio_client_t *client, int dev, int map_num,
+			unsigned long offset, uint32_t val);
+int uio_client_write64 (struct uio_client_t *client, int dev, int map_num,
+			unsigned long offset, uint64_t val);
+int uio_client_batch (struct uio_client_t *client, struct uio_broker_op_t *ops,
+		      int nr);
+
+/* statistics page functions */
+int uio_stats_publish (struct uio_info_t* info);
+void uio_stats_unpublish (struct uio_info_t* info);
+const struct uio_stats_page_t *uio_get_stats (struct uio_info_t* info);
+
+/* register access trace functions */
+int uio_trace_start (unsigned int entries);
+void uio_trace_stop (void);
+long uio_trace_dump (int fd);
+
+/* context functions */
+struct uio_ctx_t *uio_ctx_new (const struct uio_ctx_attr_t *attr);
+void uio_ctx_free (struct uio_ctx_t *ctx);
+struct uio_ctx_t *uio_get_ctx (struct uio_info_t* info);
+struct uio_info_t **uio_ctx_find_devices (struct uio_ctx_t *ctx);
+void uio_ctx_free_list (struct uio_ctx_t *ctx, struct uio_info_t **list);
+struct uio_info_t *uio_ctx_find_by_uio_name (struct uio_ctx_t *ctx,
+					     char *uio_name);
+struct uio_info_t *uio_ctx_find_by_uio_num (struct uio_ctx_t *ctx, int num);
+struct uio_info_t *uio_ctx_find_by_base_addr (struct uio_ctx_t *ctx,
+					      unsigned int base_addr);
+
+/* logging functions */
+void uio_set_log_level (int level);
+int uio_get_log_level (void);
+void uio_set_log_ratelimit (unsigned int interval_ms, unsigned int burst);
+void uio_set_log_handler (uio_log_fn_t fn, void *arg);
+int uio_log_ring_init (unsigned int entries);
+int uio_log_drain (uio_log_fn_t fn, void *arg);
+
 /* attribute functions */
 char **uio_list_attr (struct uio_info_t* info);
 char *uio_get_attr (struct uio_info_t* info, char *attr);
@@ -59,6 +358,47 @@ int uio_set_attr (struct uio_info_t* info, char *attr, char *value);
 void *uio_get_bin_attr (struct uio_info_t* info, char *attr, size_t count);
 int uio_set_bin_attr (struct uio_info_t* info, char *attr,
 		      void *value, size_t count);
+struct uio_attr_t *uio_attr_open (struct uio_info_t* info, const char *attr);
+ssize_t uio_attr_read (struct uio_attr_t *handle, void *buf, size_t count);
+ssize_t uio_attr_write (struct uio_attr_t *handle, const void *buf,
+			size_t count);
+int uio_attr_read_batch (struct uio_attr_req_t *reqs, unsigned nr);
+ssize_t uio_read_bin_attr (struct uio_info_t* info, const char *attr,
+			   void *buf, size_t count, off_t offset);
+ssize_t uio_write_bin_attr (struct uio_info_t* info, const char *attr,
+			    const void *buf, size_t count, off_t offset);
+ssize_t uio_stream_bin_attr (struct uio_info_t* info, const char *attr,
+			     off_t offset, uio_bin_attr_cb_t cb, void *arg);
+ssize_t uio_get_bin_attr_size (struct uio_info_t* info, const char *attr);
+void *uio_map_bin_attr (struct uio_info_t* info, const char *attr, int prot,
+			size_t *size);
+int uio_unmap_bin_attr (void *map, size_t size);
+int uio_get_attr_u32 (struct uio_info_t* info, const char *attr,
+		      uint32_t *val);
+int uio_get_attr_u64 (struct uio_info_t* info, const char *attr,
+		      uint64_t *val);
+int uio_get_attr_s64 (struct uio_info_t* info, const char *attr,
+		      int64_t *val);
+int uio_get_attr_hex (struct uio_info_t* info, const char *attr,
+		      uint64_t *val);
+int uio_get_attr_bool (struct uio_info_t* info, const char *attr, int *val);
+int uio_set_attr_u32 (struct uio_info_t* info, const char *attr,
+		      uint32_t val);
+int uio_set_attr_u64 (struct uio_info_t* info, const char *attr,
+		      uint64_t val);
+int uio_set_attr_s64 (struct uio_info_t* info, const char *attr,
+		      int64_t val);
+int uio_set_attr_hex (struct uio_info_t* info, const char *attr,
+		      uint64_t val);
+int uio_set_attr_bool (struct uio_info_t* info, const char *attr, int val);
+struct uio_attr_notify_t *uio_attr_notify_open (struct uio_info_t* info,
+						const char *attr);
+int uio_attr_notify_get_fd (struct uio_attr_notify_t *notify);
+ssize_t uio_attr_notify_read (struct uio_attr_notify_t *notify, void *buf,
+			      size_t count);
+ssize_t uio_attr_notify_wait (struct uio_attr_notify_t *notify, void *buf,
+			      size_t count, struct timeval *timeout);
+void uio_attr_notify_close (struct uio_attr_notify_t *notify);
 
 /* memory functions */
 int uio_get_maxmap (struct uio_info_t* info);
@@ -85,16 +425,111 @@ int uio_write32 (struct uio_info_t* info, int map, unsigned long offset,
 int uio_write64 (struct uio_info_t* info, int map, unsigned long offset,
 		 uint64_t val);
 
+/* DMA buffer pool functions */
+struct uio_pool_t *uio_pool_create (struct uio_info_t* info, int map_num,
+				    size_t offset, size_t size, size_t align);
+void uio_pool_destroy (struct uio_pool_t *pool);
+void *uio_pool_alloc (struct uio_pool_t *pool, size_t size);
+void uio_pool_free (struct uio_pool_t *pool, void *ptr);
+unsigned long uio_pool_virt_to_phys (struct uio_pool_t *pool, void *ptr);
+void *uio_pool_phys_to_virt (struct uio_pool_t *pool, unsigned long phys);
+
+/* cache maintenance functions */
+int uio_cache_clean (struct uio_info_t* info, int map_num,
+		     unsigned long offset, size_t len);
+int uio_cache_invalidate (struct uio_info_t* info, int map_num,
+			  unsigned long offset, size_t len);
+int uio_cache_flush (struct uio_info_t* info, int map_num,
+		     unsigned long offset, size_t len);
+int uio_cache_line_size (void);
+
+/* descriptor ring functions */
+void uio_ring_attr_init (struct uio_ring_attr_t *attr);
+struct uio_ring_t *uio_ring_create (struct uio_info_t* info,
+				    const struct uio_ring_attr_t *attr);
+void uio_ring_destroy (struct uio_ring_t *ring);
+unsigned uio_ring_ready (struct uio_ring_t *ring);
+int uio_ring_enqueue (struct uio_ring_t *ring, const void *desc, unsigned n);
+int uio_ring_dequeue (struct uio_ring_t *ring, void *desc, unsigned n);
+int uio_ring_wait (struct uio_ring_t *ring, struct timeval *timeout);
+
+/* register watch functions */
+struct uio_watch_t *uio_watch_create (struct uio_info_t* info, int map_num,
+				      unsigned long offset, size_t size);
+void uio_watch_destroy (struct uio_watch_t *watch);
+int uio_watch_set_mask (struct uio_watch_t *watch, unsigned long offset,
+			size_t size, uint32_t mask);
+int uio_watch_sample (struct uio_watch_t *watch,
+		      struct uio_watch_change_t *changes, unsigned max);
+int uio_watch_sample_cb (struct uio_watch_t *watch, uio_watch_cb_t cb,
+			 void *arg);
+
+/* streaming capture functions */
+void uio_capture_attr_init (struct uio_capture_attr_t *attr);
+struct uio_capture_t *uio_capture_start (struct uio_info_t* info,
+					 const struct uio_capture_attr_t *attr,
+					 int fd);
+int uio_capture_get_stats (struct uio_capture_t *cap,
+			   struct uio_capture_stats_t *stats);
+int uio_capture_stop (struct uio_capture_t *cap,
+		      struct uio_capture_stats_t *stats);
+
+/* simulated device functions */
+struct uio_sim_t *uio_sim_create (const char *name, int nr,
+				  const size_t *sizes);
+struct uio_info_t *uio_sim_get_info (struct uio_sim_t *sim);
+int uio_sim_irq (struct uio_sim_t *sim);
+int uio_sim_irqs (struct uio_sim_t *sim, unsigned int nr);
+int uio_sim_irq_enabled (struct uio_sim_t *sim);
+void uio_sim_destroy (struct uio_sim_t *sim);
+
 /* irq functions */
 int uio_enable_irq (struct uio_info_t* info);
 int uio_disable_irq (struct uio_info_t* info);
 int uio_irqwait_timeout (struct uio_info_t* info, struct timeval *timeout);
+int uio_irq_pollfd (struct uio_info_t* info);
+int uio_irq_consume (struct uio_info_t* info, uint32_t *events);
 
 static inline int uio_irqwait (struct uio_info_t* info)
 {
 	return uio_irqwait_timeout (info, NULL);
 }
 
+/* irq service thread functions */
+void uio_irq_thread_attr_init (struct uio_irq_thread_attr_t *attr);
+struct uio_irq_thread_t *uio_irq_thread_create (struct uio_info_t **info,
+		int nr, const struct uio_irq_thread_attr_t *attr);
+int uio_irq_thread_destroy (struct uio_irq_thread_t *thread);
+int uio_irq_thread_poll (struct uio_irq_thread_t *thread,
+			 struct uio_irq_event_t *ev);
+int uio_irq_thread_wait (struct uio_irq_thread_t *thread,
+			 struct uio_irq_event_t *ev, struct timeval *timeout);
+int uio_irq_thread_get_fd (struct uio_irq_thread_t *thread);
+unsigned long uio_irq_thread_get_dropped (struct uio_irq_thread_t *thread);
+
+/* irq fan-out functions */
+struct uio_irq_sub_t *uio_irq_subscribe (struct uio_info_t* info);
+void uio_irq_unsubscribe (struct uio_irq_sub_t *sub);
+int uio_irq_sub_poll (struct uio_irq_sub_t *sub, struct uio_irq_event_t *ev,
+		      uint64_t *missed);
+int uio_irq_sub_wait (struct uio_irq_sub_t *sub, struct uio_irq_event_t *ev,
+		      uint64_t *missed, struct timeval *timeout);
+
+/* irq latency statistics functions */
+int uio_irq_stats_enable (struct uio_info_t *info);
+int uio_irq_stats_disable (struct uio_info_t *info);
+int uio_irq_stats_reset (struct uio_info_t *info);
+int uio_irq_stats_set_dev_timestamp (struct uio_info_t *info, int map_num,
+				     unsigned long latch, unsigned long counter,
+				     int width, uint64_t hz);
+void uio_irq_handler_begin (struct uio_info_t *info);
+void uio_irq_handler_end (struct uio_info_t *info);
+int uio_irq_stats_get (struct uio_info_t *info, enum uio_irq_stat_t which,
+		       struct uio_histogram_t *hist);
+uint64_t uio_histogram_percentile (const struct uio_histogram_t *hist,
+				   double percentile);
+char *uio_irq_stats_format (struct uio_info_t *info);
+
 #ifdef __cplusplus
 }
 #endif
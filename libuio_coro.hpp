@@ -0,0 +1,740 @@
+/*
+ * libuio - UserspaceIO helper library
+ *
+ * Copyright (C) 2011 Benedikt Spranger
+ * based on libUIO by Hans J. Koch
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA
+ */
+
+#ifndef LIBUIO_CORO_HPP
+#define LIBUIO_CORO_HPP
+
+/*
+ * C++20 coroutine layer for libuio (header only).
+ *
+ *	uio::scheduler sched;
+ *	uio::device dev (sched, info);
+ *
+ *	uio::task flow (uio::device &dev)
+ *	{
+ *		co_await dev.irq ();
+ *		if (!co_await dev.poll (0, STATUS, READY, READY, deadline))
+ *			...
+ *	}
+ *
+ *	flow (dev);
+ *	sched.run ();
+ *
+ * uio::attribute waits for sysfs_notify() changes of an attribute in
+ * the same epoll set, so one thread serves interrupts and attributes.
+ *
+ * The scheduler is single threaded and driven by one epoll set holding
+ * the pollable irq descriptors (uio_irq_pollfd()) and a timerfd for
+ * deadlines and register polling. Awaiters are stored in the coroutine
+ * frame and linked intrusively, and frames come from a per-thread pool,
+ * so awaiting does not allocate once the pool is warm.
+ */
+
+#include <cerrno>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <new>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <libuio.h>
+
+namespace uio {
+
+/* CLOCK_MONOTONIC, the clock used by the timerfd */
+using clock = std::chrono::steady_clock;
+
+class scheduler;
+class device;
+class attribute;
+
+namespace detail {
+
+[[noreturn]] inline void throw_errno (const char *what)
+{
+	throw std::system_error (errno, std::generic_category (), what);
+}
+
+/* per-thread free lists for coroutine frames, 64 bytes .. 8 KiB */
+class frame_pool {
+public:
+	static void *alloc (std::size_t size)
+	{
+		unsigned cls = size_class (size);
+
+		if (cls >= classes)
+			return ::operator new (size);
+
+		block *&head = lists () [cls];
+		if (head) {
+			block *b = head;
+			head = b->next;
+			return b;
+		}
+
+		return ::operator new (min_size << cls);
+	}
+
+	static void free (void *p, std::size_t size) noexcept
+	{
+		unsigned cls = size_class (size);
+
+		if (cls >= classes) {
+			::operator delete (p);
+			return;
+		}
+
+		block *b = static_cast<block *> (p);
+		b->next = lists () [cls];
+		lists () [cls] = b;
+	}
+
+private:
+	struct block {
+		block *next;
+	};
+
+	static constexpr unsigned classes = 8;
+	static constexpr std::size_t min_size = 64;
+
+	static unsigned size_class (std::size_t size)
+	{
+		unsigned cls = 0;
+
+		while (cls < classes && (min_size << cls) < size)
+			cls++;
+
+		return cls;
+	}
+
+	static block **lists ()
+	{
+		thread_local block *heads [classes];
+		return heads;
+	}
+};
+
+struct timer_node {
+	static constexpr std::size_t npos = ~std::size_t (0);
+
+	clock::time_point when;
+	std::size_t index = npos;
+	void (*expire) (void *owner) = nullptr;
+	void *owner = nullptr;
+};
+
+struct poll_node {
+	poll_node *prev = nullptr;
+	poll_node *next = nullptr;
+	void (*check) (void *owner) = nullptr;
+	void *owner = nullptr;
+};
+
+struct event_source {
+	virtual void on_ready (uint32_t events) = 0;
+
+protected:
+	~event_source () = default;
+};
+
+} /* namespace detail */
+
+/* fire and forget coroutine, started eagerly */
+struct task {
+	struct promise_type {
+		task get_return_object () noexcept { return {}; }
+		std::suspend_never initial_suspend () noexcept { return {}; }
+		std::suspend_never final_suspend () noexcept { return {}; }
+		void return_void () noexcept {}
+		void unhandled_exception () noexcept { std::terminate (); }
+
+		static void *operator new (std::size_t size)
+		{
+			return detail::frame_pool::alloc (size);
+		}
+
+		static void operator delete (void *p, std::size_t size) noexcept
+		{
+			detail::frame_pool::free (p, size);
+		}
+	};
+};
+
+class scheduler {
+public:
+	explicit scheduler (clock::duration poll_interval =
+			    std::chrono::microseconds (20))
+		: interval (poll_interval)
+	{
+		epfd = epoll_create1 (EPOLL_CLOEXEC);
+		if (epfd < 0)
+			detail::throw_errno ("epoll_create1");
+
+		tfd = timerfd_create (CLOCK_MONOTONIC,
+				      TFD_NONBLOCK | TFD_CLOEXEC);
+		if (tfd < 0) {
+			::close (epfd);
+			detail::throw_errno ("timerfd_create");
+		}
+
+		epoll_event ev {};
+		ev.events = EPOLLIN;
+		ev.data.ptr = nullptr;
+		if (epoll_ctl (epfd, EPOLL_CTL_ADD, tfd, &ev)) {
+			::close (tfd);
+			::close (epfd);
+			detail::throw_errno ("epoll_ctl");
+		}
+
+		timers.reserve (64);
+	}
+
+	scheduler (const scheduler &) = delete;
+	scheduler &operator= (const scheduler &) = delete;
+
+	~scheduler ()
+	{
+		::close (tfd);
+		::close (epfd);
+	}
+
+	/* run until stop() or until nothing waits anymore */
+	void run ()
+	{
+		epoll_event events [16];
+
+		stopped = false;
+		while (!stopped && (waiters || !timers.empty () || polls)) {
+			arm ();
+
+			int n = epoll_wait (epfd, events, 16, -1);
+			if (n < 0) {
+				if (errno == EINTR)
+					continue;
+				detail::throw_errno ("epoll_wait");
+			}
+
+			for (int i = 0; i < n; i++) {
+				auto *src = static_cast<detail::event_source *>
+					(events [i].data.ptr);
+
+				if (src) {
+					src->on_ready (events [i].events);
+				} else {
+					uint64_t exp;
+					if (::read (tfd, &exp, sizeof (exp)) < 0 &&
+					    errno != EAGAIN)
+						detail::throw_errno ("timerfd");
+				}
+			}
+
+			expire_timers ();
+			check_polls ();
+		}
+	}
+
+	void stop () noexcept { stopped = true; }
+
+	struct sleep_awaiter {
+		scheduler &sched;
+		detail::timer_node timer;
+		std::coroutine_handle<> handle;
+
+		bool await_ready () const noexcept
+		{
+			return timer.when <= clock::now ();
+		}
+
+		void await_suspend (std::coroutine_handle<> h)
+		{
+			handle = h;
+			timer.owner = this;
+			timer.expire = [] (void *owner) {
+				static_cast<sleep_awaiter *> (owner)->handle.resume ();
+			};
+			sched.add_timer (&timer);
+		}
+
+		void await_resume () const noexcept {}
+	};
+
+	sleep_awaiter sleep_until (clock::time_point when)
+	{
+		sleep_awaiter a { *this, {}, {} };
+		a.timer.when = when;
+		return a;
+	}
+
+	sleep_awaiter sleep_for (clock::duration d)
+	{
+		return sleep_until (clock::now () + d);
+	}
+
+	int epoll_fd () const noexcept { return epfd; }
+
+	void add_source (int fd, uint32_t events, detail::event_source *src)
+	{
+		epoll_event ev {};
+		ev.events = events;
+		ev.data.ptr = src;
+		if (epoll_ctl (epfd, EPOLL_CTL_ADD, fd, &ev))
+			detail::throw_errno ("epoll_ctl");
+	}
+
+	void remove_source (int fd) noexcept
+	{
+		epoll_ctl (epfd, EPOLL_CTL_DEL, fd, nullptr);
+	}
+
+	void add_timer (detail::timer_node *t)
+	{
+		t->index = timers.size ();
+		timers.push_back (t);
+		sift_up (t->index);
+	}
+
+	void remove_timer (detail::timer_node *t) noexcept
+	{
+		std::size_t i = t->index;
+
+		if (i == detail::timer_node::npos)
+			return;
+
+		t->index = detail::timer_node::npos;
+		if (i == timers.size () - 1) {
+			timers.pop_back ();
+			return;
+		}
+
+		timers [i] = timers.back ();
+		timers [i]->index = i;
+		timers.pop_back ();
+		sift_down (i);
+		sift_up (i);
+	}
+
+	void add_poll (detail::poll_node *p) noexcept
+	{
+		p->prev = nullptr;
+		p->next = polls;
+		if (polls)
+			polls->prev = p;
+		polls = p;
+	}
+
+	void remove_poll (detail::poll_node *p) noexcept
+	{
+		if (p->prev)
+			p->prev->next = p->next;
+		else if (polls == p)
+			polls = p->next;
+		if (p->next)
+			p->next->prev = p->prev;
+		p->prev = p->next = nullptr;
+	}
+
+private:
+	friend class device;
+	friend class attribute;
+
+	int epfd;
+	int tfd;
+	clock::duration interval;
+	std::vector<detail::timer_node *> timers;	/* binary min-heap */
+	detail::poll_node *polls = nullptr;
+	std::size_t waiters = 0;
+	bool stopped = false;
+
+	bool before (std::size_t a, std::size_t b) const noexcept
+	{
+		return timers [a]->when < timers [b]->when;
+	}
+
+	void swap_nodes (std::size_t a, std::size_t b) noexcept
+	{
+		std::swap (timers [a], timers [b]);
+		timers [a]->index = a;
+		timers [b]->index = b;
+	}
+
+	void sift_up (std::size_t i) noexcept
+	{
+		while (i && before (i, (i - 1) / 2)) {
+			swap_nodes (i, (i - 1) / 2);
+			i = (i - 1) / 2;
+		}
+	}
+
+	void sift_down (std::size_t i) noexcept
+	{
+		for (;;) {
+			std::size_t l = 2 * i + 1, r = l + 1, m = i;
+
+			if (l < timers.size () && before (l, m))
+				m = l;
+			if (r < timers.size () && before (r, m))
+				m = r;
+			if (m == i)
+				return;
+			swap_nodes (i, m);
+			i = m;
+		}
+	}
+
+	void arm ()
+	{
+		itimerspec its {};
+		clock::time_point next = clock::time_point::max ();
+
+		if (!timers.empty ())
+			next = timers.front ()->when;
+		if (polls && clock::now () + interval < next)
+			next = clock::now () + interval;
+
+		if (next != clock::time_point::max ()) {
+			auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>
+				(next.time_since_epoch ()).count ();
+			if (ns <= 0)
+				ns = 1;
+			its.it_value.tv_sec = ns / 1000000000;
+			its.it_value.tv_nsec = ns % 1000000000;
+		}
+
+		if (timerfd_settime (tfd, TFD_TIMER_ABSTIME, &its, nullptr))
+			detail::throw_errno ("timerfd_settime");
+	}
+
+	void expire_timers ()
+	{
+		auto now = clock::now ();
+
+		while (!timers.empty () && timers.front ()->when <= now) {
+			detail::timer_node *t = timers.front ();
+			remove_timer (t);
+			t->expire (t->owner);
+		}
+	}
+
+	void check_polls ()
+	{
+		detail::poll_node *p = polls, *next;
+
+		for (; p; p = next) {
+			next = p->next;
+			p->check (p->owner);
+		}
+	}
+};
+
+class device : private detail::event_source {
+public:
+	device (scheduler &s, struct uio_info_t *dev)
+		: sched (s), info (dev)
+	{
+		fd = uio_irq_pollfd (info);
+		if (fd < 0)
+			detail::throw_errno ("uio_irq_pollfd");
+		sched.add_source (fd, EPOLLIN, this);
+	}
+
+	device (const device &) = delete;
+	device &operator= (const device &) = delete;
+
+	~device ()
+	{
+		sched.remove_source (fd);
+	}
+
+	struct uio_info_t *get_info () const noexcept { return info; }
+
+	/* resumes with the number of interrupts, 0 on timeout */
+	struct irq_awaiter {
+		device &dev;
+		detail::timer_node timer;
+		std::coroutine_handle<> handle;
+		uint32_t events = 0;
+
+		bool await_ready ()
+		{
+			if (dev.pending) {
+				events = dev.pending;
+				dev.pending = 0;
+				return true;
+			}
+
+			int ret = uio_irq_consume (dev.info, &events);
+			if (ret < 0)
+				detail::throw_errno ("uio_irq_consume");
+
+			return ret == 1;
+		}
+
+		void await_suspend (std::coroutine_handle<> h)
+		{
+			handle = h;
+			dev.waiter = this;
+			dev.sched.waiters++;
+
+			if (timer.when != clock::time_point::max ()) {
+				timer.owner = this;
+				timer.expire = [] (void *owner) {
+					auto *self = static_cast<irq_awaiter *> (owner);
+					self->dev.waiter = nullptr;
+					self->dev.sched.waiters--;
+					self->events = 0;
+					self->handle.resume ();
+				};
+				dev.sched.add_timer (&timer);
+			}
+		}
+
+		uint32_t await_resume () const noexcept { return events; }
+	};
+
+	irq_awaiter irq (clock::time_point deadline = clock::time_point::max ())
+	{
+		irq_awaiter a { *this, {}, {} };
+		a.timer.when = deadline;
+		return a;
+	}
+
+	/* resumes with true once (reg & mask) == value, false on timeout */
+	struct poll_awaiter {
+		device &dev;
+		int map;
+		unsigned long offset;
+		uint32_t mask;
+		uint32_t value;
+		detail::poll_node node;
+		detail::timer_node timer;
+		std::coroutine_handle<> handle;
+		bool result = false;
+
+		bool test () const noexcept
+		{
+			uint32_t val;
+
+			if (uio_read32 (dev.info, map, offset, &val))
+				return false;
+
+			return (val & mask) == value;
+		}
+
+		bool await_ready () noexcept
+		{
+			result = test ();
+			return result || timer.when <= clock::now ();
+		}
+
+		void await_suspend (std::coroutine_handle<> h)
+		{
+			handle = h;
+			node.owner = this;
+			node.check = [] (void *owner) {
+				auto *self = static_cast<poll_awaiter *> (owner);
+				if (!self->test ())
+					return;
+				self->dev.sched.remove_poll (&self->node);
+				self->dev.sched.remove_timer (&self->timer);
+				self->result = true;
+				self->handle.resume ();
+			};
+			dev.sched.add_poll (&node);
+
+			if (timer.when != clock::time_point::max ()) {
+				timer.owner = this;
+				timer.expire = [] (void *owner) {
+					auto *self = static_cast<poll_awaiter *> (owner);
+					self->dev.sched.remove_poll (&self->node);
+					self->result = false;
+					self->handle.resume ();
+				};
+				dev.sched.add_timer (&timer);
+			}
+		}
+
+		bool await_resume () const noexcept { return result; }
+	};
+
+	poll_awaiter poll (int map, unsigned long offset, uint32_t mask,
+			   uint32_t value,
+			   clock::time_point deadline = clock::time_point::max ())
+	{
+		poll_awaiter a { *this, map, offset, mask, value, {}, {}, {} };
+		a.timer.when = deadline;
+		return a;
+	}
+
+	/* wait for any bit of mask to become set */
+	poll_awaiter poll (int map, unsigned long offset, uint32_t mask,
+			   clock::time_point deadline = clock::time_point::max ())
+	{
+		poll_awaiter a { *this, map, offset, mask, 0, {}, {}, {} };
+		a.timer.when = deadline;
+		a.value = mask;
+		return a;
+	}
+
+private:
+	scheduler &sched;
+	struct uio_info_t *info;
+	int fd;
+	irq_awaiter *waiter = nullptr;
+	uint32_t pending = 0;
+
+	void on_ready (uint32_t) override
+	{
+		uint32_t events;
+		int ret = uio_irq_consume (info, &events);
+
+		if (ret < 0)
+			detail::throw_errno ("uio_irq_consume");
+		if (ret == 0)
+			return;
+
+		if (!waiter) {
+			pending += events;
+			return;
+		}
+
+		irq_awaiter *w = waiter;
+		waiter = nullptr;
+		sched.waiters--;
+		sched.remove_timer (&w->timer);
+		w->events = events;
+		w->handle.resume ();
+	}
+};
+
+class attribute : private detail::event_source {
+public:
+	attribute (scheduler &s, struct uio_info_t *dev, const char *name)
+		: sched (s)
+	{
+		notify = uio_attr_notify_open (dev, name);
+		if (!notify)
+			detail::throw_errno ("uio_attr_notify_open");
+		fd = uio_attr_notify_get_fd (notify);
+		try {
+			/* sysfs keeps POLLPRI raised until the next read */
+			sched.add_source (fd, EPOLLPRI | EPOLLERR | EPOLLET, this);
+		} catch (...) {
+			uio_attr_notify_close (notify);
+			throw;
+		}
+	}
+
+	attribute (const attribute &) = delete;
+	attribute &operator= (const attribute &) = delete;
+
+	~attribute ()
+	{
+		sched.remove_source (fd);
+		uio_attr_notify_close (notify);
+	}
+
+	/* current content, re-arms the change notification */
+	ssize_t read (void *buf, std::size_t count)
+	{
+		return uio_attr_notify_read (notify, buf, count);
+	}
+
+	/* resumes with true on a change, false on timeout */
+	struct change_awaiter {
+		attribute &attr;
+		detail::timer_node timer;
+		std::coroutine_handle<> handle;
+		bool result = false;
+
+		bool await_ready () noexcept
+		{
+			if (attr.pending) {
+				attr.pending = false;
+				result = true;
+				return true;
+			}
+
+			return timer.when <= clock::now ();
+		}
+
+		void await_suspend (std::coroutine_handle<> h)
+		{
+			handle = h;
+			attr.waiter = this;
+			attr.sched.waiters++;
+
+			if (timer.when != clock::time_point::max ()) {
+				timer.owner = this;
+				timer.expire = [] (void *owner) {
+					auto *self = static_cast<change_awaiter *> (owner);
+					self->attr.waiter = nullptr;
+					self->attr.sched.waiters--;
+					self->result = false;
+					self->handle.resume ();
+				};
+				attr.sched.add_timer (&timer);
+			}
+		}
+
+		bool await_resume () const noexcept { return result; }
+	};
+
+	change_awaiter changed (clock::time_point deadline =
+				clock::time_point::max ())
+	{
+		change_awaiter a { *this, {}, {} };
+		a.timer.when = deadline;
+		return a;
+	}
+
+private:
+	scheduler &sched;
+	struct uio_attr_notify_t *notify;
+	int fd;
+	change_awaiter *waiter = nullptr;
+	bool pending = false;
+
+	void on_ready (uint32_t) override
+	{
+		if (!waiter) {
+			pending = true;
+			return;
+		}
+
+		change_awaiter *w = waiter;
+		waiter = nullptr;
+		sched.waiters--;
+		sched.remove_timer (&w->timer);
+		w->result = true;
+		w->handle.resume ();
+	}
+};
+
+} /* namespace uio */
+
+#endif /* LIBUIO_CORO_HPP */
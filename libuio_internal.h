@@ -22,6 +22,8 @@
 #ifndef LIBUIO_INTERNAL_H
 #define LIBUIO_INTERNAL_H
 
+#include <pthread.h>
+
 #include "libuio.h"
 
 #ifdef USE_GLIB
@@ -46,6 +48,8 @@ struct uio_map_t {
 	size_t offset;
 	char *name;
 	void *map;
+	void *slot;
+	int prot;
 };
 
 struct uio_info_t {
@@ -57,9 +61,192 @@ struct uio_info_t {
 	dev_t devid;
 	int maxmap;
 	int fd;
+	int flags;
+	struct uio_window_t *window;
+	int irqfd;
+	uint32_t irqcount;
+	struct uio_irqstat_t *irqstat;
+	struct uio_irq_bcast_t *bcast;
+	int refs;
+	struct uio_info_t *shared_next;
+	struct uio_attr_t *attrs;
+	struct uio_ctx_t *ctx;
+	struct uio_stats_page_t *stats;
+	char *stats_name;
+	struct uio_stats_map_t *stats_maps;
+	uint32_t trace_dev;
+};
+
+/* a mapped statistics page, unmapped by uio_free_info only */
+struct uio_stats_map_t {
+	struct uio_stats_map_t *next;
+	struct uio_stats_page_t *page;
+};
+
+struct uio_ctx_devname_t {
+	dev_t devid;
+	char *name;
+};
+
+struct uio_ctx_t {
+	const char *sysfs;
+	const char *dev;
+	void *(*alloc) (void *arg, size_t size);
+	void (*release) (void *arg, void *ptr);
+	void *alloc_arg;
+	uio_log_fn_t log;
+	void *log_arg;
+	pthread_mutex_t lock;
+	struct uio_ctx_devname_t *devnames;
+	size_t ndevnames;
+	int owned;
+};
+
+struct log_site_t {
+	unsigned long begin;
+	unsigned int count;
+	unsigned int missed;
 };
 
-struct uio_info_t* create_uio_info (char *dir, char* name);
-char *first_line_from_file (char *filename);
+extern int log_level;
+
+void log_emit (struct uio_ctx_t *ctx, int level, struct log_site_t *site,
+	       const char *fmt, ...)
+	__attribute__ ((format (printf, 4, 5)));
+
+/* every expansion owns its rate limit state */
+#define log_msg(ctx, level, ...)					\
+	do {								\
+		static struct log_site_t log_site;			\
+									\
+		if ((level) <= __atomic_load_n (&log_level,		\
+						__ATOMIC_RELAXED))	\
+			log_emit ((ctx), (level), &log_site,		\
+				  __VA_ARGS__);				\
+	} while (0)
+
+/* failures of the system or of resources */
+#define ctx_err(ctx, ...)	log_msg (ctx, UIO_LOG_ERR, __VA_ARGS__)
+/* invalid arguments and misuse */
+#define ctx_warn(ctx, ...)	log_msg (ctx, UIO_LOG_WARNING, __VA_ARGS__)
+/* expected failures with a fallback, e.g. optional sysfs files */
+#define ctx_dbg(ctx, ...)	log_msg (ctx, UIO_LOG_DEBUG, __VA_ARGS__)
+#define log_err(...)		ctx_err (NULL, __VA_ARGS__)
+#define log_warn(...)		ctx_warn (NULL, __VA_ARGS__)
+#define log_dbg(...)		ctx_dbg (NULL, __VA_ARGS__)
+
+/* messages on interrupt wait and acknowledge paths */
+#ifdef DISABLE_HOTPATH_LOG
+#define ctx_warn_hot(ctx, ...)						\
+	do {								\
+		if (0)							\
+			log_emit ((ctx), UIO_LOG_WARNING, NULL,		\
+				  __VA_ARGS__);				\
+	} while (0)
+#else
+#define ctx_warn_hot(ctx, ...)	ctx_warn (ctx, __VA_ARGS__)
+#endif
+
+static inline struct uio_ctx_t *info_ctx (struct uio_info_t *info)
+{
+	return info ? info->ctx : NULL;
+}
+
+static inline uint64_t timespec_to_ns (const struct timespec *ts)
+{
+	return (uint64_t) ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+/* ordering of device memory accesses against each other */
+#if defined(__x86_64__) || defined(__i386__)
+#define mmio_wmb()	__asm__ __volatile__ ("sfence" ::: "memory")
+#define mmio_rmb()	__asm__ __volatile__ ("lfence" ::: "memory")
+#define mmio_mb()	__asm__ __volatile__ ("mfence" ::: "memory")
+#elif defined(__aarch64__)
+#define mmio_wmb()	__asm__ __volatile__ ("dmb oshst" ::: "memory")
+#define mmio_rmb()	__asm__ __volatile__ ("dmb oshld" ::: "memory")
+#define mmio_mb()	__asm__ __volatile__ ("dmb osh" ::: "memory")
+#else
+#define mmio_wmb()	__sync_synchronize ()
+#define mmio_rmb()	__sync_synchronize ()
+#define mmio_mb()	__sync_synchronize ()
+#endif
+
+/* busy wait hint */
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax()	__asm__ __volatile__ ("pause" ::: "memory")
+#elif defined(__aarch64__)
+#define cpu_relax()	__asm__ __volatile__ ("yield" ::: "memory")
+#else
+#define cpu_relax()	__asm__ __volatile__ ("" ::: "memory")
+#endif
+
+struct uio_info_t* create_uio_info (struct uio_ctx_t *ctx, char *dir,
+				    char* name);
+struct uio_info_t *dup_uio_info (struct uio_info_t* info);
+void uio_free_info (struct uio_info_t* info);
+int map_device (struct uio_info_t* info, void *ptr, int flags);
+char *first_line_from_file (struct uio_ctx_t *ctx, char *filename);
+void attr_free_handles (struct uio_info_t* info);
+int attr_handle_fd (struct uio_attr_t *handle);
+struct uio_ctx_t *ctx_get (struct uio_ctx_t *ctx);
+void ctx_set_default_sysfs (const char *sysfs_mpoint);
+const char *ctx_sysfs_point (struct uio_ctx_t *ctx);
+const char *ctx_dev_root (struct uio_ctx_t *ctx);
+void *ctx_alloc (struct uio_ctx_t *ctx, size_t size);
+char *ctx_strdup (struct uio_ctx_t *ctx, const char *str);
+void ctx_free (struct uio_ctx_t *ctx, void *ptr);
+char *ctx_devname_lookup (struct uio_ctx_t *ctx, dev_t devid);
+void ctx_devname_store (struct uio_ctx_t *ctx, dev_t devid, const char *name);
+void stats_open (struct uio_info_t* info, int flags);
+void stats_release (struct uio_info_t* info);
+void stats_wait_done (struct uio_stats_page_t *stats,
+		      const struct timespec *start, int ret);
+void irqstat_wakeup (struct uio_info_t *info, const struct timespec *stamp);
+void bcast_publish (struct uio_irq_bcast_t *bcast, uint32_t count,
+		    const struct timespec *stamp);
+void irq_notify (struct uio_info_t* info, uint32_t count,
+		 const struct timespec *stamp);
+int futex_wait (int *addr, int val, const struct timespec *deadline);
+int futex_wake (int *addr);
+void timeval_to_deadline (const struct timeval *timeout,
+			  struct timespec *deadline);
+
+/* the published statistics page, NULL if none; stays mapped until free */
+static inline struct uio_stats_page_t *stats_get (struct uio_info_t* info)
+{
+	return __atomic_load_n (&info->stats, __ATOMIC_ACQUIRE);
+}
+
+/* bump a statistics page counter if the device publishes one */
+#define stats_inc(info, counter)					\
+	do {								\
+		struct uio_stats_page_t *__stats = stats_get (info);	\
+		if (__builtin_expect (__stats != NULL, 0))		\
+			__atomic_fetch_add (&__stats->counter, 1,	\
+					    __ATOMIC_RELAXED);		\
+	} while (0)
+
+extern int trace_enabled;
+
+void trace_record (struct uio_info_t* info, int map_num,
+		   unsigned long offset, int width, uint64_t value, int flags);
+
+/* record a register access while tracing is on */
+#define trace_access(info, map_num, offset, width, value, flags)	\
+	do {								\
+		if (__builtin_expect (__atomic_load_n (&trace_enabled,	\
+						       __ATOMIC_RELAXED), 0)) \
+			trace_record ((info), (map_num), (offset),	\
+				      (width), (value), (flags));	\
+	} while (0)
+
+static inline void irq_delivered (struct uio_info_t* info, uint32_t count,
+				  const struct timespec *stamp)
+{
+	stats_inc (info, irqs);
+	if (info->irqstat || info->bcast)
+		irq_notify (info, count, stamp);
+}
 
 #endif /* LIBUIO_INTERNAL_H */
@@ -0,0 +1,430 @@
+/*
+ * libuio - UserspaceIO helper library
+ *
+ * Copyright (C) 2011 Benedikt Spranger
+ * based on libUIO by Hans J. Koch
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA
+ */
+
+#define _GNU_SOURCE
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libuio_internal.h"
+
+/**
+ * @defgroup libuio_log libuio logging functions
+ * @ingroup libuio_public
+ * @brief public logging functions
+ *
+ * Library messages carry a level and pass three stages: a level
+ * threshold checked inline at the call site, a per call site rate
+ * limit (burst messages per interval, the number of suppressed ones is
+ * reported with the next message that gets through) and a sink.
+ *
+ * The sink is the log hook of the device's context if it has one,
+ * else the log ring if uio_log_ring_init() was called, else the
+ * handler set with uio_set_log_handler(), else stderr. The ring only
+ * formats into a preallocated slot, it never locks or enters the
+ * kernel, so real-time threads can log; another thread drains it with
+ * uio_log_drain().
+ *
+ * Configuring with --disable-hotpath-log removes the messages of the
+ * interrupt wait and acknowledge paths at compile time.
+ * @{
+ */
+
+#define LOG_MSG_SIZE	240
+
+struct log_cell_t {
+	unsigned long seq;
+	int level;
+	char msg [LOG_MSG_SIZE];
+};
+
+struct log_ring_t {
+	struct log_cell_t *cells;
+	unsigned long mask;
+	unsigned long dropped;
+
+	/* producer and consumer indices live on separate cache lines */
+	unsigned long head __attribute__ ((aligned (64)));
+	unsigned long tail __attribute__ ((aligned (64)));
+};
+
+int log_level = UIO_LOG_WARNING;
+
+static unsigned long log_interval = 5000000000UL;
+static unsigned int log_burst = 10;
+
+static uio_log_fn_t log_handler;
+static void *log_handler_arg;
+
+static struct log_ring_t *log_ring;
+
+static uint64_t log_now (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC_COARSE, &ts);
+
+	return timespec_to_ns (&ts);
+}
+
+/**
+ * apply the rate limit of a call site
+ * @param site call site state
+ * @param missed messages suppressed since the last one that got through
+ * @returns 1 if the message may be emitted, 0 if it is suppressed
+ */
+static int log_ratelimit (struct log_site_t *site, unsigned int *missed)
+{
+	unsigned long interval, begin, now;
+	unsigned int burst;
+
+	interval = __atomic_load_n (&log_interval, __ATOMIC_RELAXED);
+	burst = __atomic_load_n (&log_burst, __ATOMIC_RELAXED);
+	if (!interval || !burst)
+		return 1;
+
+	now = log_now ();
+	begin = __atomic_load_n (&site->begin, __ATOMIC_RELAXED);
+	if (!begin || now - begin >= interval)
+	{
+		/* one caller opens the new window */
+		if (__atomic_compare_exchange_n (&site->begin, &begin, now,
+						 0, __ATOMIC_RELAXED,
+						 __ATOMIC_RELAXED))
+			__atomic_store_n (&site->count, 0, __ATOMIC_RELAXED);
+	}
+
+	if (__atomic_fetch_add (&site->count, 1, __ATOMIC_RELAXED) >= burst)
+	{
+		__atomic_fetch_add (&site->missed, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+
+	*missed = __atomic_exchange_n (&site->missed, 0, __ATOMIC_RELAXED);
+
+	return 1;
+}
+
+static int ring_put (struct log_ring_t *ring, int level, const char *msg)
+{
+	struct log_cell_t *cell;
+	unsigned long pos, seq;
+	long diff;
+
+	pos = __atomic_load_n (&ring->head, __ATOMIC_RELAXED);
+	for (;;)
+	{
+		cell = &ring->cells [pos & ring->mask];
+		seq = __atomic_load_n (&cell->seq, __ATOMIC_ACQUIRE);
+		diff = (long) (seq - pos);
+
+		if (diff < 0)
+		{
+			__atomic_fetch_add (&ring->dropped, 1,
+					    __ATOMIC_RELAXED);
+			return -1;
+		}
+
+		if (diff > 0)
+		{
+			pos = __atomic_load_n (&ring->head, __ATOMIC_RELAXED);
+			continue;
+		}
+
+		if (__atomic_compare_exchange_n (&ring->head, &pos, pos + 1,
+						 1, __ATOMIC_RELAXED,
+						 __ATOMIC_RELAXED))
+			break;
+	}
+
+	cell->level = level;
+	strncpy (cell->msg, msg, LOG_MSG_SIZE - 1);
+	cell->msg [LOG_MSG_SIZE - 1] = '\0';
+	__atomic_store_n (&cell->seq, pos + 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+static int ring_get (struct log_ring_t *ring, int *level, char *msg)
+{
+	struct log_cell_t *cell;
+	unsigned long pos, seq;
+	long diff;
+
+	pos = __atomic_load_n (&ring->tail, __ATOMIC_RELAXED);
+	for (;;)
+	{
+		cell = &ring->cells [pos & ring->mask];
+		seq = __atomic_load_n (&cell->seq, __ATOMIC_ACQUIRE);
+		diff = (long) (seq - (pos + 1));
+
+		if (diff < 0)
+			return 0;
+
+		if (diff > 0)
+		{
+			pos = __atomic_load_n (&ring->tail, __ATOMIC_RELAXED);
+			continue;
+		}
+
+		if (__atomic_compare_exchange_n (&ring->tail, &pos, pos + 1,
+						 1, __ATOMIC_RELAXED,
+						 __ATOMIC_RELAXED))
+			break;
+	}
+
+	*level = cell->level;
+	memcpy (msg, cell->msg, LOG_MSG_SIZE);
+	__atomic_store_n (&cell->seq, pos + ring->mask + 1, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+static void log_stderr (int level, const char *msg)
+{
+	static const char *const prefix [] = {
+		"error", "warning", "info", "debug"
+	};
+	char line [LOG_MSG_SIZE + 32];
+	int len;
+
+	len = snprintf (line, sizeof (line), "libuio %s: %s\n",
+			prefix [level], msg);
+	if (len > (int) sizeof (line))
+		len = sizeof (line);
+	if (write (STDERR_FILENO, line, len) < 0)
+		return;
+}
+
+static void log_sink (struct uio_ctx_t *ctx, int level, const char *msg)
+{
+	struct log_ring_t *ring;
+	uio_log_fn_t handler;
+
+	ctx = ctx_get (ctx);
+	if (ctx->log)
+	{
+		ctx->log (ctx->log_arg, level, msg);
+		return;
+	}
+
+	ring = __atomic_load_n (&log_ring, __ATOMIC_ACQUIRE);
+	if (ring)
+	{
+		ring_put (ring, level, msg);
+		return;
+	}
+
+	handler = __atomic_load_n (&log_handler, __ATOMIC_ACQUIRE);
+	if (handler)
+		handler (__atomic_load_n (&log_handler_arg, __ATOMIC_RELAXED),
+			 level, msg);
+	else
+		log_stderr (level, msg);
+}
+
+/**
+ * emit a message, use the log macros of libuio_internal.h instead
+ * @param ctx library context or NULL
+ * @param level UIO_LOG_* level
+ * @param site call site state for rate limiting
+ * @param fmt printf format
+ */
+void log_emit (struct uio_ctx_t *ctx, int level, struct log_site_t *site,
+	       const char *fmt, ...)
+{
+	char msg [LOG_MSG_SIZE];
+	unsigned int missed = 0;
+	va_list ap;
+	int len;
+
+	if (!log_ratelimit (site, &missed))
+		return;
+
+	if (missed)
+	{
+		snprintf (msg, sizeof (msg), _("%u messages suppressed"),
+			  missed);
+		log_sink (ctx, level, msg);
+	}
+
+	va_start (ap, fmt);
+	len = vsnprintf (msg, sizeof (msg), fmt, ap);
+	va_end (ap);
+
+	if (len >= (int) sizeof (msg))
+		len = sizeof (msg) - 1;
+	while (len > 0 && msg [len - 1] == '\n')
+		msg [--len] = '\0';
+
+	log_sink (ctx, level, msg);
+}
+
+/**
+ * set the log level threshold
+ * @param level most verbose UIO_LOG_* level that is emitted
+ */
+void uio_set_log_level (int level)
+{
+	if (level < UIO_LOG_ERR)
+		level = UIO_LOG_ERR;
+	if (level > UIO_LOG_DEBUG)
+		level = UIO_LOG_DEBUG;
+
+	__atomic_store_n (&log_level, level, __ATOMIC_RELAXED);
+}
+
+/**
+ * get the log level threshold
+ * @returns most verbose UIO_LOG_* level that is emitted
+ */
+int uio_get_log_level (void)
+{
+	return __atomic_load_n (&log_level, __ATOMIC_RELAXED);
+}
+
+/**
+ * set the per call site rate limit
+ * @param interval_ms window length in milliseconds, 0 disables limiting
+ * @param burst messages per call site and window, 0 disables limiting
+ */
+void uio_set_log_ratelimit (unsigned int interval_ms, unsigned int burst)
+{
+	__atomic_store_n (&log_interval, interval_ms * 1000000UL,
+			  __ATOMIC_RELAXED);
+	__atomic_store_n (&log_burst, burst, __ATOMIC_RELAXED);
+}
+
+/**
+ * set the log handler
+ *
+ * The handler is called synchronously from the failing function unless
+ * a log ring is set up.
+ * @param fn handler or NULL for stderr
+ * @param arg handler argument
+ */
+void uio_set_log_handler (uio_log_fn_t fn, void *arg)
+{
+	__atomic_store_n (&log_handler_arg, arg, __ATOMIC_RELAXED);
+	__atomic_store_n (&log_handler, fn, __ATOMIC_RELEASE);
+}
+
+/**
+ * route messages into a lock-free ring
+ *
+ * From now on messages of contexts without a log hook are queued, not
+ * emitted. Messages that find the ring full are dropped and counted.
+ * The ring lives until the process exits.
+ * @param entries ring size, rounded up to a power of two
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_log_ring_init (unsigned int entries)
+{
+	struct log_ring_t *ring, *old = NULL;
+	unsigned long size = 1, i;
+
+	if (!entries)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	while (size < entries)
+		size <<= 1;
+
+	ring = calloc (1, sizeof (*ring));
+	if (ring)
+		ring->cells = calloc (size, sizeof (*ring->cells));
+	if (!ring || !ring->cells)
+	{
+		free (ring);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	for (i = 0; i < size; i++)
+		ring->cells [i].seq = i;
+	ring->mask = size - 1;
+
+	if (!__atomic_compare_exchange_n (&log_ring, &old, ring, 0,
+					  __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+	{
+		free (ring->cells);
+		free (ring);
+		errno = EBUSY;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * drain queued messages
+ * @param fn called for each message, NULL writes them to stderr
+ * @param arg argument for fn
+ * @returns number of messages drained or -1 on failure and errno is set
+ */
+int uio_log_drain (uio_log_fn_t fn, void *arg)
+{
+	struct log_ring_t *ring;
+	char msg [LOG_MSG_SIZE];
+	unsigned long dropped;
+	int level, nr = 0;
+
+	ring = __atomic_load_n (&log_ring, __ATOMIC_ACQUIRE);
+	if (!ring)
+	{
+		errno = ENODEV;
+		return -1;
+	}
+
+	while (ring_get (ring, &level, msg))
+	{
+		if (fn)
+			fn (arg, level, msg);
+		else
+			log_stderr (level, msg);
+		nr++;
+	}
+
+	dropped = __atomic_exchange_n (&ring->dropped, 0, __ATOMIC_RELAXED);
+	if (dropped)
+	{
+		snprintf (msg, sizeof (msg), _("%lu messages dropped"),
+			  dropped);
+		if (fn)
+			fn (arg, UIO_LOG_WARNING, msg);
+		else
+			log_stderr (UIO_LOG_WARNING, msg);
+	}
+
+	return nr;
+}
+
+/** @} */
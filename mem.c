@@ -41,6 +41,43 @@
  * @{
  */
 
+/**
+ * get address of a register, mapping the bar on first use if lazy
+ * @param info UIO device info struct
+ * @param map_num memory bar number
+ * @param offset register offset
+ * @param write non-zero for a write access
+ * @return register address or NULL on failure and errno is set, EACCES
+ *         for writes to a bar set read-only with uio_set_map_prot()
+ */
+static inline void *map_ptr (struct uio_info_t* info, int map_num,
+			     unsigned long offset, int write)
+{
+	struct uio_map_t *map = &info->maps [map_num];
+	void *base = __atomic_load_n (&map->map, __ATOMIC_RELAXED);
+
+	/* a read-only mapping would fault */
+	if (write && map->prot && !(map->prot & PROT_WRITE))
+	{
+		errno = EACCES;
+		return NULL;
+	}
+
+	if (base == MAP_FAILED)
+	{
+		if (!(info->flags & UIO_OPEN_LAZY))
+		{
+			errno = EINVAL;
+			return NULL;
+		}
+		if (uio_map_mem (info, map_num, 0))
+			return NULL;
+		base = map->map;
+	}
+
+	return base + map->offset + offset;
+}
+
 /**
  * get memory map size of UIO memory bar
  * @param info UIO device info struct
@@ -88,12 +125,16 @@ unsigned long uio_get_mem_addr (struct uio_info_t* info, int map_num)
  * @param info UIO device info struct
  * @param map_num memory bar number
  * @return UIO memory bar maped pointer or NULL on failure
+ *
+ * For devices opened with UIO_OPEN_LAZY the bar is mapped on first use.
  */
 void *uio_get_mem_map (struct uio_info_t* info, int map_num)
 {
-	if (!info ||
-	    map_num >= info->maxmap ||
-	    info->maps [map_num].map == MAP_FAILED)
+	if (!info || map_num < 0 || map_num >= info->maxmap)
+		return NULL;
+
+	if (info->maps [map_num].map == MAP_FAILED &&
+	    (!(info->flags & UIO_OPEN_LAZY) || uio_map_mem (info, map_num, 0)))
 		return NULL;
 
 	return info->maps [map_num].map;
@@ -168,10 +209,18 @@ int uio_read8 (struct uio_info_t* info, int map_num, unsigned long offset,
 	if (!info || !val)
 		return -1;
 
-	ptr = info->maps [map_num].map + info->maps [map_num].offset + offset;
+	ptr = map_ptr (info, map_num, offset, 0);
+	if (!ptr)
+	{
+		stats_inc (info, errors);
+		return -1;
+	}
 
 	*val = *(volatile uint8_t *) ptr;
 
+	stats_inc (info, reads);
+	trace_access (info, map_num, offset, 8, *val, 0);
+
 	return 0;
 }
 
@@ -191,10 +240,18 @@ int uio_read16 (struct uio_info_t* info, int map_num, unsigned long offset,
 	if (!info || !val)
 		return -1;
 
-	ptr = info->maps [map_num].map + info->maps [map_num].offset + offset;
+	ptr = map_ptr (info, map_num, offset, 0);
+	if (!ptr)
+	{
+		stats_inc (info, errors);
+		return -1;
+	}
 
 	*val = *(volatile uint16_t *) ptr;
 
+	stats_inc (info, reads);
+	trace_access (info, map_num, offset, 16, *val, 0);
+
 	return 0;
 }
 
@@ -214,10 +271,18 @@ int uio_read32 (struct uio_info_t* info, int map_num, unsigned long offset,
 	if (!info || !val)
 		return -1;
 
-	ptr = info->maps [map_num].map + info->maps [map_num].offset + offset;
+	ptr = map_ptr (info, map_num, offset, 0);
+	if (!ptr)
+	{
+		stats_inc (info, errors);
+		return -1;
+	}
 
 	*val = *(volatile uint32_t *) ptr;
 
+	stats_inc (info, reads);
+	trace_access (info, map_num, offset, 32, *val, 0);
+
 	return 0;
 }
 
@@ -237,10 +302,18 @@ int uio_read64 (struct uio_info_t* info, int map_num, unsigned long offset,
 	if (!info || !val)
 		return -1;
 
-	ptr = info->maps [map_num].map + info->maps [map_num].offset + offset;
+	ptr = map_ptr (info, map_num, offset, 0);
+	if (!ptr)
+	{
+		stats_inc (info, errors);
+		return -1;
+	}
 
 	*val = *(volatile uint64_t *) ptr;
 
+	stats_inc (info, reads);
+	trace_access (info, map_num, offset, 64, *val, 0);
+
 	return 0;
 }
 
@@ -260,10 +333,18 @@ int uio_write8 (struct uio_info_t* info, int map_num, unsigned long offset,
 	if (!info)
 		return -1;
 
-	ptr = info->maps [map_num].map + info->maps [map_num].offset + offset;
+	ptr = map_ptr (info, map_num, offset, 1);
+	if (!ptr)
+	{
+		stats_inc (info, errors);
+		return -1;
+	}
 
 	*(volatile uint8_t *) ptr = val;
 
+	stats_inc (info, writes);
+	trace_access (info, map_num, offset, 8, val, UIO_TRACE_WRITE);
+
 	return 0;
 }
 
@@ -283,10 +364,18 @@ int uio_write16 (struct uio_info_t* info, int map_num, unsigned long offset,
 	if (!info)
 		return -1;
 
-	ptr = info->maps [map_num].map + info->maps [map_num].offset + offset;
+	ptr = map_ptr (info, map_num, offset, 1);
+	if (!ptr)
+	{
+		stats_inc (info, errors);
+		return -1;
+	}
 
 	*(volatile uint16_t *) ptr = val;
 
+	stats_inc (info, writes);
+	trace_access (info, map_num, offset, 16, val, UIO_TRACE_WRITE);
+
 	return 0;
 }
 
@@ -306,10 +395,18 @@ int uio_write32 (struct uio_info_t* info, int map_num, unsigned long offset,
 	if (!info)
 		return -1;
 
-	ptr = info->maps [map_num].map + info->maps [map_num].offset + offset;
+	ptr = map_ptr (info, map_num, offset, 1);
+	if (!ptr)
+	{
+		stats_inc (info, errors);
+		return -1;
+	}
 
 	*(volatile uint32_t *) ptr = val;
 
+	stats_inc (info, writes);
+	trace_access (info, map_num, offset, 32, val, UIO_TRACE_WRITE);
+
 	return 0;
 }
 
@@ -329,10 +426,18 @@ int uio_write64 (struct uio_info_t* info, int map_num, unsigned long offset,
 	if (!info)
 		return -1;
 
-	ptr = info->maps [map_num].map + info->maps [map_num].offset + offset;
+	ptr = map_ptr (info, map_num, offset, 1);
+	if (!ptr)
+	{
+		stats_inc (info, errors);
+		return -1;
+	}
 
 	*(volatile uint64_t *) ptr = val;
 
+	stats_inc (info, writes);
+	trace_access (info, map_num, offset, 64, val, UIO_TRACE_WRITE);
+
 	return 0;
 }
 
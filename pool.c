@@ -0,0 +1,562 @@
+/*
+ * libuio - UserspaceIO helper library
+ *
+ * Copyright (C) 2011 Benedikt Spranger
+ * based on libUIO by Hans J. Koch
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/types.h>
+
+#include "libuio_internal.h"
+
+/**
+ * @defgroup libuio_pool libuio DMA buffer pool functions
+ * @ingroup libuio_public
+ * @brief public DMA buffer pool over a UIO memory bar
+ *
+ * A pool manages a range of a memory bar whose physical address is
+ * known (uio_dmem_genirq, reserved memory). The range is split into
+ * 4 KiB blocks handed out by a buddy allocator; requests up to 2 KiB
+ * come from slabs of power of two sized objects (64 bytes .. 2 KiB).
+ * Every allocation is aligned to the pool alignment and at least to a
+ * cache line. Slab objects are cached per thread, so the common alloc
+ * and free paths do not take the pool lock. All bookkeeping lives in
+ * normal memory from the context allocator of the device, the DMA
+ * memory itself is never written by the pool.
+ * @{
+ */
+
+#define BLOCK_SHIFT	12
+#define BLOCK_SIZE	(1UL << BLOCK_SHIFT)
+#define MIN_SHIFT	6
+#define CLASSES		(BLOCK_SHIFT - MIN_SHIFT)
+#define MAX_ORDER	32
+#define MAG_SIZE	32
+#define NO_BLOCK	UINT32_MAX
+
+enum {
+	BLK_TAIL,
+	BLK_FREE,
+	BLK_USED,
+	BLK_SLAB,
+};
+
+struct pool_class_t {
+	void **stack;
+	size_t top;
+	size_t cap;
+};
+
+struct uio_pool_t {
+	pthread_mutex_t lock;
+	struct uio_ctx_t *ctx;
+	uint64_t id;
+	char *virt;
+	unsigned long phys;
+	size_t size;
+	size_t align;
+	uint32_t nblocks;
+	uint8_t *state;
+	uint8_t *order;
+	uint32_t *next;
+	uint32_t *prev;
+	uint32_t freelist [MAX_ORDER];
+	struct pool_class_t cls [CLASSES];
+	struct uio_pool_t *live_next;
+};
+
+struct pool_mag_t {
+	int n;
+	void *obj [MAG_SIZE];
+};
+
+struct pool_tcache_t {
+	struct uio_pool_t *pool;
+	uint64_t id;
+	struct pool_mag_t mag [CLASSES];
+	struct pool_tcache_t *next;
+};
+
+static pthread_mutex_t live_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct uio_pool_t *live_pools;
+static uint64_t pool_ids;
+
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+static pthread_key_t tcache_key;
+static __thread struct pool_tcache_t *tcache_list;
+
+static int ilog2_up (size_t val)
+{
+	return val <= 1 ? 0 : 64 - __builtin_clzll (val - 1);
+}
+
+static void list_push (struct uio_pool_t *pool, uint32_t blk, int order)
+{
+	uint32_t head = pool->freelist [order];
+
+	pool->state [blk] = BLK_FREE;
+	pool->order [blk] = order;
+	pool->prev [blk] = NO_BLOCK;
+	pool->next [blk] = head;
+	if (head != NO_BLOCK)
+		pool->prev [head] = blk;
+	pool->freelist [order] = blk;
+}
+
+static void list_del (struct uio_pool_t *pool, uint32_t blk)
+{
+	int order = pool->order [blk];
+
+	if (pool->prev [blk] != NO_BLOCK)
+		pool->next [pool->prev [blk]] = pool->next [blk];
+	else
+		pool->freelist [order] = pool->next [blk];
+	if (pool->next [blk] != NO_BLOCK)
+		pool->prev [pool->next [blk]] = pool->prev [blk];
+	pool->state [blk] = BLK_TAIL;
+}
+
+/* called with pool->lock held */
+static uint32_t buddy_alloc (struct uio_pool_t *pool, int order, int state)
+{
+	uint32_t blk;
+	int o;
+
+	for (o = order; o < MAX_ORDER; o++)
+		if (pool->freelist [o] != NO_BLOCK)
+			break;
+	if (o == MAX_ORDER)
+		return NO_BLOCK;
+
+	blk = pool->freelist [o];
+	list_del (pool, blk);
+
+	while (o > order)
+	{
+		o--;
+		list_push (pool, blk + (1U << o), o);
+	}
+
+	pool->state [blk] = state;
+	pool->order [blk] = order;
+
+	return blk;
+}
+
+/* called with pool->lock held */
+static void buddy_free (struct uio_pool_t *pool, uint32_t blk)
+{
+	int order = pool->order [blk];
+	uint32_t buddy;
+
+	while (order < MAX_ORDER - 1)
+	{
+		buddy = blk ^ (1U << order);
+		if (buddy >= pool->nblocks || pool->state [buddy] != BLK_FREE ||
+		    pool->order [buddy] != order)
+			break;
+
+		list_del (pool, buddy);
+		pool->state [blk] = BLK_TAIL;
+		if (buddy < blk)
+			blk = buddy;
+		order++;
+	}
+
+	list_push (pool, blk, order);
+}
+
+/* called with pool->lock held */
+static int slab_grow (struct uio_pool_t *pool, int cls)
+{
+	struct pool_class_t *c = &pool->cls [cls];
+	size_t objsize = 1UL << (cls + MIN_SHIFT), n, i;
+	void **stack;
+	uint32_t blk;
+	char *base;
+
+	n = BLOCK_SIZE / objsize;
+	if (c->top + n > c->cap)
+	{
+		stack = ctx_alloc (pool->ctx,
+				   (c->cap + n) * 2 * sizeof (void *));
+		if (!stack)
+			return -1;
+		if (c->top)
+			memcpy (stack, c->stack, c->top * sizeof (void *));
+		ctx_free (pool->ctx, c->stack);
+		c->stack = stack;
+		c->cap = (c->cap + n) * 2;
+	}
+
+	blk = buddy_alloc (pool, 0, BLK_SLAB);
+	if (blk == NO_BLOCK)
+		return -1;
+	pool->order [blk] = cls;
+
+	base = pool->virt + ((size_t) blk << BLOCK_SHIFT);
+	for (i = n; i > 0; i--)
+		c->stack [c->top++] = base + (i - 1) * objsize;
+
+	return 0;
+}
+
+static void tcache_flush (struct uio_pool_t *pool, struct pool_mag_t *mag,
+			  int cls, int keep)
+{
+	struct pool_class_t *c = &pool->cls [cls];
+
+	pthread_mutex_lock (&pool->lock);
+	/* the stack always has room for every object of a grown slab */
+	while (mag->n > keep)
+		c->stack [c->top++] = mag->obj [--mag->n];
+	pthread_mutex_unlock (&pool->lock);
+}
+
+static void tcache_destroy (void *arg)
+{
+	struct pool_tcache_t *tc = arg, *next;
+	struct uio_pool_t *pool;
+	int i;
+
+	pthread_mutex_lock (&live_lock);
+	for (; tc; tc = next)
+	{
+		next = tc->next;
+		for (pool = live_pools; pool; pool = pool->live_next)
+			if (pool == tc->pool && pool->id == tc->id)
+				break;
+		if (pool)
+			for (i = 0; i < CLASSES; i++)
+				tcache_flush (pool, &tc->mag [i], i, 0);
+		free (tc);
+	}
+	pthread_mutex_unlock (&live_lock);
+}
+
+static void tcache_init (void)
+{
+	pthread_key_create (&tcache_key, tcache_destroy);
+}
+
+static struct pool_tcache_t *tcache_get (struct uio_pool_t *pool)
+{
+	struct pool_tcache_t *tc;
+
+	for (tc = tcache_list; tc; tc = tc->next)
+		if (tc->pool == pool && tc->id == pool->id)
+			return tc;
+
+	tc = calloc (1, sizeof (*tc));
+	if (!tc)
+		return NULL;
+
+	pthread_once (&tcache_once, tcache_init);
+	tc->pool = pool;
+	tc->id = pool->id;
+	tc->next = tcache_list;
+	tcache_list = tc;
+	pthread_setspecific (tcache_key, tcache_list);
+
+	return tc;
+}
+
+/**
+ * create a DMA buffer pool on a memory bar
+ * @param info opened UIO device info struct
+ * @param map_num memory bar number
+ * @param offset start of the pool within the bar
+ * @param size pool size in bytes
+ * @param align minimum alignment of every allocation (power of two)
+ * @returns pool or NULL on failure and errno is set
+ */
+struct uio_pool_t *uio_pool_create (struct uio_info_t* info, int map_num,
+				    size_t offset, size_t size, size_t align)
+{
+	struct uio_pool_t *pool;
+	unsigned long phys, start;
+	uint32_t i;
+	char *map;
+	int o;
+
+	if (align < (1UL << MIN_SHIFT))
+		align = 1UL << MIN_SHIFT;
+
+	if (!info || map_num < 0 || map_num >= info->maxmap ||
+	    (align & (align - 1)) || offset + size < offset ||
+	    offset + size > info->maps [map_num].size)
+	{
+		errno = EINVAL;
+		ctx_warn (info_ctx (info), _("%s: %s"), __func__,
+			  g_strerror (errno));
+		return NULL;
+	}
+
+	map = uio_get_mem_map (info, map_num);
+	if (!map)
+		return NULL;
+
+	/* start on a physical boundary of at least one block */
+	phys = info->maps [map_num].addr + offset;
+	start = (phys + (align > BLOCK_SIZE ? align : BLOCK_SIZE) - 1) &
+		~((align > BLOCK_SIZE ? align : BLOCK_SIZE) - 1);
+	if (start - phys >= size || (size - (start - phys)) < BLOCK_SIZE)
+	{
+		errno = ENOSPC;
+		ctx_warn (info_ctx (info), _("%s: %s"), __func__,
+			  g_strerror (errno));
+		return NULL;
+	}
+	size = (size - (start - phys)) & ~(BLOCK_SIZE - 1);
+
+	pool = ctx_alloc (info->ctx, sizeof (*pool));
+	if (!pool)
+		goto err_nomem;
+	pool->ctx = info->ctx;
+
+	pool->virt = map + info->maps [map_num].offset + offset + (start - phys);
+	pool->phys = start;
+	pool->size = size;
+	pool->align = align;
+	pool->nblocks = size >> BLOCK_SHIFT;
+	pool->state = ctx_alloc (pool->ctx, pool->nblocks);
+	pool->order = ctx_alloc (pool->ctx, pool->nblocks);
+	pool->next = ctx_alloc (pool->ctx, pool->nblocks * sizeof (uint32_t));
+	pool->prev = ctx_alloc (pool->ctx, pool->nblocks * sizeof (uint32_t));
+	if (!pool->state || !pool->order || !pool->next || !pool->prev)
+		goto err_free;
+
+	for (o = 0; o < MAX_ORDER; o++)
+		pool->freelist [o] = NO_BLOCK;
+
+	/* carve the range into naturally aligned maximal blocks */
+	for (i = 0; i < pool->nblocks; i += 1U << o)
+	{
+		for (o = MAX_ORDER - 1; o > 0; o--)
+			if (!(i & ((1U << o) - 1)) &&
+			    (uint64_t) i + (1U << o) <= pool->nblocks)
+				break;
+		list_push (pool, i, o);
+	}
+
+	pthread_mutex_init (&pool->lock, NULL);
+
+	pthread_mutex_lock (&live_lock);
+	pool->id = ++pool_ids;
+	pool->live_next = live_pools;
+	live_pools = pool;
+	pthread_mutex_unlock (&live_lock);
+
+	return pool;
+
+err_free:
+	ctx_free (pool->ctx, pool->state);
+	ctx_free (pool->ctx, pool->order);
+	ctx_free (pool->ctx, pool->next);
+	ctx_free (pool->ctx, pool->prev);
+	ctx_free (pool->ctx, pool);
+err_nomem:
+	errno = ENOMEM;
+	ctx_err (info_ctx (info), _("%s: %s"), __func__, g_strerror (errno));
+
+	return NULL;
+}
+
+/**
+ * destroy a DMA buffer pool
+ *
+ * All buffers of the pool become invalid. Must not race with
+ * allocations from other threads.
+ * @param pool DMA buffer pool
+ */
+void uio_pool_destroy (struct uio_pool_t *pool)
+{
+	struct uio_pool_t **pos;
+	int i;
+
+	if (!pool)
+		return;
+
+	pthread_mutex_lock (&live_lock);
+	for (pos = &live_pools; *pos && *pos != pool; pos = &(*pos)->live_next);
+	if (*pos)
+		*pos = pool->live_next;
+	pthread_mutex_unlock (&live_lock);
+
+	for (i = 0; i < CLASSES; i++)
+		ctx_free (pool->ctx, pool->cls [i].stack);
+	pthread_mutex_destroy (&pool->lock);
+	ctx_free (pool->ctx, pool->state);
+	ctx_free (pool->ctx, pool->order);
+	ctx_free (pool->ctx, pool->next);
+	ctx_free (pool->ctx, pool->prev);
+	ctx_free (pool->ctx, pool);
+}
+
+/**
+ * allocate a DMA buffer
+ * @param pool DMA buffer pool
+ * @param size buffer size in bytes
+ * @returns buffer or NULL on failure and errno is set
+ */
+void *uio_pool_alloc (struct uio_pool_t *pool, size_t size)
+{
+	struct pool_tcache_t *tc;
+	struct pool_class_t *c;
+	struct pool_mag_t *mag;
+	uint32_t blk;
+	int cls;
+
+	if (!pool || !size)
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if (size < pool->align)
+		size = pool->align;
+
+	if (size > BLOCK_SIZE / 2)
+	{
+		pthread_mutex_lock (&pool->lock);
+		blk = buddy_alloc (pool, ilog2_up ((size + BLOCK_SIZE - 1) >>
+						   BLOCK_SHIFT), BLK_USED);
+		pthread_mutex_unlock (&pool->lock);
+		if (blk == NO_BLOCK)
+		{
+			errno = ENOMEM;
+			return NULL;
+		}
+
+		return pool->virt + ((size_t) blk << BLOCK_SHIFT);
+	}
+
+	cls = ilog2_up (size) - MIN_SHIFT;
+	if (cls < 0)
+		cls = 0;
+
+	tc = tcache_get (pool);
+	if (!tc)
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	mag = &tc->mag [cls];
+	if (!mag->n)
+	{
+		c = &pool->cls [cls];
+		pthread_mutex_lock (&pool->lock);
+		if (!c->top)
+			slab_grow (pool, cls);
+		while (c->top && mag->n < MAG_SIZE / 2)
+			mag->obj [mag->n++] = c->stack [--c->top];
+		pthread_mutex_unlock (&pool->lock);
+
+		if (!mag->n)
+		{
+			errno = ENOMEM;
+			return NULL;
+		}
+	}
+
+	return mag->obj [--mag->n];
+}
+
+/**
+ * free a DMA buffer
+ * @param pool DMA buffer pool
+ * @param ptr buffer returned by uio_pool_alloc()
+ */
+void uio_pool_free (struct uio_pool_t *pool, void *ptr)
+{
+	struct pool_tcache_t *tc;
+	struct pool_mag_t *mag;
+	uint32_t blk;
+	int cls;
+
+	if (!pool || !ptr || (char *) ptr < pool->virt ||
+	    (char *) ptr >= pool->virt + pool->size)
+		return;
+
+	blk = ((char *) ptr - pool->virt) >> BLOCK_SHIFT;
+
+	if (__atomic_load_n (&pool->state [blk], __ATOMIC_RELAXED) != BLK_SLAB)
+	{
+		pthread_mutex_lock (&pool->lock);
+		if (pool->state [blk] == BLK_USED)
+			buddy_free (pool, blk);
+		pthread_mutex_unlock (&pool->lock);
+		return;
+	}
+
+	cls = pool->order [blk];
+	tc = tcache_get (pool);
+	if (!tc)
+	{
+		/* no cache, hand it back directly */
+		pthread_mutex_lock (&pool->lock);
+		pool->cls [cls].stack [pool->cls [cls].top++] = ptr;
+		pthread_mutex_unlock (&pool->lock);
+		return;
+	}
+
+	mag = &tc->mag [cls];
+	if (mag->n == MAG_SIZE)
+		tcache_flush (pool, mag, cls, MAG_SIZE / 2);
+	mag->obj [mag->n++] = ptr;
+}
+
+/**
+ * translate a pool address to its physical (bus) address
+ * @param pool DMA buffer pool
+ * @param ptr address inside the pool
+ * @returns physical address or 0 if ptr is outside the pool
+ */
+unsigned long uio_pool_virt_to_phys (struct uio_pool_t *pool, void *ptr)
+{
+	if (!pool || (char *) ptr < pool->virt ||
+	    (char *) ptr >= pool->virt + pool->size)
+		return 0;
+
+	return pool->phys + ((char *) ptr - pool->virt);
+}
+
+/**
+ * translate a physical (bus) address to its pool address
+ * @param pool DMA buffer pool
+ * @param phys physical address inside the pool
+ * @returns pool address or NULL if phys is outside the pool
+ */
+void *uio_pool_phys_to_virt (struct uio_pool_t *pool, unsigned long phys)
+{
+	if (!pool || phys < pool->phys || phys - pool->phys >= pool->size)
+		return NULL;
+
+	return pool->virt + (phys - pool->phys);
+}
+
+/** @} */
@@ -0,0 +1,320 @@
+/*
+ * libuio - UserspaceIO helper library
+ *
+ * Copyright (C) 2011 Benedikt Spranger
+ * based on libUIO by Hans J. Koch
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libuio_internal.h"
+
+/**
+ * @defgroup libuio_ring libuio descriptor ring functions
+ * @ingroup libuio_public
+ * @brief public descriptor ring functions
+ *
+ * A descriptor ring is an array of fixed size descriptors in a memory
+ * bar plus a head (producer) and a tail (consumer) index register.
+ * Both indices run from 0 to entries - 1, one slot is kept empty to
+ * tell a full ring from an empty one. The library side owns one of the
+ * indices, the device the other. The own index is shadowed in memory
+ * and the device index is cached, so the device register is only read
+ * when the ring looks full (producer) or empty (consumer). A ring must
+ * be driven by one thread at a time.
+ * @{
+ */
+
+struct uio_ring_t {
+	struct uio_info_t *info;
+	volatile uint32_t *desc;
+	volatile uint32_t *head_reg;
+	volatile uint32_t *tail_reg;
+	uint32_t words;
+	uint32_t mask;
+	uint32_t own;
+	uint32_t peer;
+	int role;
+	int flags;
+};
+
+/**
+ * initialize descriptor ring attributes with defaults
+ * @param attr ring attributes
+ */
+void uio_ring_attr_init (struct uio_ring_attr_t *attr)
+{
+	memset (attr, 0, sizeof (*attr));
+	attr->desc_size = 16;
+	attr->entries = 256;
+	attr->role = UIO_RING_PRODUCER;
+}
+
+/**
+ * attach to a descriptor ring in a memory bar
+ * @param info opened UIO device info struct
+ * @param attr ring layout and role
+ * @returns ring or NULL on failure and errno is set
+ */
+struct uio_ring_t *uio_ring_create (struct uio_info_t* info,
+				    const struct uio_ring_attr_t *attr)
+{
+	struct uio_ring_t *ring;
+	char *desc, *regs;
+
+	if (!info || !attr || !attr->entries ||
+	    (attr->entries & (attr->entries - 1)) ||
+	    !attr->desc_size || (attr->desc_size & 3) ||
+	    (attr->head_reg & 3) || (attr->tail_reg & 3) ||
+	    (attr->desc_offset & 3) ||
+	    (attr->role != UIO_RING_PRODUCER &&
+	     attr->role != UIO_RING_CONSUMER) ||
+	    attr->desc_map < 0 || attr->desc_map >= info->maxmap ||
+	    attr->reg_map < 0 || attr->reg_map >= info->maxmap ||
+	    attr->desc_offset + (size_t) attr->entries * attr->desc_size >
+	    info->maps [attr->desc_map].size ||
+	    attr->head_reg + 4 > info->maps [attr->reg_map].size ||
+	    attr->tail_reg + 4 > info->maps [attr->reg_map].size)
+	{
+		errno = EINVAL;
+		ctx_warn (info_ctx (info), _("%s: %s"), __func__,
+			  g_strerror (errno));
+		return NULL;
+	}
+
+	desc = uio_get_mem_map (info, attr->desc_map);
+	regs = uio_get_mem_map (info, attr->reg_map);
+	if (!desc || !regs)
+		return NULL;
+
+	ring = calloc (1, sizeof (*ring));
+	if (!ring)
+	{
+		errno = ENOMEM;
+		ctx_err (info_ctx (info), _("%s: %s"), __func__,
+			 g_strerror (errno));
+		return NULL;
+	}
+
+	ring->info = info;
+	ring->desc = (void *) (desc + info->maps [attr->desc_map].offset +
+			       attr->desc_offset);
+	regs += info->maps [attr->reg_map].offset;
+	ring->head_reg = (void *) (regs + attr->head_reg);
+	ring->tail_reg = (void *) (regs + attr->tail_reg);
+	ring->words = attr->desc_size / 4;
+	ring->mask = attr->entries - 1;
+	ring->role = attr->role;
+	ring->flags = attr->flags;
+
+	/* pick up where the device currently is */
+	if (ring->role == UIO_RING_PRODUCER)
+	{
+		ring->own = *ring->head_reg & ring->mask;
+		ring->peer = *ring->tail_reg & ring->mask;
+	}
+	else
+	{
+		ring->own = *ring->tail_reg & ring->mask;
+		ring->peer = *ring->head_reg & ring->mask;
+	}
+	mmio_rmb ();
+
+	return ring;
+}
+
+/**
+ * detach from a descriptor ring
+ * @param ring descriptor ring
+ */
+void uio_ring_destroy (struct uio_ring_t *ring)
+{
+	free (ring);
+}
+
+static inline uint32_t ring_ready (struct uio_ring_t *ring)
+{
+	if (ring->role == UIO_RING_PRODUCER)
+		return (ring->peer - ring->own - 1) & ring->mask;
+
+	return (ring->peer - ring->own) & ring->mask;
+}
+
+static inline void ring_refresh (struct uio_ring_t *ring)
+{
+	if (ring->role == UIO_RING_PRODUCER)
+		ring->peer = *ring->tail_reg & ring->mask;
+	else
+		ring->peer = *ring->head_reg & ring->mask;
+
+	/* descriptor accesses must not pass the index read */
+	mmio_rmb ();
+}
+
+/**
+ * get number of free (producer) or filled (consumer) descriptors
+ * @param ring descriptor ring
+ * @returns number of descriptors ready for the own role
+ */
+unsigned uio_ring_ready (struct uio_ring_t *ring)
+{
+	ring_refresh (ring);
+
+	return ring_ready (ring);
+}
+
+/**
+ * put descriptors on a producer ring
+ * @param ring producer descriptor ring
+ * @param desc descriptors, n * desc_size bytes
+ * @param n number of descriptors
+ * @returns number of descriptors queued (may be less than n) or -1 on
+ *	failure and errno is set
+ */
+int uio_ring_enqueue (struct uio_ring_t *ring, const void *desc, unsigned n)
+{
+	const uint32_t *src = desc;
+	volatile uint32_t *dst;
+	uint32_t i, w, room;
+
+	if (!ring || ring->role != UIO_RING_PRODUCER || (n && !desc))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	room = ring_ready (ring);
+	if (room < n)
+	{
+		ring_refresh (ring);
+		room = ring_ready (ring);
+	}
+	if (n > room)
+		n = room;
+	if (!n)
+		return 0;
+
+	for (i = 0; i < n; i++)
+	{
+		dst = ring->desc + ((ring->own + i) & ring->mask) * ring->words;
+		for (w = 0; w < ring->words; w++)
+			dst [w] = *src++;
+	}
+
+	/* descriptors must be visible before the device sees the index */
+	mmio_wmb ();
+	ring->own = (ring->own + n) & ring->mask;
+	*ring->head_reg = ring->own;
+
+	return n;
+}
+
+/**
+ * take descriptors from a consumer ring
+ * @param ring consumer descriptor ring
+ * @param desc buffer for up to n * desc_size bytes
+ * @param n maximum number of descriptors
+ * @returns number of descriptors taken (0 if empty) or -1 on failure
+ *	and errno is set
+ */
+int uio_ring_dequeue (struct uio_ring_t *ring, void *desc, unsigned n)
+{
+	volatile uint32_t *src;
+	uint32_t *dst = desc;
+	uint32_t i, w, avail;
+
+	if (!ring || ring->role != UIO_RING_CONSUMER || (n && !desc))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	avail = ring_ready (ring);
+	if (avail < n)
+	{
+		ring_refresh (ring);
+		avail = ring_ready (ring);
+	}
+	if (n > avail)
+		n = avail;
+	if (!n)
+		return 0;
+
+	for (i = 0; i < n; i++)
+	{
+		src = ring->desc + ((ring->own + i) & ring->mask) * ring->words;
+		for (w = 0; w < ring->words; w++)
+			*dst++ = src [w];
+	}
+
+	/* descriptor reads must complete before the slots are handed back */
+	mmio_mb ();
+	ring->own = (ring->own + n) & ring->mask;
+	*ring->tail_reg = ring->own;
+
+	return n;
+}
+
+/**
+ * wait until a ring has free (producer) or filled (consumer) descriptors
+ *
+ * Only for rings created with UIO_RING_IRQ: the device interrupt is
+ * re-enabled, the ring is checked once more to close the race with an
+ * event that arrived in between, then the UIO file descriptor is
+ * waited on.
+ * @param ring descriptor ring
+ * @param timeout timeout or NULL to wait forever
+ * @returns number of descriptors ready or -1 on failure and errno is set
+ */
+int uio_ring_wait (struct uio_ring_t *ring, struct timeval *timeout)
+{
+	uint32_t ready;
+
+	if (!ring || !(ring->flags & UIO_RING_IRQ))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (;;)
+	{
+		ready = ring_ready (ring);
+		if (ready)
+			return ready;
+
+		/* irqcontrol is optional, a failing enable is not fatal */
+		uio_enable_irq (ring->info);
+
+		ring_refresh (ring);
+		ready = ring_ready (ring);
+		if (ready)
+			return ready;
+
+		if (uio_irqwait_timeout (ring->info, timeout))
+			return -1;
+
+		ring_refresh (ring);
+	}
+}
+
+/** @} */
@@ -0,0 +1,211 @@
+/*
+ * libuio - UserspaceIO helper library
+ *
+ * Copyright (C) 2011 Benedikt Spranger
+ * based on libUIO by Hans J. Koch
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/mman.h>
+#include <sys/types.h>
+
+#include "libuio_internal.h"
+
+/**
+ * @defgroup libuio_share libuio shared handle functions
+ * @ingroup libuio_public
+ * @brief public reference counted device handles
+ *
+ * Subsystems of one process that open the same device through
+ * uio_open_shared() get the same handle, i.e. one file descriptor and
+ * one set of mappings. The handle is owned by the library and released
+ * when the last user calls uio_close_shared().
+ * @{
+ */
+
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct uio_info_t *shared_list;
+
+/**
+ * duplicate a UIO device info struct (without open state)
+ * @param info UIO device info struct
+ * @returns copy or NULL on failure
+ */
+struct uio_info_t *dup_uio_info (struct uio_info_t* info)
+{
+	struct uio_info_t *copy;
+	int i;
+
+	copy = ctx_alloc (info->ctx, sizeof (*copy));
+	if (!copy)
+		goto err_nomem;
+	copy->ctx = info->ctx;
+
+	copy->path = ctx_strdup (info->ctx, info->path);
+	copy->name = ctx_strdup (info->ctx, info->name);
+	copy->version = ctx_strdup (info->ctx, info->version);
+	copy->devname = ctx_strdup (info->ctx, info->devname);
+	copy->devid = info->devid;
+	copy->fd = -1;
+	copy->irqfd = -1;
+
+	if (info->maxmap)
+	{
+		copy->maps = ctx_alloc (info->ctx,
+				       info->maxmap * sizeof (*copy->maps));
+		if (!copy->maps)
+			goto err_free;
+
+		for (i = 0; i < info->maxmap; i++)
+		{
+			copy->maps [i].addr = info->maps [i].addr;
+			copy->maps [i].size = info->maps [i].size;
+			copy->maps [i].offset = info->maps [i].offset;
+			copy->maps [i].prot = info->maps [i].prot;
+			copy->maps [i].name = ctx_strdup (info->ctx,
+							   info->maps [i].name);
+			copy->maps [i].map = MAP_FAILED;
+		}
+		copy->maxmap = info->maxmap;
+	}
+
+	return copy;
+
+err_free:
+	uio_free_info (copy);
+err_nomem:
+	errno = ENOMEM;
+	ctx_err (info_ctx (info), _("%s: %s"), __func__, g_strerror (errno));
+
+	return NULL;
+}
+
+/**
+ * open a UIO device as a shared, reference counted handle
+ *
+ * Opens are deduplicated by context and device id; contexts with
+ * different sysfs mount points or allocators never share a handle. The
+ * first open creates a library owned copy of info and opens it with
+ * flags; later opens of the same device in the same context return
+ * that handle and ignore flags. The passed info
+ * is never opened and stays owned by the caller.
+ * @param info UIO device info struct
+ * @param flags UIO_OPEN_* flags for the first open
+ * @returns shared handle or NULL on failure and errno is set
+ */
+struct uio_info_t *uio_open_shared (struct uio_info_t* info, int flags)
+{
+	struct uio_info_t *handle;
+	int err;
+
+	if (!info || !info->devid)
+	{
+		errno = EINVAL;
+		ctx_warn (info_ctx (info), _("%s: %s"), __func__,
+			  g_strerror (errno));
+		return NULL;
+	}
+
+	pthread_mutex_lock (&shared_lock);
+
+	for (handle = shared_list; handle; handle = handle->shared_next)
+	{
+		if (handle->ctx == info->ctx && handle->devid == info->devid)
+		{
+			handle->refs++;
+			goto out;
+		}
+	}
+
+	handle = dup_uio_info (info);
+	if (!handle)
+		goto out;
+
+	if (uio_open_ex (handle, flags))
+	{
+		err = errno;
+		uio_free_info (handle);
+		handle = NULL;
+		errno = err;
+		goto out;
+	}
+
+	handle->refs = 1;
+	handle->shared_next = shared_list;
+	shared_list = handle;
+
+out:
+	pthread_mutex_unlock (&shared_lock);
+
+	return handle;
+}
+
+/**
+ * drop a reference to a shared UIO device handle
+ *
+ * The device is closed and the handle freed with the last reference.
+ * @param info shared handle returned by uio_open_shared()
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_close_shared (struct uio_info_t* info)
+{
+	struct uio_info_t **pos;
+	int ret = 0;
+
+	if (!info)
+	{
+		errno = EINVAL;
+		ctx_warn (info_ctx (info), _("%s: %s"), __func__,
+			  g_strerror (errno));
+		return -1;
+	}
+
+	pthread_mutex_lock (&shared_lock);
+
+	for (pos = &shared_list; *pos && *pos != info;
+	     pos = &(*pos)->shared_next);
+
+	if (!*pos)
+	{
+		pthread_mutex_unlock (&shared_lock);
+		errno = EINVAL;
+		ctx_warn (info_ctx (info), _("%s: %s"), __func__,
+			  g_strerror (errno));
+		return -1;
+	}
+
+	if (!--info->refs)
+	{
+		*pos = info->shared_next;
+		ret = uio_close (info);
+		uio_free_info (info);
+	}
+
+	pthread_mutex_unlock (&shared_lock);
+
+	return ret;
+}
+
+/** @} */
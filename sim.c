@@ -0,0 +1,260 @@
+/*
+ * libuio - UserspaceIO helper library
+ *
+ * Copyright (C) 2011 Benedikt Spranger
+ * based on libUIO by Hans J. Koch
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include "libuio_internal.h"
+
+/**
+ * @defgroup libuio_sim libuio simulated device functions
+ * @ingroup libuio_public
+ * @brief public simulated device functions
+ *
+ * A simulated device is an opened UIO device info struct without
+ * kernel backing: its memory bars are shared anonymous memory, and its
+ * file descriptor and the descriptor returned by uio_irq_pollfd() are
+ * each one end of a packet socket pair. Reads return the 32 bit
+ * interrupt count like the UIO core does, irqcontrol writes are
+ * accepted. It drives the library wait paths, rings and capture engine
+ * in tests. Bars are mapped at creation, lazy mapping and uio_export()
+ * are not supported.
+ * @{
+ */
+
+struct uio_sim_t {
+	struct uio_info_t *info;
+	int ctrl;
+	int pollctrl;
+	uint32_t count;
+	uint32_t irqcontrol;
+};
+
+/**
+ * create a simulated UIO device
+ * @param name device name
+ * @param nr number of memory bars
+ * @param sizes size of each memory bar in bytes
+ * @returns simulated device or NULL on failure and errno is set
+ */
+struct uio_sim_t *uio_sim_create (const char *name, int nr,
+				  const size_t *sizes)
+{
+	struct uio_info_t *info;
+	struct uio_sim_t *sim;
+	char mapname [16];
+	int sv [2], pv [2], err, i;
+
+	if (!name || nr < 0 || (nr && !sizes))
+	{
+		errno = EINVAL;
+		log_warn (_("%s: %s"), __func__, g_strerror (errno));
+		return NULL;
+	}
+
+	sim = calloc (1, sizeof (*sim));
+	info = ctx_alloc (NULL, sizeof (*info));
+	if (!sim || !info)
+		goto err_nomem;
+	sim->info = info;
+	sim->ctrl = -1;
+	sim->pollctrl = -1;
+	sim->irqcontrol = 1;
+	info->fd = -1;
+	info->irqfd = -1;
+
+	info->name = ctx_strdup (NULL, name);
+	info->version = ctx_strdup (NULL, "sim");
+	if (!info->name || !info->version)
+		goto err_nomem;
+
+	if (nr)
+	{
+		info->maps = ctx_alloc (NULL, nr * sizeof (*info->maps));
+		if (!info->maps)
+			goto err_nomem;
+		for (i = 0; i < nr; i++)
+			info->maps [i].map = MAP_FAILED;
+		info->maxmap = nr;
+	}
+
+	for (i = 0; i < nr; i++)
+	{
+		snprintf (mapname, sizeof (mapname), "map%d", i);
+		info->maps [i].name = ctx_strdup (NULL, mapname);
+		info->maps [i].addr = (unsigned long) (i + 1) << 28;
+		info->maps [i].size = sizes [i];
+		info->maps [i].map = mmap (NULL, sizes [i],
+					   PROT_READ | PROT_WRITE,
+					   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		if (info->maps [i].map == MAP_FAILED)
+		{
+			log_err (_("mmap: %s"), g_strerror (errno));
+			goto err_free;
+		}
+		if (!info->maps [i].name)
+			goto err_nomem;
+	}
+
+	if (socketpair (AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv))
+	{
+		log_err (_("socketpair: %s"), g_strerror (errno));
+		goto err_free;
+	}
+	info->fd = sv [0];
+	sim->ctrl = sv [1];
+
+	if (socketpair (AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC |
+			SOCK_NONBLOCK, 0, pv))
+	{
+		log_err (_("socketpair: %s"), g_strerror (errno));
+		goto err_free;
+	}
+	info->irqfd = pv [0];
+	sim->pollctrl = pv [1];
+
+	return sim;
+
+err_nomem:
+	errno = ENOMEM;
+	log_err (_("%s: %s"), __func__, g_strerror (errno));
+err_free:
+	err = errno;
+	if (info)
+	{
+		uio_close (info);
+		uio_free_info (info);
+	}
+	if (sim && sim->ctrl >= 0)
+		close (sim->ctrl);
+	free (sim);
+	errno = err;
+
+	return NULL;
+}
+
+/**
+ * get the opened UIO device info struct of a simulated device
+ * @param sim simulated device
+ * @returns UIO device info struct
+ */
+struct uio_info_t *uio_sim_get_info (struct uio_sim_t *sim)
+{
+	return sim ? sim->info : NULL;
+}
+
+static void sim_drain (struct uio_sim_t *sim)
+{
+	uint32_t val;
+
+	while (recv (sim->ctrl, &val, sizeof (val), MSG_DONTWAIT) ==
+	       sizeof (val))
+		sim->irqcontrol = val;
+	while (recv (sim->pollctrl, &val, sizeof (val), MSG_DONTWAIT) ==
+	       sizeof (val))
+		sim->irqcontrol = val;
+}
+
+/**
+ * raise an interrupt on a simulated device
+ * @param sim simulated device
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_sim_irq (struct uio_sim_t *sim)
+{
+	return uio_sim_irqs (sim, 1);
+}
+
+/**
+ * raise several interrupts that are delivered as one event
+ *
+ * Models a device that interrupts again before the previous interrupt
+ * was read: the reader sees the count advance by nr.
+ * @param sim simulated device
+ * @param nr number of interrupts
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_sim_irqs (struct uio_sim_t *sim, unsigned int nr)
+{
+	uint32_t count;
+
+	if (!sim || !nr)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	sim_drain (sim);
+
+	sim->count += nr;
+	count = sim->count;
+	if (send (sim->ctrl, &count, sizeof (count), MSG_NOSIGNAL) !=
+	    sizeof (count))
+		return -1;
+
+	/* like a second open file, nobody needs to poll it */
+	send (sim->pollctrl, &count, sizeof (count),
+	      MSG_NOSIGNAL | MSG_DONTWAIT);
+
+	return 0;
+}
+
+/**
+ * get the last irqcontrol value written by the library side
+ * @param sim simulated device
+ * @returns 1 if enabled, 0 if disabled
+ */
+int uio_sim_irq_enabled (struct uio_sim_t *sim)
+{
+	if (!sim)
+		return 0;
+
+	sim_drain (sim);
+
+	return sim->irqcontrol != 0;
+}
+
+/**
+ * destroy a simulated device and its info struct
+ * @param sim simulated device
+ */
+void uio_sim_destroy (struct uio_sim_t *sim)
+{
+	if (!sim)
+		return;
+
+	uio_close (sim->info);
+	uio_free_info (sim->info);
+	close (sim->ctrl);
+	close (sim->pollctrl);
+	free (sim);
+}
+
+/** @} */
@@ -0,0 +1,257 @@
+/*
+ * libuio - UserspaceIO helper library
+ *
+ * Copyright (C) 2011 Benedikt Spranger
+ * based on libUIO by Hans J. Koch
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "libuio_internal.h"
+
+/**
+ * @defgroup libuio_stats libuio statistics page functions
+ * @ingroup libuio_public
+ * @brief public functions to publish device statistics
+ *
+ * A published device gets a struct uio_stats_page_t in the POSIX shared
+ * memory object UIO_STATS_PREFIX "<pid>.<device>.<handle>", e.g.
+ * /dev/shm/libuio.1234.uio0.0; the handle number keeps several opens of
+ * the same device in one process apart. The interrupt wait paths and the register
+ * accessors bump its counters with relaxed atomics; an unpublished
+ * device costs them one predictable branch. External monitors such as
+ * uiostat map the objects read-only and sum them up, no cooperation of
+ * the observed process is needed.
+ *
+ * Devices are published by uio_stats_publish(), by opening them with
+ * UIO_OPEN_STATS or, for unmodified programs, by setting the
+ * environment variable LIBUIO_STATS. uio_close() removes the object.
+ *
+ * The page pointer is published with a release store and read with an
+ * acquire load, so accessors running on other threads see either no
+ * page or a complete one. Unpublishing only clears the pointer and
+ * unlinks the object; the mapping stays valid for accessors that loaded
+ * the pointer before and is unmapped when the info is freed.
+ * @{
+ */
+
+static unsigned int stats_seq;
+
+static void stats_name (struct uio_info_t* info, char *name, size_t size)
+{
+	const char *dev = NULL;
+
+	if (info->path)
+		dev = strrchr (info->path, '/');
+	dev = dev ? dev + 1 : (info->name ? info->name : "uio");
+
+	snprintf (name, size, "/" UIO_STATS_PREFIX "%d.%s.%u", (int) getpid (),
+		  dev, __atomic_fetch_add (&stats_seq, 1, __ATOMIC_RELAXED));
+}
+
+/**
+ * publish the statistics page of an opened UIO device
+ * @param info UIO device info struct
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_stats_publish (struct uio_info_t* info)
+{
+	struct uio_stats_page_t *page;
+	struct uio_stats_map_t *map;
+	char name [NAME_MAX];
+	int fd, err;
+
+	if (!info || info->fd == -1)
+	{
+		errno = EINVAL;
+		ctx_warn (info_ctx (info), _("%s: %s"), __func__,
+			  g_strerror (errno));
+		return -1;
+	}
+
+	if (stats_get (info))
+		return 0;
+
+	stats_name (info, name, sizeof (name));
+	fd = shm_open (name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if (fd < 0)
+		goto err;
+
+	if (ftruncate (fd, sizeof (*page)))
+	{
+		err = errno;
+		close (fd);
+		shm_unlink (name);
+		errno = err;
+		goto err;
+	}
+
+	page = mmap (NULL, sizeof (*page), PROT_READ | PROT_WRITE, MAP_SHARED,
+		     fd, 0);
+	err = errno;
+	close (fd);
+	if (page == MAP_FAILED)
+	{
+		shm_unlink (name);
+		errno = err;
+		goto err;
+	}
+
+	map = ctx_alloc (info->ctx, sizeof (*map));
+	info->stats_name = ctx_strdup (info->ctx, name);
+	if (!map || !info->stats_name)
+	{
+		ctx_free (info->ctx, map);
+		ctx_free (info->ctx, info->stats_name);
+		info->stats_name = NULL;
+		munmap (page, sizeof (*page));
+		shm_unlink (name);
+		errno = ENOMEM;
+		goto err;
+	}
+	map->page = page;
+	map->next = info->stats_maps;
+	info->stats_maps = map;
+
+	page->size = sizeof (*page);
+	page->pid = getpid ();
+	if (info->name)
+		strncpy (page->name, info->name, sizeof (page->name) - 1);
+	if (info->devname)
+		strncpy (page->devname, info->devname,
+			 sizeof (page->devname) - 1);
+	page->version = UIO_STATS_VERSION;
+
+	/* readers ignore pages without magic */
+	__atomic_store_n (&page->magic, UIO_STATS_MAGIC, __ATOMIC_RELEASE);
+	__atomic_store_n (&info->stats, page, __ATOMIC_RELEASE);
+
+	return 0;
+
+err:
+	ctx_err (info_ctx (info), _("%s: %s: %s"), __func__, name,
+		 g_strerror (errno));
+
+	return -1;
+}
+
+/**
+ * remove the statistics page of a UIO device
+ *
+ * The shared memory object is unlinked at once, the page itself stays
+ * mapped until the info is freed, so concurrent accessors are safe.
+ * @param info UIO device info struct
+ */
+void uio_stats_unpublish (struct uio_info_t* info)
+{
+	if (!info || !__atomic_exchange_n (&info->stats, NULL, __ATOMIC_ACQ_REL))
+		return;
+
+	shm_unlink (info->stats_name);
+	ctx_free (info->ctx, info->stats_name);
+	info->stats_name = NULL;
+}
+
+/**
+ * unpublish and unmap every statistics page of a UIO device
+ * @param info UIO device info struct
+ */
+void stats_release (struct uio_info_t* info)
+{
+	struct uio_stats_map_t *map;
+
+	uio_stats_unpublish (info);
+
+	while ((map = info->stats_maps))
+	{
+		info->stats_maps = map->next;
+		munmap (map->page, sizeof (*map->page));
+		ctx_free (info->ctx, map);
+	}
+}
+
+/**
+ * get the statistics page of a UIO device
+ * @param info UIO device info struct
+ * @returns statistics page or NULL if not published; the page stays
+ *          readable until the info is freed
+ */
+const struct uio_stats_page_t *uio_get_stats (struct uio_info_t* info)
+{
+	return info ? stats_get (info) : NULL;
+}
+
+/**
+ * publish the statistics page at open if requested
+ * @param info UIO device info struct
+ * @param flags UIO_OPEN_* flags
+ */
+void stats_open (struct uio_info_t* info, int flags)
+{
+	if ((flags & UIO_OPEN_STATS) || getenv ("LIBUIO_STATS"))
+		uio_stats_publish (info);
+}
+
+/**
+ * account a finished interrupt wait
+ * @param stats published statistics page of the device
+ * @param start CLOCK_MONOTONIC time the wait started
+ * @param ret result of the wait
+ */
+void stats_wait_done (struct uio_stats_page_t *stats,
+		      const struct timespec *start, int ret)
+{
+	struct timespec now;
+	uint64_t ns, max;
+
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	ns = timespec_to_ns (&now) - timespec_to_ns (start);
+
+	__atomic_fetch_add (&stats->waits, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add (&stats->wait_ns, ns, __ATOMIC_RELAXED);
+	max = __atomic_load_n (&stats->wait_max_ns, __ATOMIC_RELAXED);
+	while (ns > max &&
+	       !__atomic_compare_exchange_n (&stats->wait_max_ns, &max, ns, 1,
+					     __ATOMIC_RELAXED,
+					     __ATOMIC_RELAXED))
+		;
+
+	if (ret)
+	{
+		if (errno == ETIMEDOUT)
+			__atomic_fetch_add (&stats->timeouts, 1,
+					    __ATOMIC_RELAXED);
+		else
+			__atomic_fetch_add (&stats->errors, 1,
+					    __ATOMIC_RELAXED);
+	}
+}
+
+/** @} */
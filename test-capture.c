@@ -0,0 +1,219 @@
+/*
+ * test-capture - drive the capture engine through a simulated device.
+ *
+ * Copyright (C) 2011 Benedikt Spranger
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libuio.h"
+
+#define SEG_SIZE	256
+#define SEGMENTS	2
+#define INDEX_REG	1024
+#define EVENTS		10
+#define LAPPED		3	/* interrupts of the last event */
+
+/* container format, see capture.c */
+struct hdr_t {
+	char magic [8];
+	uint32_t version;
+	uint32_t align;
+	uint64_t seg_size;
+	uint32_t segments;
+	uint32_t reserved [9];
+};
+
+struct rec_t {
+	uint32_t magic;
+	uint32_t segment;
+	uint64_t seq;
+	uint64_t stamp;
+	uint32_t count;
+	uint32_t length;
+};
+
+struct idx_t {
+	uint64_t seq;
+	uint64_t offset;
+};
+
+struct tail_t {
+	char magic [8];
+	uint64_t records;
+	uint64_t offset;
+	uint64_t reserved;
+};
+
+static int failed;
+
+#define check(cond)							\
+	do {								\
+		if (!(cond))						\
+		{							\
+			fprintf (stderr, "%s:%d: %s\n", __FILE__,	\
+				 __LINE__, #cond);			\
+			failed = 1;					\
+		}							\
+	} while (0)
+
+static int wait_segments (struct uio_capture_t *cap, uint64_t nr)
+{
+	struct uio_capture_stats_t stats;
+	struct timespec ts = { 0, 1000000 };
+	int i;
+
+	for (i = 0; i < 5000; i++)
+	{
+		uio_capture_get_stats (cap, &stats);
+		if (stats.segments >= nr)
+			return 0;
+		nanosleep (&ts, NULL);
+	}
+
+	return -1;
+}
+
+/* segment contents of event i */
+static unsigned char pattern (int event, size_t pos)
+{
+	return (unsigned char) (event * 31 + pos);
+}
+
+static void raise_event (struct uio_sim_t *sim, int event, unsigned nr)
+{
+	struct uio_info_t *info = uio_sim_get_info (sim);
+	unsigned char *map = uio_get_mem_map (info, 0);
+	int seg = event % SEGMENTS;
+	size_t i;
+
+	for (i = 0; i < SEG_SIZE; i++)
+		map [seg * SEG_SIZE + i] = pattern (event, i);
+	uio_write32 (info, 0, INDEX_REG, seg);
+	uio_sim_irqs (sim, nr);
+}
+
+static void check_file (FILE *file)
+{
+	unsigned char data [SEG_SIZE];
+	struct tail_t tail;
+	struct hdr_t hdr;
+	struct idx_t idx;
+	struct rec_t rec;
+	long size;
+	size_t i;
+	int n;
+
+	fseek (file, 0, SEEK_SET);
+	check (fread (&hdr, sizeof (hdr), 1, file) == 1);
+	check (!memcmp (hdr.magic, "UIOCAP01", 8));
+	check (hdr.seg_size == SEG_SIZE);
+	check (hdr.segments == SEGMENTS);
+
+	fseek (file, -(long) sizeof (tail), SEEK_END);
+	size = ftell (file);
+	check (fread (&tail, sizeof (tail), 1, file) == 1);
+	check (!memcmp (tail.magic, "UIOCAPIX", 8));
+	check (tail.records == EVENTS + 1);
+	check ((long) tail.offset < size);
+
+	for (n = 0; n < (int) tail.records && !failed; n++)
+	{
+		fseek (file, tail.offset + n * sizeof (idx), SEEK_SET);
+		check (fread (&idx, sizeof (idx), 1, file) == 1);
+		check (idx.seq == (uint64_t) n);
+
+		fseek (file, idx.offset, SEEK_SET);
+		check (fread (&rec, sizeof (rec), 1, file) == 1);
+		check (rec.magic == 0x44524355);
+		check (rec.seq == (uint64_t) n);
+		check (rec.segment == (uint32_t) (n % SEGMENTS));
+		check (rec.length == SEG_SIZE);
+		check (rec.count == (uint32_t) (n < EVENTS ? n + 1 :
+						  n + LAPPED));
+
+		check (fread (data, sizeof (data), 1, file) == 1);
+		for (i = 0; i < SEG_SIZE; i++)
+			if (data [i] != pattern (n, i))
+				break;
+		check (i == SEG_SIZE);
+	}
+}
+
+int main (void)
+{
+	struct uio_capture_attr_t attr;
+	struct uio_capture_stats_t stats;
+	struct uio_capture_t *cap;
+	struct uio_sim_t *sim;
+	size_t size = 4096;
+	FILE *file;
+	int i;
+
+	sim = uio_sim_create ("capture", 1, &size);
+	file = tmpfile ();
+	if (!sim || !file)
+	{
+		perror ("setup");
+		return 99;
+	}
+
+	uio_capture_attr_init (&attr);
+	attr.map = 0;
+	attr.seg_size = SEG_SIZE;
+	attr.segments = SEGMENTS;
+	attr.index_map = 0;
+	attr.index_reg = INDEX_REG;
+	attr.buffers = 4;
+
+	cap = uio_capture_start (uio_sim_get_info (sim), &attr,
+				 fileno (file));
+	if (!cap)
+	{
+		perror ("uio_capture_start");
+		return 99;
+	}
+
+	/* one event at a time, the segment must not change under a copy */
+	for (i = 0; i < EVENTS; i++)
+	{
+		raise_event (sim, i, 1);
+		check (!wait_segments (cap, i + 1));
+	}
+
+	/* the device raised LAPPED interrupts before the engine read one */
+	raise_event (sim, EVENTS, LAPPED);
+	check (!wait_segments (cap, EVENTS + 1));
+
+	check (!uio_capture_stop (cap, &stats));
+	check (stats.segments == EVENTS + 1);
+	check (stats.overruns == LAPPED - 1);
+	check (stats.dropped == 0);
+	check (stats.error == 0);
+
+	check_file (file);
+
+	fclose (file);
+	uio_sim_destroy (sim);
+
+	return failed;
+}
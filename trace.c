@@ -0,0 +1,406 @@
+/*
+ * libuio - UserspaceIO helper library
+ *
+ * Copyright (C) 2011 Benedikt Spranger
+ * based on libUIO by Hans J. Koch
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+
+#include "libuio_internal.h"
+
+/**
+ * @defgroup libuio_trace libuio register access trace functions
+ * @ingroup libuio_public
+ * @brief public functions to record register accesses
+ *
+ * While tracing is on, every successful access through the uio_read*()
+ * and uio_write*() accessors is recorded as a struct uio_trace_rec_t in
+ * a ring owned by the calling thread: a time stamp counter read, a few
+ * plain stores and one release store. No lock is taken and the kernel
+ * is not entered, so the timing of the traced program barely changes;
+ * only the first traced access of a thread allocates its ring. Rings
+ * keep the most recent accesses, older ones are overwritten and
+ * counted.
+ *
+ * Records name their device by an index into a process wide device
+ * table. A handle gets its index on its first traced access, so
+ * simulated devices, which all share device id 0, stay apart.
+ *
+ * uio_trace_dump() merges the rings in time stamp order into the file
+ * format described in libuio.h, which the uioreplay tool re-issues
+ * against a real or simulated device.
+ * @{
+ */
+
+#define TRACE_ENTRIES_DEFAULT	65536
+
+struct trace_ring_t {
+	struct trace_ring_t *next;
+	struct uio_trace_rec_t *recs;
+	unsigned long mask;
+	unsigned long head;
+	int orphan;
+};
+
+int trace_enabled;
+
+static unsigned long trace_entries = TRACE_ENTRIES_DEFAULT;
+static struct trace_ring_t *trace_rings;
+static __thread struct trace_ring_t *trace_self;
+
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static pthread_key_t trace_key;
+
+/* device table, index + 1 of each traced handle is in info->trace_dev */
+static pthread_mutex_t trace_dev_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct uio_trace_dev_t *trace_devs;
+static uint32_t trace_nr_devs, trace_max_devs;
+
+/* calibration points of the time stamp counter */
+static uint64_t trace_tsc0, trace_ns0;
+
+static inline uint64_t trace_clock (void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc ();
+#elif defined(__aarch64__)
+	uint64_t val;
+
+	__asm__ __volatile__ ("mrs %0, cntvct_el0" : "=r" (val));
+
+	return val;
+#else
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return timespec_to_ns (&ts);
+#endif
+}
+
+static uint64_t trace_now (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return timespec_to_ns (&ts);
+}
+
+static void trace_release (void *arg)
+{
+	struct trace_ring_t *ring = arg;
+
+	/* the records stay for uio_trace_dump () */
+	__atomic_store_n (&ring->orphan, 1, __ATOMIC_RELEASE);
+}
+
+static void trace_init_key (void)
+{
+	pthread_key_create (&trace_key, trace_release);
+}
+
+static struct trace_ring_t *trace_ring_get (void)
+{
+	struct trace_ring_t *ring, *head;
+	unsigned long size = 1;
+	int one = 1;
+
+	pthread_once (&trace_once, trace_init_key);
+
+	/* adopt the empty ring of a thread that is gone */
+	for (ring = __atomic_load_n (&trace_rings, __ATOMIC_ACQUIRE); ring;
+	     ring = ring->next)
+	{
+		if (!__atomic_load_n (&ring->head, __ATOMIC_RELAXED) &&
+		    __atomic_compare_exchange_n (&ring->orphan, &one, 0, 0,
+						 __ATOMIC_ACQUIRE,
+						 __ATOMIC_RELAXED))
+			goto out;
+		one = 1;
+	}
+
+	while (size < __atomic_load_n (&trace_entries, __ATOMIC_RELAXED))
+		size <<= 1;
+
+	ring = calloc (1, sizeof (*ring));
+	if (ring)
+		ring->recs = malloc (size * sizeof (*ring->recs));
+	if (!ring || !ring->recs)
+	{
+		free (ring);
+		return NULL;
+	}
+	ring->mask = size - 1;
+
+	head = __atomic_load_n (&trace_rings, __ATOMIC_RELAXED);
+	do
+		ring->next = head;
+	while (!__atomic_compare_exchange_n (&trace_rings, &head, ring, 1,
+					     __ATOMIC_RELEASE,
+					     __ATOMIC_RELAXED));
+
+out:
+	pthread_setspecific (trace_key, ring);
+	trace_self = ring;
+
+	return ring;
+}
+
+static uint32_t trace_dev_add (struct uio_info_t* info)
+{
+	struct uio_trace_dev_t *tmp;
+	const char *name;
+	uint32_t dev, max;
+
+	pthread_mutex_lock (&trace_dev_lock);
+
+	dev = __atomic_load_n (&info->trace_dev, __ATOMIC_RELAXED);
+	if (dev)
+		goto out;
+
+	if (trace_nr_devs == trace_max_devs)
+	{
+		max = trace_max_devs ? trace_max_devs * 2 : 8;
+		tmp = realloc (trace_devs, max * sizeof (*trace_devs));
+		if (!tmp)
+			goto out;
+		trace_devs = tmp;
+		trace_max_devs = max;
+	}
+
+	name = info->devname ? info->devname :
+		(info->name ? info->name : "");
+	memset (&trace_devs [trace_nr_devs], 0, sizeof (*trace_devs));
+	strncpy (trace_devs [trace_nr_devs].name, name,
+		 sizeof (trace_devs->name) - 1);
+
+	dev = ++trace_nr_devs;
+	__atomic_store_n (&info->trace_dev, dev, __ATOMIC_RELAXED);
+
+out:
+	pthread_mutex_unlock (&trace_dev_lock);
+
+	return dev;
+}
+
+/**
+ * record a register access, use trace_access () instead
+ * @param info UIO device info struct
+ * @param map_num memory bar number
+ * @param offset register offset
+ * @param width access width in bits
+ * @param value value read or written
+ * @param flags UIO_TRACE_WRITE for writes
+ */
+void trace_record (struct uio_info_t* info, int map_num,
+		   unsigned long offset, int width, uint64_t value, int flags)
+{
+	struct trace_ring_t *ring = trace_self;
+	struct uio_trace_rec_t *rec;
+	unsigned long pos;
+	uint32_t dev;
+
+	if (__builtin_expect (!ring, 0))
+	{
+		ring = trace_ring_get ();
+		if (!ring)
+			return;
+	}
+
+	dev = __atomic_load_n (&info->trace_dev, __ATOMIC_RELAXED);
+	if (__builtin_expect (!dev, 0))
+	{
+		dev = trace_dev_add (info);
+		if (!dev)
+			return;
+	}
+
+	pos = ring->head;
+	rec = &ring->recs [pos & ring->mask];
+	rec->tsc = trace_clock ();
+	rec->value = value;
+	rec->offset = offset;
+	rec->dev = dev - 1;
+	rec->map_num = map_num;
+	rec->width = width;
+	rec->flags = flags;
+	__atomic_store_n (&ring->head, pos + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * start recording register accesses
+ *
+ * Records of an earlier trace are discarded.
+ * @param entries records per thread, rounded up to a power of two, 0
+ *        for the default; applies to rings of threads that did not trace
+ *        before
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_trace_start (unsigned int entries)
+{
+	struct trace_ring_t *ring;
+
+	if (__atomic_load_n (&trace_enabled, __ATOMIC_RELAXED))
+	{
+		errno = EBUSY;
+		log_warn (_("%s: %s"), __func__, g_strerror (errno));
+		return -1;
+	}
+
+	if (entries)
+		__atomic_store_n (&trace_entries, entries, __ATOMIC_RELAXED);
+
+	for (ring = __atomic_load_n (&trace_rings, __ATOMIC_ACQUIRE); ring;
+	     ring = ring->next)
+		__atomic_store_n (&ring->head, 0, __ATOMIC_RELAXED);
+
+	trace_ns0 = trace_now ();
+	trace_tsc0 = trace_clock ();
+	__atomic_store_n (&trace_enabled, 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/**
+ * stop recording register accesses
+ */
+void uio_trace_stop (void)
+{
+	__atomic_store_n (&trace_enabled, 0, __ATOMIC_RELEASE);
+}
+
+static int trace_cmp (const void *a, const void *b)
+{
+	const struct uio_trace_rec_t *ra = a, *rb = b;
+
+	return (ra->tsc > rb->tsc) - (ra->tsc < rb->tsc);
+}
+
+static int write_all (int fd, const void *buf, size_t len)
+{
+	const char *ptr = buf;
+	ssize_t ret;
+
+	while (len)
+	{
+		ret = write (fd, ptr, len);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return -1;
+		ptr += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+/**
+ * write the recorded register accesses to a file
+ *
+ * Tracing must be stopped and the traced threads should be done with
+ * their last access.
+ * @param fd file descriptor to write the trace to
+ * @returns number of records written or -1 on failure and errno is set
+ */
+long uio_trace_dump (int fd)
+{
+	struct uio_trace_rec_t *recs = NULL, *tmp;
+	struct uio_trace_hdr_t hdr;
+	struct trace_ring_t *ring;
+	unsigned long head, nr = 0, first, i;
+	uint64_t lost = 0, ns, tsc;
+	int ret;
+
+	if (__atomic_load_n (&trace_enabled, __ATOMIC_ACQUIRE))
+	{
+		errno = EBUSY;
+		log_warn (_("%s: %s"), __func__, g_strerror (errno));
+		return -1;
+	}
+
+	for (ring = __atomic_load_n (&trace_rings, __ATOMIC_ACQUIRE); ring;
+	     ring = ring->next)
+	{
+		head = __atomic_load_n (&ring->head, __ATOMIC_ACQUIRE);
+		first = head > ring->mask + 1 ? head - ring->mask - 1 : 0;
+		lost += first;
+
+		tmp = realloc (recs, (nr + head - first) * sizeof (*recs));
+		if (!tmp && head != first)
+		{
+			free (recs);
+			errno = ENOMEM;
+			log_err (_("%s: %s"), __func__, g_strerror (errno));
+			return -1;
+		}
+		recs = tmp;
+
+		for (i = first; i < head; i++)
+			recs [nr++] = ring->recs [i & ring->mask];
+	}
+
+	qsort (recs, nr, sizeof (*recs), trace_cmp);
+
+	ns = trace_now ();
+	tsc = trace_clock ();
+
+	memset (&hdr, 0, sizeof (hdr));
+	memcpy (hdr.magic, UIO_TRACE_MAGIC, sizeof (hdr.magic));
+	hdr.version = UIO_TRACE_VERSION;
+	hdr.rec_size = sizeof (struct uio_trace_rec_t);
+	hdr.records = nr;
+	hdr.lost = lost;
+	hdr.tsc_hz = (ns > trace_ns0) ?
+		(uint64_t) ((double) (tsc - trace_tsc0) * 1e9 /
+			    (ns - trace_ns0)) : 1000000000ULL;
+	hdr.dev_size = sizeof (struct uio_trace_dev_t);
+
+	pthread_mutex_lock (&trace_dev_lock);
+	hdr.devices = trace_nr_devs;
+	ret = write_all (fd, &hdr, sizeof (hdr)) ||
+		write_all (fd, trace_devs,
+			   trace_nr_devs * sizeof (*trace_devs)) ||
+		write_all (fd, recs, nr * sizeof (*recs));
+	pthread_mutex_unlock (&trace_dev_lock);
+
+	if (ret)
+	{
+		free (recs);
+		log_err (_("%s: %s"), __func__, g_strerror (errno));
+		return -1;
+	}
+
+	free (recs);
+
+	return nr;
+}
+
+/** @} */
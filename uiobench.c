@@ -0,0 +1,132 @@
+/*
+ * uiobench - libuio first touch latency benchmark.
+ *
+ * Copyright (C) 2011 Benedikt Spranger
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+
+#include "config.h"
+#include "libuio.h"
+
+#if ENABLE_NLS
+# include <libintl.h>
+# define _(Text) gettext (Text)
+#else
+# define textdomain(Domain)
+# define _(Text) Text
+#endif
+#define N_(Text) Text
+
+void usage (char *name);
+
+static uint64_t now_ns (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* touch every page of a bar once and report the access latencies */
+static int touch (struct uio_info_t *uio, int map, int flags, const char *desc)
+{
+	uint64_t t, min = UINT64_MAX, max = 0, sum = 0;
+	size_t size, off, pages = 0, step;
+	uint32_t val;
+
+	if (uio_open_ex (uio, flags))
+	{
+		printf (_("could not open UIO device: %s\n"), strerror (errno));
+		return -1;
+	}
+
+	size = uio_get_mem_size (uio, map);
+	step = getpagesize ();
+	for (off = 0; off + sizeof (val) <= size; off += step)
+	{
+		t = now_ns ();
+		uio_read32 (uio, map, off, &val);
+		t = now_ns () - t;
+
+		if (t < min)
+			min = t;
+		if (t > max)
+			max = t;
+		sum += t;
+		pages++;
+	}
+
+	printf (_("%-28s pages %6zu  min %6llu ns  avg %6llu ns  max %8llu ns  pagesize %zu\n"),
+		desc, pages, (unsigned long long) min,
+		(unsigned long long) (pages ? sum / pages : 0),
+		(unsigned long long) max, uio_get_mem_pagesize (uio, map));
+
+	uio_close (uio);
+
+	return 0;
+}
+
+int main (int argc, char **argv)
+{
+	struct uio_info_t *uio;
+	int map = 0;
+
+	if (argc < 2)
+	{
+		usage (argv [0]);
+		return -1;
+	}
+
+	textdomain (PACKAGE);
+
+	uio = uio_find_by_uio_name (argv [1]);
+	if (!uio)
+	{
+		printf (_("could not find UIO device >%s<.\n"), argv [1]);
+		return -1;
+	}
+
+	if (argc > 2)
+		map = strtoul (argv [2], NULL, 0);
+	if (map >= uio_get_maxmap (uio))
+	{
+		printf (_("UIO device >%s< has no map %d.\n"), argv [1], map);
+		return -1;
+	}
+
+	touch (uio, map, 0, _("plain"));
+	touch (uio, map, UIO_OPEN_POPULATE, _("populate"));
+	touch (uio, map, UIO_OPEN_POPULATE | UIO_OPEN_MLOCK, _("populate+mlock"));
+	touch (uio, map, UIO_OPEN_POPULATE | UIO_OPEN_MLOCK |
+	       UIO_OPEN_HUGE_ALIGN, _("populate+mlock+huge-align"));
+
+	return 0;
+}
+
+void usage (char *name)
+{
+	printf (_("usage: %s <uio name> [<map>]\n"), name);
+}
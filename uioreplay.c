@@ -0,0 +1,535 @@
+/*
+ * uioreplay - re-issue a libuio register access trace.
+ *
+ * Copyright (C) 2011 Benedikt Spranger
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <argp.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/types.h>
+
+#include "config.h"
+#include "libuio.h"
+
+#ifdef USE_GLIB
+#include <glib.h>
+#else
+#define g_print	printf
+#endif
+
+#define EXIT_FAILURE 1
+
+#if ENABLE_NLS
+# include <libintl.h>
+# define _(Text) gettext (Text)
+#else
+# define textdomain(Domain)
+# define _(Text) Text
+#endif
+#define N_(Text) Text
+
+/* sleep instead of spinning if the next access is further away */
+#define SLEEP_NS	200000
+
+static error_t parse_opt (int key, char *arg, struct argp_state *state);
+static void show_version (FILE *stream, struct argp_state *state);
+
+/* Option flags and variables.  These are initialized in parse_opt.  */
+
+int want_dry_run;		/* --dry-run */
+int want_fast;			/* --fast */
+int want_check;			/* --check */
+double speed;			/* --speed */
+char *trace_file;
+char **dev_names;
+int nr_dev_names;
+
+static struct argp_option options [] =
+{
+	{"dry-run", 'n', NULL, 0, N_("print the trace, do not access devices"),
+	 0},
+	{"fast", 'f', NULL, 0, N_("ignore the recorded timing"), 0},
+	{"check", 'c', NULL, 0,
+	 N_("compare read values with the recorded ones"), 0},
+	{"speed", 's', N_("FACTOR"), 0,
+	 N_("replay FACTOR times faster than recorded"), 0},
+	{NULL, 0, NULL, 0, NULL, 0}
+};
+
+/* The argp functions examine these global variables.  */
+const char *argp_program_bug_address = "https://github.com/linutronix/libuio/issues";
+void (*argp_program_version_hook) (FILE *, struct argp_state *) = show_version;
+
+static struct argp argp =
+{
+	options, parse_opt, N_("TRACE [UIO NAME...]"),
+	N_("re-issue a register access trace written by uio_trace_dump ().\v"
+	   "The devices of the trace are assigned to the UIO names in order "
+	   "of their first access. Without names the trace is replayed "
+	   "against simulated devices sized to fit it."),
+	NULL, NULL, NULL
+};
+
+struct replay_dev_t {
+	uint32_t dev;
+	struct uio_info_t *info;
+	struct uio_sim_t *sim;
+	int maxmap;
+	size_t sizes [16];
+};
+
+static struct replay_dev_t devs [16];
+static int nr_devs;
+
+/* device table of the trace, empty for version 1 traces */
+static struct uio_trace_dev_t *trace_devs;
+static uint32_t nr_trace_devs;
+
+static uint64_t now_ns (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void wait_until (uint64_t target)
+{
+	struct timespec ts;
+	uint64_t now = now_ns ();
+
+	if (now + SLEEP_NS < target)
+	{
+		target -= SLEEP_NS / 2;
+		ts.tv_sec = target / 1000000000ULL;
+		ts.tv_nsec = target % 1000000000ULL;
+		clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+		target += SLEEP_NS / 2;
+	}
+
+	while (now_ns () < target)
+		;
+}
+
+static struct replay_dev_t *find_dev (uint32_t dev)
+{
+	int i;
+
+	for (i = 0; i < nr_devs; i++)
+		if (devs [i].dev == dev)
+			return &devs [i];
+
+	if (nr_devs == (int) (sizeof (devs) / sizeof (devs [0])))
+		return NULL;
+
+	devs [nr_devs].dev = dev;
+
+	return &devs [nr_devs++];
+}
+
+/* name of a recorded device, version 1 traces record the minor */
+static const char *dev_label (uint32_t dev)
+{
+	static char label [16];
+
+	if (dev < nr_trace_devs)
+		return trace_devs [dev].name;
+
+	snprintf (label, sizeof (label), "uio%u", dev);
+
+	return label;
+}
+
+static struct uio_trace_rec_t *load_trace (const char *name,
+					   struct uio_trace_hdr_t *hdr)
+{
+	struct uio_trace_rec_t *recs;
+	char *buf = NULL;
+	uint64_t i;
+	FILE *file;
+
+	file = fopen (name, "r");
+	if (!file)
+	{
+		g_print (_("could not open %s: %s\n"), name, strerror (errno));
+		return NULL;
+	}
+
+	/* version 1 headers end before the device table fields */
+	memset (hdr, 0, sizeof (*hdr));
+	if (fread (hdr, offsetof (struct uio_trace_hdr_t, devices), 1,
+		   file) != 1 ||
+	    memcmp (hdr->magic, UIO_TRACE_MAGIC, sizeof (hdr->magic)) ||
+	    hdr->version < 1 || hdr->rec_size < sizeof (*recs) ||
+	    !hdr->tsc_hz ||
+	    (hdr->version >= 2 &&
+	     (fread (&hdr->devices, sizeof (*hdr) -
+		     offsetof (struct uio_trace_hdr_t, devices), 1,
+		     file) != 1 ||
+	      hdr->dev_size < sizeof (*trace_devs))))
+	{
+		g_print (_("%s is not a libuio trace\n"), name);
+		fclose (file);
+		return NULL;
+	}
+
+	recs = calloc (hdr->records ? hdr->records : 1, sizeof (*recs));
+	buf = malloc (hdr->rec_size > hdr->dev_size ?
+		      hdr->rec_size : hdr->dev_size);
+	trace_devs = calloc (hdr->devices ? hdr->devices : 1,
+			     sizeof (*trace_devs));
+	if (!recs || !buf || !trace_devs)
+	{
+		g_print (_("out of memory\n"));
+		goto err;
+	}
+
+	for (i = 0; i < hdr->devices; i++)
+	{
+		if (fread (buf, hdr->dev_size, 1, file) != 1)
+		{
+			g_print (_("%s is truncated\n"), name);
+			goto err;
+		}
+		memcpy (&trace_devs [i], buf, sizeof (*trace_devs));
+		trace_devs [i].name [sizeof (trace_devs->name) - 1] = '\0';
+	}
+	nr_trace_devs = hdr->devices;
+
+	for (i = 0; i < hdr->records; i++)
+	{
+		if (fread (buf, hdr->rec_size, 1, file) != 1)
+		{
+			g_print (_("%s is truncated\n"), name);
+			goto err;
+		}
+		memcpy (&recs [i], buf, sizeof (*recs));
+
+		if ((recs [i].width != 8 && recs [i].width != 16 &&
+		     recs [i].width != 32 && recs [i].width != 64) ||
+		    recs [i].offset + recs [i].width / 8 < recs [i].offset ||
+		    (hdr->version >= 2 && recs [i].dev >= hdr->devices))
+		{
+			g_print (_("%s: record %llu is corrupt\n"), name,
+				 (unsigned long long) i);
+			goto err;
+		}
+	}
+
+	free (buf);
+	fclose (file);
+
+	return recs;
+
+err:
+	free (buf);
+	free (recs);
+	fclose (file);
+
+	return NULL;
+}
+
+static int setup_devs (struct uio_trace_rec_t *recs, uint64_t nr)
+{
+	struct replay_dev_t *dev;
+	uint64_t i;
+	size_t end;
+	int d, m;
+
+	for (i = 0; i < nr; i++)
+	{
+		dev = find_dev (recs [i].dev);
+		if (!dev || recs [i].map_num >= 16)
+		{
+			g_print (_("too many devices or maps in trace\n"));
+			return -1;
+		}
+
+		if (recs [i].map_num >= dev->maxmap)
+			dev->maxmap = recs [i].map_num + 1;
+		end = recs [i].offset + recs [i].width / 8;
+		if (end > dev->sizes [recs [i].map_num])
+			dev->sizes [recs [i].map_num] = end;
+	}
+
+	if (want_dry_run)
+		return 0;
+
+	if (nr_dev_names && nr_dev_names != nr_devs)
+	{
+		g_print (_("trace accesses %d devices, %d names given\n"),
+			 nr_devs, nr_dev_names);
+		return -1;
+	}
+
+	for (d = 0; d < nr_devs; d++)
+	{
+		dev = &devs [d];
+
+		if (nr_dev_names)
+		{
+			dev->info = uio_find_by_uio_name (dev_names [d]);
+			if (!dev->info)
+			{
+				g_print (_("could not find UIO device >%s<.\n"),
+					 dev_names [d]);
+				return -1;
+			}
+			if (uio_open (dev->info))
+			{
+				g_print (_("could not open UIO device >%s<: %s\n"),
+					 dev_names [d], strerror (errno));
+				return -1;
+			}
+			continue;
+		}
+
+		for (m = 0; m < dev->maxmap; m++)
+			dev->sizes [m] = (dev->sizes [m] + 4095) & ~4095UL;
+		for (m = 0; m < dev->maxmap; m++)
+			if (!dev->sizes [m])
+				dev->sizes [m] = 4096;
+
+		dev->sim = uio_sim_create ("replay", dev->maxmap, dev->sizes);
+		if (!dev->sim)
+			return -1;
+		dev->info = uio_sim_get_info (dev->sim);
+	}
+
+	return 0;
+}
+
+static int replay_one (struct uio_trace_rec_t *rec, uint64_t *val)
+{
+	struct uio_info_t *info = find_dev (rec->dev)->info;
+	uint8_t v8;
+	uint16_t v16;
+	uint32_t v32;
+	uint64_t v64;
+	int ret;
+
+	if (rec->map_num >= uio_get_maxmap (info) ||
+	    rec->offset + rec->width / 8 >
+	    uio_get_mem_size (info, rec->map_num))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (rec->flags & UIO_TRACE_WRITE)
+	{
+		*val = rec->value;
+		switch (rec->width)
+		{
+		case 8:
+			return uio_write8 (info, rec->map_num, rec->offset,
+					   rec->value);
+		case 16:
+			return uio_write16 (info, rec->map_num, rec->offset,
+					    rec->value);
+		case 32:
+			return uio_write32 (info, rec->map_num, rec->offset,
+					    rec->value);
+		default:
+			return uio_write64 (info, rec->map_num, rec->offset,
+					    rec->value);
+		}
+	}
+
+	switch (rec->width)
+	{
+	case 8:
+		ret = uio_read8 (info, rec->map_num, rec->offset, &v8);
+		*val = v8;
+		break;
+	case 16:
+		ret = uio_read16 (info, rec->map_num, rec->offset, &v16);
+		*val = v16;
+		break;
+	case 32:
+		ret = uio_read32 (info, rec->map_num, rec->offset, &v32);
+		*val = v32;
+		break;
+	default:
+		ret = uio_read64 (info, rec->map_num, rec->offset, &v64);
+		*val = v64;
+		break;
+	}
+
+	return ret;
+}
+
+int main (int argc, char **argv)
+{
+	struct uio_trace_rec_t *recs;
+	struct uio_trace_hdr_t hdr;
+	uint64_t i, val, start, target, late, max_late = 0;
+	unsigned long mismatches = 0, errors = 0;
+	int d;
+
+	textdomain (PACKAGE);
+	argp_parse (&argp, argc, argv, 0, NULL, NULL);
+
+	recs = load_trace (trace_file, &hdr);
+	if (!recs)
+		return EXIT_FAILURE;
+
+	if (hdr.lost)
+		g_print (_("warning: %llu accesses were lost before the dump\n"),
+			 (unsigned long long) hdr.lost);
+
+	if (setup_devs (recs, hdr.records))
+		return EXIT_FAILURE;
+
+	start = now_ns ();
+	for (i = 0; i < hdr.records; i++)
+	{
+		struct uio_trace_rec_t *rec = &recs [i];
+
+		if (want_dry_run)
+		{
+			g_print ("%12.3f %s map %u %s%-2u 0x%08llx = 0x%llx\n",
+				 (double) (rec->tsc - recs [0].tsc) * 1e6 /
+				 hdr.tsc_hz, dev_label (rec->dev), rec->map_num,
+				 (rec->flags & UIO_TRACE_WRITE) ? "w" : "r",
+				 rec->width, (unsigned long long) rec->offset,
+				 (unsigned long long) rec->value);
+			continue;
+		}
+
+		if (!want_fast)
+		{
+			target = start + (uint64_t) ((double) (rec->tsc -
+							       recs [0].tsc) *
+						     1e9 / hdr.tsc_hz / speed);
+			wait_until (target);
+			late = now_ns () - target;
+			if (late > max_late)
+				max_late = late;
+		}
+
+		if (replay_one (rec, &val))
+		{
+			errors++;
+			continue;
+		}
+
+		if (want_check && !(rec->flags & UIO_TRACE_WRITE) &&
+		    val != rec->value)
+		{
+			mismatches++;
+			g_print (_("record %llu: %s map %u 0x%llx read 0x%llx, "
+				   "recorded 0x%llx\n"),
+				 (unsigned long long) i, dev_label (rec->dev),
+				 rec->map_num,
+				 (unsigned long long) rec->offset,
+				 (unsigned long long) val,
+				 (unsigned long long) rec->value);
+		}
+	}
+
+	if (!want_dry_run)
+		g_print (_("%llu accesses replayed in %.3f ms, %lu failed, "
+			   "%lu mismatches, max lateness %.3f us\n"),
+			 (unsigned long long) hdr.records,
+			 (now_ns () - start) / 1e6, errors, mismatches,
+			 max_late / 1e3);
+
+	for (d = 0; d < nr_devs; d++)
+	{
+		if (devs [d].sim)
+			uio_sim_destroy (devs [d].sim);
+		else if (devs [d].info)
+			uio_close (devs [d].info);
+	}
+	free (recs);
+
+	return (errors || mismatches) ? EXIT_FAILURE : 0;
+}
+
+/* Parse a single option.  */
+static error_t parse_opt (int key, char *arg, struct argp_state *state)
+{
+	switch (key)
+	{
+	case ARGP_KEY_INIT:
+		/* Set up default values.  */
+		want_dry_run = 0;
+		want_fast = 0;
+		want_check = 0;
+		speed = 1.0;
+		break;
+
+	case 'n':			/* --dry-run */
+		want_dry_run = 1;
+		break;
+
+	case 'f':			/* --fast */
+		want_fast = 1;
+		break;
+
+	case 'c':			/* --check */
+		want_check = 1;
+		break;
+
+	case 's':			/* --speed */
+		speed = strtod (arg, NULL);
+		if (speed <= 0)
+			argp_error (state, _("invalid speed %s"), arg);
+		break;
+
+	case ARGP_KEY_ARG:		/* TRACE [UIO NAME]... */
+		if (!trace_file)
+			trace_file = arg;
+		else
+		{
+			dev_names = &state->argv [state->next - 1];
+			nr_dev_names = state->argc - state->next + 1;
+			state->next = state->argc;
+		}
+		break;
+
+	case ARGP_KEY_NO_ARGS:
+		argp_usage (state);
+		break;
+
+	default:
+		return ARGP_ERR_UNKNOWN;
+	}
+	return 0;
+}
+
+/* Show the version number and copyright information.  */
+static void show_version (FILE *stream, struct argp_state *state)
+{
+	(void) state;
+
+	fputs (PACKAGE" "VERSION"\n", stream);
+	fprintf (stream, _("Written by %s.\n\n"), "Benedikt Spranger");
+	fprintf (stream, _("Copyright (C) %s %s\n"), "2011", "Benedikt Spranger");
+	fputs(_("\
+This program is free software; you may redistribute it under the terms of\n\
+the GNU General Public License.  This program has absolutely no warranty.\n"),
+	      stream);
+}
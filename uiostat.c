@@ -0,0 +1,292 @@
+/*
+ * uiostat - show libuio device statistics of all processes.
+ *
+ * Copyright (C) 2011 Benedikt Spranger
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <argp.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "config.h"
+#include "libuio.h"
+
+#ifdef USE_GLIB
+#include <glib.h>
+#else
+#define g_print	printf
+#endif
+
+#define EXIT_FAILURE 1
+
+#if ENABLE_NLS
+# include <libintl.h>
+# define _(Text) gettext (Text)
+#else
+# define textdomain(Domain)
+# define _(Text) Text
+#endif
+#define N_(Text) Text
+
+#define SHM_DIR		"/dev/shm"
+
+static error_t parse_opt (int key, char *arg, struct argp_state *state);
+static void show_version (FILE *stream, struct argp_state *state);
+
+/* Option flags and variables.  These are initialized in parse_opt.  */
+
+int want_procs;			/* --processes */
+int want_clean;			/* --clean */
+
+static struct argp_option options [] =
+{
+	{"processes", 'p', NULL, 0, N_("show one line per process"), 0},
+	{"clean", 'c', NULL, 0,
+	 N_("remove pages of processes that are gone"), 0},
+	{NULL, 0, NULL, 0, NULL, 0}
+};
+
+/* The argp functions examine these global variables.  */
+const char *argp_program_bug_address = "https://github.com/linutronix/libuio/issues";
+void (*argp_program_version_hook) (FILE *, struct argp_state *) = show_version;
+
+static struct argp argp =
+{
+	options, parse_opt, NULL,
+	N_("show statistics of libuio devices published by running processes."),
+	NULL, NULL, NULL
+};
+
+struct row_t {
+	char name [sizeof (((struct uio_stats_page_t *) 0)->name) + 1];
+	char devname [sizeof (((struct uio_stats_page_t *) 0)->devname) + 1];
+	unsigned int pid;
+	int procs;
+	uint64_t irqs;
+	uint64_t waits;
+	uint64_t wait_ns;
+	uint64_t wait_max_ns;
+	uint64_t timeouts;
+	uint64_t reads;
+	uint64_t writes;
+	uint64_t errors;
+};
+
+static struct row_t *rows;
+static int nrows;
+
+static uint64_t load (const uint64_t *counter)
+{
+	return __atomic_load_n (counter, __ATOMIC_RELAXED);
+}
+
+static struct row_t *find_row (const struct uio_stats_page_t *page)
+{
+	struct row_t *row;
+	int i;
+
+	for (i = 0; i < nrows && !want_procs; i++)
+		if (!strncmp (rows [i].name, page->name, sizeof (page->name)) &&
+		    !strncmp (rows [i].devname, page->devname,
+			      sizeof (page->devname)))
+			return &rows [i];
+
+	row = realloc (rows, (nrows + 1) * sizeof (*rows));
+	if (!row)
+		return NULL;
+	rows = row;
+
+	row = &rows [nrows++];
+	memset (row, 0, sizeof (*row));
+	memcpy (row->name, page->name, sizeof (page->name));
+	memcpy (row->devname, page->devname, sizeof (page->devname));
+	row->pid = page->pid;
+
+	return row;
+}
+
+static void add_page (const struct uio_stats_page_t *page)
+{
+	struct row_t *row;
+	uint64_t max;
+
+	row = find_row (page);
+	if (!row)
+		return;
+
+	row->procs++;
+	row->irqs += load (&page->irqs);
+	row->waits += load (&page->waits);
+	row->wait_ns += load (&page->wait_ns);
+	max = load (&page->wait_max_ns);
+	if (max > row->wait_max_ns)
+		row->wait_max_ns = max;
+	row->timeouts += load (&page->timeouts);
+	row->reads += load (&page->reads);
+	row->writes += load (&page->writes);
+	row->errors += load (&page->errors);
+}
+
+static void scan_page (const char *name)
+{
+	const struct uio_stats_page_t *page;
+	char path [NAME_MAX + 2];
+	struct stat st;
+	int fd;
+
+	snprintf (path, sizeof (path), "/%s", name);
+	fd = shm_open (path, O_RDONLY | O_CLOEXEC, 0);
+	if (fd < 0)
+		return;
+
+	if (fstat (fd, &st) || st.st_size < (off_t) sizeof (*page))
+	{
+		close (fd);
+		return;
+	}
+
+	page = mmap (NULL, sizeof (*page), PROT_READ, MAP_SHARED, fd, 0);
+	close (fd);
+	if (page == MAP_FAILED)
+		return;
+
+	/* pages of newer layouts start with the version 1 fields */
+	if (__atomic_load_n (&page->magic, __ATOMIC_ACQUIRE) ==
+	    UIO_STATS_MAGIC && page->version >= 1 &&
+	    page->size >= sizeof (*page))
+	{
+		if (kill (page->pid, 0) && errno == ESRCH)
+		{
+			if (want_clean)
+				shm_unlink (path);
+		}
+		else
+			add_page (page);
+	}
+
+	munmap ((void *) page, sizeof (*page));
+}
+
+int main (int argc, char **argv)
+{
+	struct dirent *ent;
+	struct row_t *row;
+	DIR *dir;
+	int i;
+
+	textdomain (PACKAGE);
+	argp_parse (&argp, argc, argv, 0, NULL, NULL);
+
+	dir = opendir (SHM_DIR);
+	if (!dir)
+	{
+		g_print (_("could not open %s: %s\n"), SHM_DIR,
+			 strerror (errno));
+		return EXIT_FAILURE;
+	}
+
+	while ((ent = readdir (dir)))
+		if (!strncmp (ent->d_name, UIO_STATS_PREFIX,
+			      strlen (UIO_STATS_PREFIX)))
+			scan_page (ent->d_name);
+	closedir (dir);
+
+	if (!nrows)
+	{
+		g_print (_("No published UIO devices found\n"));
+		return 1;
+	}
+
+	g_print (_("%-16s %-12s %7s %10s %10s %10s %10s %8s %12s %12s %8s\n"),
+		 _("Name"), _("DevNode"), want_procs ? _("Pid") : _("Procs"),
+		 _("Irqs"), _("Waits"), _("AvgWait"), _("MaxWait"),
+		 _("Timeouts"), _("Reads"), _("Writes"), _("Errors"));
+
+	for (i = 0; i < nrows; i++)
+	{
+		row = &rows [i];
+		g_print ("%-16s %-12s %7u %10llu %10llu %8lluus %8lluus "
+			 "%8llu %12llu %12llu %8llu\n",
+			 row->name, row->devname,
+			 want_procs ? row->pid : (unsigned int) row->procs,
+			 (unsigned long long) row->irqs,
+			 (unsigned long long) row->waits,
+			 (unsigned long long) (row->waits ?
+				row->wait_ns / row->waits / 1000 : 0),
+			 (unsigned long long) (row->wait_max_ns / 1000),
+			 (unsigned long long) row->timeouts,
+			 (unsigned long long) row->reads,
+			 (unsigned long long) row->writes,
+			 (unsigned long long) row->errors);
+	}
+
+	free (rows);
+
+	return 0;
+}
+
+/* Parse a single option.  */
+static error_t parse_opt (int key, char *arg, struct argp_state *state)
+{
+	(void) arg;
+	(void) state;
+
+	switch (key)
+	{
+	case ARGP_KEY_INIT:
+		/* Set up default values.  */
+		want_procs = 0;
+		want_clean = 0;
+		break;
+
+	case 'p':			/* --processes */
+		want_procs = 1;
+		break;
+
+	case 'c':			/* --clean */
+		want_clean = 1;
+		break;
+
+	default:
+		return ARGP_ERR_UNKNOWN;
+	}
+	return 0;
+}
+
+/* Show the version number and copyright information.  */
+static void show_version (FILE *stream, struct argp_state *state)
+{
+	(void) state;
+
+	fputs (PACKAGE" "VERSION"\n", stream);
+	fprintf (stream, _("Written by %s.\n\n"), "Benedikt Spranger");
+	fprintf (stream, _("Copyright (C) %s %s\n"), "2011", "Benedikt Spranger");
+	fputs(_("\
+This program is free software; you may redistribute it under the terms of\n\
+the GNU General Public License.  This program has absolutely no warranty.\n"),
+	      stream);
+}
@@ -0,0 +1,286 @@
+/*
+ * libuio - UserspaceIO helper library
+ *
+ * Copyright (C) 2011 Benedikt Spranger
+ * based on libUIO by Hans J. Koch
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA  02110-1301 USA
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libuio_internal.h"
+
+/**
+ * @defgroup libuio_watch libuio register watch functions
+ * @ingroup libuio_public
+ * @brief public register change watch functions
+ *
+ * A watch snapshots a 32 bit register block of a memory bar with
+ * 16 byte loads and compares it against the previous snapshot 64 bytes
+ * at a time. Only blocks with a difference are scanned word by word,
+ * so an unchanged block costs one pass at memory bandwidth. A per
+ * register mask selects the bits that count as a change; clear it for
+ * free-running counters.
+ * @{
+ */
+
+typedef uint32_t watch_vec_t __attribute__ ((vector_size (16)));
+
+struct uio_watch_t {
+	struct uio_info_t *info;
+	const volatile uint32_t *src;
+	unsigned long offset;
+	size_t words;
+	uint32_t *prev;
+	uint32_t *mask;
+};
+
+/**
+ * create a register watch and take the first snapshot
+ * @param info opened UIO device info struct
+ * @param map_num memory bar number
+ * @param offset start of the block, 16 byte aligned in the bar and in
+ *        memory
+ * @param size size of the block in bytes, multiple of 4
+ * @returns watch or NULL on failure and errno is set
+ */
+struct uio_watch_t *uio_watch_create (struct uio_info_t* info, int map_num,
+				      unsigned long offset, size_t size)
+{
+	struct uio_watch_t *watch;
+	size_t alloc, i;
+	char *map;
+
+	if (!info || map_num < 0 || map_num >= info->maxmap || !size ||
+	    (offset & 15) || (size & 3) || offset + size < offset ||
+	    offset + size > info->maps [map_num].size)
+		goto err_inval;
+
+	map = uio_get_mem_map (info, map_num);
+	if (!map)
+		return NULL;
+
+	/* the bar itself may start anywhere within its page */
+	map += info->maps [map_num].offset + offset;
+	if ((unsigned long) map & 15)
+		goto err_inval;
+
+	watch = calloc (1, sizeof (*watch));
+	if (!watch)
+		goto err_nomem;
+
+	/* whole 64 byte blocks, the tail is compared word by word */
+	alloc = (size + 63) & ~63UL;
+	if (posix_memalign ((void **) &watch->prev, 64, alloc) ||
+	    posix_memalign ((void **) &watch->mask, 64, alloc))
+		goto err_free;
+
+	watch->info = info;
+	watch->src = (void *) map;
+	watch->offset = offset;
+	watch->words = size / 4;
+
+	for (i = 0; i < watch->words; i++)
+	{
+		watch->prev [i] = watch->src [i];
+		watch->mask [i] = UINT32_MAX;
+	}
+
+	return watch;
+
+err_free:
+	free (watch->prev);
+	free (watch->mask);
+	free (watch);
+err_nomem:
+	errno = ENOMEM;
+	ctx_err (info_ctx (info), _("%s: %s"), __func__, g_strerror (errno));
+
+	return NULL;
+
+err_inval:
+	errno = EINVAL;
+	ctx_warn (info_ctx (info), _("%s: %s"), __func__, g_strerror (errno));
+
+	return NULL;
+}
+
+/**
+ * destroy a register watch
+ * @param watch register watch
+ */
+void uio_watch_destroy (struct uio_watch_t *watch)
+{
+	if (!watch)
+		return;
+
+	free (watch->prev);
+	free (watch->mask);
+	free (watch);
+}
+
+/**
+ * set the change mask of a register range
+ * @param watch register watch
+ * @param offset first register, bar offset
+ * @param size range size in bytes
+ * @param mask bits that count as a change, 0 ignores the registers
+ * @returns 0 on success or -1 on failure and errno is set
+ */
+int uio_watch_set_mask (struct uio_watch_t *watch, unsigned long offset,
+			size_t size, uint32_t mask)
+{
+	size_t first, last;
+
+	if (!watch || offset < watch->offset || (offset & 3) ||
+	    (offset - watch->offset) / 4 + (size + 3) / 4 > watch->words)
+	{
+		errno = EINVAL;
+		log_warn (_("%s: %s"), __func__, g_strerror (errno));
+		return -1;
+	}
+
+	first = (offset - watch->offset) / 4;
+	last = first + (size + 3) / 4;
+	for (; first < last; first++)
+		watch->mask [first] = mask;
+
+	return 0;
+}
+
+/**
+ * take a snapshot and report changed registers through a callback
+ * @param watch register watch
+ * @param cb called once per changed register in offset order
+ * @param arg passed to cb
+ * @returns number of changed registers or -1 on failure and errno is set
+ */
+int uio_watch_sample_cb (struct uio_watch_t *watch, uio_watch_cb_t cb,
+			 void *arg)
+{
+	struct uio_watch_change_t change;
+	const volatile watch_vec_t *src;
+	watch_vec_t *prev, *mask, cur [4], diff;
+	uint32_t *words = (uint32_t *) cur;
+	size_t i, w, blocks;
+	int changes = 0;
+
+	if (!watch || !cb)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	src = (const volatile watch_vec_t *) watch->src;
+	prev = (watch_vec_t *) watch->prev;
+	mask = (watch_vec_t *) watch->mask;
+	blocks = watch->words / 16;
+
+	mmio_rmb ();
+	for (i = 0; i < blocks; i++, src += 4, prev += 4, mask += 4)
+	{
+		cur [0] = src [0];
+		cur [1] = src [1];
+		cur [2] = src [2];
+		cur [3] = src [3];
+
+		diff = ((cur [0] ^ prev [0]) & mask [0]) |
+		       ((cur [1] ^ prev [1]) & mask [1]) |
+		       ((cur [2] ^ prev [2]) & mask [2]) |
+		       ((cur [3] ^ prev [3]) & mask [3]);
+
+		if (diff [0] | diff [1] | diff [2] | diff [3])
+		{
+			for (w = 0; w < 16; w++)
+			{
+				if (!((words [w] ^ ((uint32_t *) prev) [w]) &
+				      ((uint32_t *) mask) [w]))
+					continue;
+
+				change.offset = watch->offset + (i * 16 + w) * 4;
+				change.old_val = ((uint32_t *) prev) [w];
+				change.new_val = words [w];
+				cb (arg, &change);
+				changes++;
+			}
+		}
+
+		prev [0] = cur [0];
+		prev [1] = cur [1];
+		prev [2] = cur [2];
+		prev [3] = cur [3];
+	}
+
+	for (w = blocks * 16; w < watch->words; w++)
+	{
+		words [0] = watch->src [w];
+		if ((words [0] ^ watch->prev [w]) & watch->mask [w])
+		{
+			change.offset = watch->offset + w * 4;
+			change.old_val = watch->prev [w];
+			change.new_val = words [0];
+			cb (arg, &change);
+			changes++;
+		}
+		watch->prev [w] = words [0];
+	}
+
+	return changes;
+}
+
+struct watch_list_t {
+	struct uio_watch_change_t *changes;
+	unsigned max;
+	unsigned n;
+};
+
+static void watch_collect (void *arg, const struct uio_watch_change_t *change)
+{
+	struct watch_list_t *list = arg;
+
+	if (list->n < list->max)
+		list->changes [list->n++] = *change;
+}
+
+/**
+ * take a snapshot and store changed registers
+ * @param watch register watch
+ * @param changes array for up to max changes in offset order
+ * @param max size of the changes array
+ * @returns number of changed registers, which may be larger than max,
+ *	or -1 on failure and errno is set
+ */
+int uio_watch_sample (struct uio_watch_t *watch,
+		      struct uio_watch_change_t *changes, unsigned max)
+{
+	struct watch_list_t list = { changes, max, 0 };
+
+	if (max && !changes)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	return uio_watch_sample_cb (watch, watch_collect, &list);
+}
+
+/** @} */